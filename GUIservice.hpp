@@ -39,6 +39,8 @@ private:
     const unsigned int throttle = 300;
     GUIConnector* connector;
     boost::posix_time::ptime lastTick = boost::posix_time::microsec_clock::universal_time();
+    MetricCounter* published = MetricsRegistry::GetInstance().GetCounter("gui.published");
+    MetricCounter* throttled = MetricsRegistry::GetInstance().GetCounter("gui.throttled");
 };
 
 class BondPriceServiceListener : public ServiceListener<Price<Bond>> {
@@ -89,6 +91,10 @@ void GUIService::PersistData(Price<Bond>& data) {
     if (diff.total_milliseconds() > 300) {
         connector->Publish(data);
         lastTick = currentTick;
+        published->Increment();
+    }
+    else {
+        throttled->Increment();
     }
 }
 
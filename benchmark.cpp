@@ -0,0 +1,367 @@
+/**
+ * benchmark.cpp
+ * Micro- and macro-benchmarks for the bond trading system, run on data produced by the data generator.
+ *
+ * Usage: benchmark [options]
+ *   --filter=TEXT        only run benchmarks whose name contains TEXT
+ *   --scale=N            multiply the generated data set (20000 prices and order books, 2000 trades and inquiries) by N
+ *   --warmups=N          untimed repetitions before timing (default 2)
+ *   --repetitions=N      timed repetitions (default 5)
+ *   --directory=DIR      where the data set is generated and the flows write their output (default 'benchmark_data')
+ *   --output=FILE        where the JSON results are written (default 'benchmark.json')
+ *
+ * Micro-benchmarks: the CSV parsers, convertFractionalPriceToDouble, binary input delivery, whole reads of marketdata.csv
+ * decoded on the calling thread and on 1 to 8 workers, order book and position updates, and the CSV formatters of the
+ * historical data services. Macro-benchmarks: each of the three flows end to end, including
+ * their output files. Results are printed as a table and written as JSON with events/sec and ns/event per benchmark.
+ * Journal benchmarks: trades and position deltas appended to the write-ahead journal with group commits of 1 to 512 records.
+ * Their commit latency (append to durable) percentiles are printed after the table and added to the JSON context.
+ */
+
+#include <fstream>
+#include <map>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "benchmark.hpp"
+#include "datagenerator.hpp"
+#include "tradingflows.hpp"
+
+/**
+ * A service that only counts what it is sent, so connectors can be timed on their own.
+ */
+template<typename K, typename V>
+class BenchmarkSink : public Service<K, V> {
+public:
+    uint64_t count = 0;
+    void OnMessage(V& data) override {
+        KeepAlive(data);
+        count++;
+    }
+};
+
+struct BenchmarkOptions {
+    string filter;
+    uint64_t scale = 1;
+    int warmups = 2;
+    int repetitions = 5;
+    string directory = "benchmark_data";
+    string output = "benchmark.json";
+};
+
+bool parseOptions(int argc, char* argv[], BenchmarkOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        string option = argv[i];
+        size_t equals = option.find('=');
+        string name = option.substr(0, equals);
+        string value = equals == string::npos ? "" : option.substr(equals + 1);
+        if (name == "--filter") {
+            options.filter = value;
+        }
+        else if (name == "--scale") {
+            options.scale = max<uint64_t>(stoull(value), 1);
+        }
+        else if (name == "--warmups") {
+            options.warmups = stoi(value);
+        }
+        else if (name == "--repetitions") {
+            options.repetitions = stoi(value);
+        }
+        else if (name == "--directory") {
+            options.directory = value;
+        }
+        else if (name == "--output") {
+            options.output = value;
+        }
+        else {
+            std::cerr << "Unknown option " << option << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Read the data lines of a generated CSV file
+vector<string> readLines(const string& path) {
+    ifstream input(path);
+    if (!input) {
+        std::cerr << "Unable to open file " << path;
+        exit(1);
+    }
+    vector<string> lines;
+    string line;
+    getline(input, line);
+    while (getline(input, line)) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+// Time a connector's parse on its own, with the parsed values going to a sink
+template<typename K, typename V, typename C>
+void addParser(BenchmarkSuite& suite, const string& name, const vector<string>& lines) {
+    auto sink = new BenchmarkSink<K, V>();
+    InputFileConnector<K, V>* connector = new C("", sink);
+    suite.Add(name, MICRO_BENCHMARK, [connector, &lines](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; ++i) {
+            connector->parse(lines[i % lines.size()]);
+        }
+        return iterations;
+    });
+}
+
+// Time a connector's CSV formatting of a fixed value
+template<typename V, typename C>
+void addFormatter(BenchmarkSuite& suite, const string& name, const V& value) {
+    OutputFileConnector<V>* connector = new C("");
+    V* data = new V(value);
+    suite.Add(name, MICRO_BENCHMARK, [connector, data](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; ++i) {
+            string line = connector->toCSVString(*data);
+            KeepAlive(line);
+        }
+        return iterations;
+    });
+}
+
+void addMicroBenchmarks(BenchmarkSuite& suite, const vector<string>& prices, const vector<string>& marketData,
+    const vector<string>& trades, const vector<string>& inquiries) {
+    auto fractionalPrices = new vector<string>();
+    for (const auto& line : prices) {
+        fractionalPrices->push_back(splitString(line, ',')[1]);
+    }
+    suite.Add("convertFractionalPriceToDouble", MICRO_BENCHMARK, [fractionalPrices](uint64_t iterations) {
+        double sum = 0.0;
+        for (uint64_t i = 0; i < iterations; ++i) {
+            sum += convertFractionalPriceToDouble((*fractionalPrices)[i % fractionalPrices->size()]);
+        }
+        KeepAlive(sum);
+        return iterations;
+    });
+
+    addParser<string, Price<Bond>, BondPricesConnector>(suite, "parse.prices", prices);
+    addParser<string, OrderBook<Bond>, BondMarketDataConnector>(suite, "parse.marketdata", marketData);
+    addParser<TradeId, Trade<Bond>, BondTradesConnector>(suite, "parse.trades", trades);
+    addParser<string, Inquiry<Bond>, BondInquirySubscriber>(suite, "parse.inquiries", inquiries);
+
+    suite.Add("binary.prices", MICRO_BENCHMARK, [](uint64_t iterations) {
+        BenchmarkSink<string, Price<Bond>> sink;
+        BondPricesBinaryConnector connector("prices.bin", &sink);
+        for (uint64_t i = 0; i < iterations; ++i) {
+            connector.read();
+        }
+        return sink.count;
+    });
+    suite.Add("binary.marketdata", MICRO_BENCHMARK, [](uint64_t iterations) {
+        BenchmarkSink<string, OrderBook<Bond>> sink;
+        BondMarketDataBinaryConnector connector("marketdata.bin", &sink);
+        for (uint64_t i = 0; i < iterations; ++i) {
+            connector.read();
+        }
+        return sink.count;
+    });
+
+    for (size_t threads : { 0, 1, 2, 4, 8 }) {
+        string name = threads == 0 ? "read.marketdata" : "read.marketdata.parallel_" + to_string(threads);
+        suite.Add(name, MICRO_BENCHMARK, [threads](uint64_t iterations) {
+            BenchmarkSink<string, OrderBook<Bond>> sink;
+            BondMarketDataConnector connector("marketdata.csv", &sink);
+            connector.SetParallel(threads);
+            for (uint64_t i = 0; i < iterations; ++i) {
+                connector.read();
+            }
+            return sink.count;
+        });
+    }
+
+    // Parse the books and trades once up front, so the updates are timed without parsing.
+    auto books = new vector<OrderBook<Bond>>();
+    for (const auto& line : marketData) {
+        auto split = splitString(line, ',');
+        vector<Order> bidStack, offerStack;
+        for (int level = 1; level <= 5; ++level) {
+            bidStack.push_back(Order(convertFractionalPriceToDouble(split[2 * level - 1]), stol(split[2 * level]), BID));
+            offerStack.push_back(Order(convertFractionalPriceToDouble(split[9 + 2 * level]), stol(split[10 + 2 * level]), OFFER));
+        }
+        books->push_back(OrderBook<Bond>(BondProductService::GetInstance()->GetData(split[0]), bidStack, offerStack));
+    }
+    auto marketDataService = new BondMarketDataService();
+    suite.Add("update.book", MICRO_BENCHMARK, [books, marketDataService](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; ++i) {
+            marketDataService->OnMessage((*books)[i % books->size()]);
+        }
+        return iterations;
+    });
+
+    auto bookedTrades = new vector<Trade<Bond>>();
+    for (const auto& line : trades) {
+        auto split = splitString(line, ',');
+        bookedTrades->push_back(Trade<Bond>(BondProductService::GetInstance()->GetData(split[0]), TradeId::FromExternal(split[1]),
+            stod(split[2]), split[3], stol(split[4]), split[5] == "0" ? BUY : SELL));
+    }
+    auto positionService = new BondPositionService();
+    suite.Add("update.position", MICRO_BENCHMARK, [bookedTrades, positionService](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; ++i) {
+            positionService->AddTrade((*bookedTrades)[i % bookedTrades->size()]);
+        }
+        return iterations;
+    });
+
+    const Bond& bond = BondProductService::GetInstance()->GetData("9128283H1");
+    positionService->AddTrade(bookedTrades->front());
+    addFormatter<Position<Bond>, BondPositionConnector>(suite, "format.position", positionService->GetData(bond.GetProductId()));
+    addFormatter<PV01<Bond>, BondRiskConnector>(suite, "format.risk", PV01<Bond>(bond, 0.0185, 1000000));
+    addFormatter<PriceStream<Bond>, BondPriceStreamsConnector>(suite, "format.price_stream", PriceStream<Bond>(bond,
+        PriceStreamOrder(99.5, 1000000, 2000000, BID), PriceStreamOrder(99.515625, 1000000, 2000000, OFFER)));
+    addFormatter<ExecutionOrder<Bond>, BondExecutionOrderConnector>(suite, "format.execution", ExecutionOrder<Bond>(bond,
+        BID, OrderId(ORDER_ID, 1, 0, 42), MARKET, 99.5, 1000000, 0, OrderId(), false));
+}
+
+/**
+ * Journal a booked trade and its position delta per trade, committing in batches of each size. The latency histogram of the
+ * last repetition of each batch size is kept for the report.
+ */
+void addJournalBenchmarks(BenchmarkSuite& suite, const vector<string>& trades, map<size_t, LatencyHistogram>& latencies) {
+    auto records = new vector<JournalRecord>();
+    for (const auto& line : trades) {
+        auto split = splitString(line, ',');
+        JournalRecord trade = {};
+        trade.type = JOURNAL_TRADE;
+        trade.tradeId = TradeId::FromExternal(split[1]).GetValue();
+        trade.price = stod(split[2]);
+        trade.quantity = stol(split[4]);
+        trade.side = split[5] == "0" ? BUY : SELL;
+        strncpy(trade.productId, split[0].c_str(), sizeof(trade.productId) - 1);
+        strncpy(trade.book, split[3].c_str(), sizeof(trade.book) - 1);
+        records->push_back(trade);
+        JournalRecord delta = trade;
+        delta.type = JOURNAL_POSITION_DELTA;
+        delta.quantity = trade.side == BUY ? trade.quantity : -trade.quantity;
+        records->push_back(delta);
+    }
+    for (size_t batch : { 1, 8, 64, 512 }) {
+        LatencyHistogram* latency = &latencies[batch];
+        suite.Add("journal.batch_" + to_string(batch), MACRO_BENCHMARK, [records, batch, latency](uint64_t) {
+            unlink("journal.bin");
+            JournalOptions options;
+            options.commitBatch = batch;
+            JournalWriter journal("journal.bin", options);
+            for (auto record : *records) {
+                journal.Append(record);
+            }
+            journal.Close();
+            *latency = journal.GetCommitLatency();
+            return uint64_t(records->size());
+        });
+    }
+}
+
+void addMacroBenchmarks(BenchmarkSuite& suite, uint64_t priceRows, uint64_t marketDataRows, uint64_t tradeRows, uint64_t inquiryRows) {
+    auto pool = new ThreadPool();
+    // Each repetition wires a fresh set of services, as main does, so no state carries over between repetitions.
+    auto streaming = [pool, priceRows](bool binaryInput) {
+        return [pool, priceRows, binaryInput](uint64_t) {
+            QuietOutput quiet;
+            RunOptions options;
+            options.binaryInput = binaryInput;
+            auto riskService = new BondRiskService(VALUATION_DATE);
+            setupSectors(riskService);
+            auto scenarioService = new BondScenarioService(riskService->GetAnalytics(), BondScenarioService::StandardScenarios(), pool);
+            runStreamingFlow(riskService, scenarioService, options);
+            return priceRows;
+        };
+    };
+    auto trades = [pool, marketDataRows, tradeRows](bool binaryInput) {
+        return [pool, marketDataRows, tradeRows, binaryInput](uint64_t) {
+            QuietOutput quiet;
+            RunOptions options;
+            options.binaryInput = binaryInput;
+            auto riskService = new BondRiskService(VALUATION_DATE);
+            setupSectors(riskService);
+            auto scenarioService = new BondScenarioService(riskService->GetAnalytics(), BondScenarioService::StandardScenarios(), pool);
+            runTradesAndExecutionFlow(riskService, scenarioService, options);
+            return marketDataRows + tradeRows;
+        };
+    };
+    suite.Add("flow.streaming", MACRO_BENCHMARK, streaming(false));
+    suite.Add("flow.streaming.binary", MACRO_BENCHMARK, streaming(true));
+    suite.Add("flow.inquiry", MACRO_BENCHMARK, [inquiryRows](uint64_t) {
+        QuietOutput quiet;
+        runInquiryFlow(RunOptions());
+        return inquiryRows;
+    });
+    suite.Add("flow.trades_and_execution", MACRO_BENCHMARK, trades(false));
+    suite.Add("flow.trades_and_execution.binary", MACRO_BENCHMARK, trades(true));
+}
+
+int main(int argc, char* argv[]) {
+    BenchmarkOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        return 1;
+    }
+    // The flows read their inputs from and write their outputs to the current directory.
+    ofstream output(options.output, ios_base::trunc);
+    if (!output) {
+        std::cerr << "Unable to open file " << options.output << std::endl;
+        return 1;
+    }
+    mkdir(options.directory.c_str(), 0755);
+    if (chdir(options.directory.c_str()) != 0) {
+        std::cerr << "Unable to use directory " << options.directory << std::endl;
+        return 1;
+    }
+
+    GeneratorOptions data;
+    data.priceRows = 20000 * options.scale;
+    data.marketDataRows = 20000 * options.scale;
+    data.tradeRows = 2000 * options.scale;
+    data.inquiryRows = 2000 * options.scale;
+    DataGenerator(data).Run();
+    data.binary = true;
+    DataGenerator binaryData(data);
+    binaryData.WritePrices();
+    binaryData.WriteMarketData();
+    setupProducts();
+
+    auto prices = readLines("prices.csv");
+    auto marketData = readLines("marketdata.csv");
+    auto trades = readLines("trades.csv");
+    auto inquiries = readLines("inquiries.csv");
+
+    BenchmarkSuite suite(options.warmups, options.repetitions);
+    addMicroBenchmarks(suite, prices, marketData, trades, inquiries);
+    addMacroBenchmarks(suite, prices.size(), marketData.size(), trades.size(), inquiries.size());
+    map<size_t, LatencyHistogram> journalLatencies;
+    addJournalBenchmarks(suite, trades, journalLatencies);
+    suite.Run(options.filter, std::cout);
+
+    vector<pair<string, string>> context = {
+        { "seed", to_string(data.seed) },
+        { "prices", to_string(data.priceRows) },
+        { "marketdata", to_string(data.marketDataRows) },
+        { "trades", to_string(data.tradeRows) },
+        { "inquiries", to_string(data.inquiryRows) },
+        { "hardware_threads", to_string(thread::hardware_concurrency()) } };
+    double ticksPerMicro = LatencyClock::TicksPerNano() * 1000.0;
+    bool first = true;
+    for (const auto& entry : journalLatencies) {
+        const LatencyHistogram& latency = entry.second;
+        if (latency.GetCount() == 0) {
+            continue;
+        }
+        if (first) {
+            std::cout << left << setw(40) << "Journal commit latency (us)" << right << setw(12) << "p50" << setw(12) << "p99"
+                << setw(12) << "max" << endl;
+            first = false;
+        }
+        string name = "journal.batch_" + to_string(entry.first);
+        std::cout << left << setw(40) << name << right << fixed << setprecision(1)
+            << setw(12) << latency.GetPercentile(50) / ticksPerMicro
+            << setw(12) << latency.GetPercentile(99) / ticksPerMicro
+            << setw(12) << latency.GetMax() / ticksPerMicro << endl;
+        std::cout.unsetf(ios_base::floatfield);
+        context.push_back(make_pair(name + ".p50_us", to_string(latency.GetPercentile(50) / ticksPerMicro)));
+        context.push_back(make_pair(name + ".p99_us", to_string(latency.GetPercentile(99) / ticksPerMicro)));
+    }
+    suite.WriteJSON(output, context);
+    return 0;
+}
@@ -0,0 +1,214 @@
+/**
+ * benchmark.hpp
+ *
+ * This file defines the benchmark harness for the bond trading system. Key components include:
+ * - 'KeepAlive': Stops the compiler from optimizing away a value computed by a benchmark body.
+ * - 'QuietOutput': Silences std::cout while in scope, for benchmarks that run code which prints progress lines.
+ * - 'BenchmarkResult': The timings of one benchmark: events per repetition and the wall time of each repetition.
+ * - 'BenchmarkSuite': Registers benchmarks and runs them with warm-up and repetition, then reports events/sec and ns/event
+ *   as a table and as JSON.
+ *
+ * A benchmark body is given an iteration count and returns the number of events it processed. Micro-benchmarks loop
+ * 'iterations' times over their input; the suite first doubles the count until one repetition takes at least the minimum
+ * repetition time, so short bodies are timed over enough work to be stable. Macro-benchmarks ignore the count and process
+ * their whole input once per repetition. Rates are reported from the median repetition, which is robust to the odd slow run.
+ */
+
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Make the compiler assume value is read, so the work producing it cannot be elided
+template<typename T>
+inline void KeepAlive(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/**
+ * Redirects std::cout to nowhere while in scope.
+ */
+class QuietOutput {
+
+public:
+
+    QuietOutput() : saved(std::cout.rdbuf(nullptr)) {}
+    ~QuietOutput() { std::cout.rdbuf(saved); }
+
+private:
+    streambuf* saved;
+
+};
+
+enum BenchmarkKind { MICRO_BENCHMARK, MACRO_BENCHMARK };
+
+struct BenchmarkResult {
+    string name;
+    BenchmarkKind kind;
+    uint64_t iterations;
+    uint64_t eventsPerRepetition;
+    vector<double> seconds;
+
+    double GetMedianSeconds() const;
+    double GetMinSeconds() const;
+    double GetMaxSeconds() const;
+    double GetEventsPerSecond() const;
+    double GetNanosPerEvent() const;
+};
+
+class BenchmarkSuite {
+
+public:
+
+    /**
+     * @param warmups untimed repetitions run before the timed ones
+     * @param repetitions timed repetitions
+     * @param minRepetitionSeconds micro-benchmarks are scaled up until one repetition takes at least this long
+     */
+    explicit BenchmarkSuite(int warmups = 2, int repetitions = 5, double minRepetitionSeconds = 0.1);
+
+    // Register a benchmark. The body is given an iteration count and returns the number of events it processed.
+    void Add(const string& name, BenchmarkKind kind, function<uint64_t(uint64_t)> body);
+
+    // Run every benchmark whose name contains filter, printing a line per benchmark as it finishes
+    void Run(const string& filter, ostream& progress);
+
+    const vector<BenchmarkResult>& GetResults() const;
+
+    // Write the results as a JSON document, with the given context (e.g. the data set) as string fields
+    void WriteJSON(ostream& output, const vector<pair<string, string>>& context) const;
+
+private:
+    struct Benchmark {
+        string name;
+        BenchmarkKind kind;
+        function<uint64_t(uint64_t)> body;
+    };
+
+    int warmups;
+    int repetitions;
+    double minRepetitionSeconds;
+    vector<Benchmark> benchmarks;
+    vector<BenchmarkResult> results;
+
+    static double Time(const function<uint64_t(uint64_t)>& body, uint64_t iterations, uint64_t& events);
+    static string Escape(const string& text);
+
+};
+
+double BenchmarkResult::GetMedianSeconds() const {
+    vector<double> sorted(seconds);
+    sort(sorted.begin(), sorted.end());
+    size_t middle = sorted.size() / 2;
+    return sorted.empty() ? 0.0 : sorted.size() % 2 == 1 ? sorted[middle] : (sorted[middle - 1] + sorted[middle]) / 2.0;
+}
+
+double BenchmarkResult::GetMinSeconds() const {
+    return seconds.empty() ? 0.0 : *min_element(seconds.begin(), seconds.end());
+}
+
+double BenchmarkResult::GetMaxSeconds() const {
+    return seconds.empty() ? 0.0 : *max_element(seconds.begin(), seconds.end());
+}
+
+double BenchmarkResult::GetEventsPerSecond() const {
+    double median = GetMedianSeconds();
+    return median > 0.0 ? eventsPerRepetition / median : 0.0;
+}
+
+double BenchmarkResult::GetNanosPerEvent() const {
+    return eventsPerRepetition > 0 ? GetMedianSeconds() * 1e9 / eventsPerRepetition : 0.0;
+}
+
+BenchmarkSuite::BenchmarkSuite(int _warmups, int _repetitions, double _minRepetitionSeconds) {
+    warmups = max(_warmups, 0);
+    repetitions = max(_repetitions, 1);
+    minRepetitionSeconds = _minRepetitionSeconds;
+}
+
+void BenchmarkSuite::Add(const string& name, BenchmarkKind kind, function<uint64_t(uint64_t)> body) {
+    benchmarks.push_back(Benchmark{ name, kind, body });
+}
+
+void BenchmarkSuite::Run(const string& filter, ostream& progress) {
+    for (const auto& benchmark : benchmarks) {
+        if (benchmark.name.find(filter) == string::npos) {
+            continue;
+        }
+        BenchmarkResult result{ benchmark.name, benchmark.kind, 1, 0, {} };
+        uint64_t events = 0;
+        if (benchmark.kind == MICRO_BENCHMARK) {
+            // Calibration doubles as the first warm-up.
+            while (Time(benchmark.body, result.iterations, events) < minRepetitionSeconds && result.iterations < (uint64_t(1) << 40)) {
+                result.iterations *= 2;
+            }
+        }
+        for (int i = 0; i < warmups; ++i) {
+            Time(benchmark.body, result.iterations, events);
+        }
+        for (int i = 0; i < repetitions; ++i) {
+            result.seconds.push_back(Time(benchmark.body, result.iterations, events));
+        }
+        result.eventsPerRepetition = events;
+        results.push_back(result);
+
+        progress << left << setw(40) << result.name << right << setw(16) << fixed << setprecision(0)
+            << result.GetEventsPerSecond() << " events/s" << setw(12) << setprecision(1) << result.GetNanosPerEvent()
+            << " ns/event" << endl;
+        progress.unsetf(ios_base::floatfield);
+    }
+}
+
+const vector<BenchmarkResult>& BenchmarkSuite::GetResults() const {
+    return results;
+}
+
+void BenchmarkSuite::WriteJSON(ostream& output, const vector<pair<string, string>>& context) const {
+    output << "{\n  \"context\": {";
+    for (size_t i = 0; i < context.size(); ++i) {
+        output << (i > 0 ? ", " : "") << "\"" << Escape(context[i].first) << "\": \"" << Escape(context[i].second) << "\"";
+    }
+    output << "},\n  \"warmups\": " << warmups << ",\n  \"repetitions\": " << repetitions << ",\n  \"benchmarks\": [";
+    output << setprecision(9);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult& result = results[i];
+        output << (i > 0 ? "," : "") << "\n    { \"name\": \"" << Escape(result.name) << "\", \"kind\": \""
+            << (result.kind == MICRO_BENCHMARK ? "micro" : "macro") << "\", \"iterations\": " << result.iterations
+            << ", \"events\": " << result.eventsPerRepetition
+            << ", \"events_per_second\": " << result.GetEventsPerSecond()
+            << ", \"ns_per_event\": " << result.GetNanosPerEvent()
+            << ", \"median_seconds\": " << result.GetMedianSeconds()
+            << ", \"min_seconds\": " << result.GetMinSeconds()
+            << ", \"max_seconds\": " << result.GetMaxSeconds() << " }";
+    }
+    output << "\n  ]\n}\n";
+}
+
+double BenchmarkSuite::Time(const function<uint64_t(uint64_t)>& body, uint64_t iterations, uint64_t& events) {
+    auto start = chrono::steady_clock::now();
+    events = body(iterations);
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+string BenchmarkSuite::Escape(const string& text) {
+    string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+#endif //BENCHMARK_HPP
@@ -0,0 +1,516 @@
+/**
+ * binaryinput.hpp
+ *
+ * This file defines the compact binary input format for prices and market data in the bond trading system. Key components include:
+ * - 'BinaryPriceRecord' and 'BinaryMarketDataRecord': Fixed-layout records holding a product handle, prices as integer ticks
+ *   of 1/256, quantities and an optional timestamp (microseconds since the Unix epoch, 0 when the source had none).
+ * - 'BinaryInputHeader' and 'BinaryProductEntry': A 64-byte file header and the product dictionary that handles index into.
+ * - 'BinaryInputWriter': Appends records to a file and writes the dictionary and header when closed.
+ * - 'BinaryInputFile': Memory-maps a file so its records can be read as a plain array.
+ * - 'BinaryInputConnector': The binary counterpart of InputFileConnector. Records are handed to 'decode' straight out of the
+ *   mapping, with the same replay pacing as the CSV connectors, and resumes after the record count of its snapshot watermark.
+ * - 'ConvertPricesToBinary' and 'ConvertMarketDataToBinary': Convert prices.csv and marketdata.csv (with or without a
+ *   'Timestamp' column) to the binary format.
+ *
+ * A file is laid out as the header, then recordCount records of recordSize bytes, then productCount dictionary entries.
+ * Treasury prices are quoted in 1/256ths, so ticks are exact. Files are written in the native byte order.
+ */
+
+#ifndef BINARY_INPUT_HPP
+#define BINARY_INPUT_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "soa.hpp"
+#include "replay.hpp"
+#include "formatting.hpp"
+#include "snapshot.hpp"
+
+using namespace std;
+
+static const int32_t TICKS_PER_POINT = 256;
+static const int BINARY_BOOK_DEPTH = 5;
+
+// Convert a price to the nearest tick and back
+int32_t PriceToTicks(double price) {
+    return static_cast<int32_t>(lround(price * TICKS_PER_POINT));
+}
+
+double TicksToPrice(int32_t ticks) {
+    return ticks * (1.0 / TICKS_PER_POINT);
+}
+
+/**
+ * One line of prices.csv. 24 bytes.
+ */
+struct BinaryPriceRecord {
+    static const uint32_t RECORD_TYPE = 1;
+
+    int64_t timestamp;
+    uint32_t product;
+    int32_t midTicks;
+    int32_t spreadTicks;
+    uint32_t reserved;
+};
+
+/**
+ * One line of marketdata.csv: five levels a side, best first. 136 bytes.
+ */
+struct BinaryMarketDataRecord {
+    static const uint32_t RECORD_TYPE = 2;
+
+    int64_t timestamp;
+    uint32_t product;
+    uint32_t depth;
+    int32_t bidTicks[BINARY_BOOK_DEPTH];
+    int32_t offerTicks[BINARY_BOOK_DEPTH];
+    int64_t bidQuantities[BINARY_BOOK_DEPTH];
+    int64_t offerQuantities[BINARY_BOOK_DEPTH];
+};
+
+/**
+ * Header at the start of every binary input file. 64 bytes, so the records that follow are cache-line aligned in a mapping.
+ */
+struct BinaryInputHeader {
+    static const uint32_t HAS_TIMESTAMPS = 1;
+
+    char magic[8];
+    uint32_t recordType;
+    uint32_t recordSize;
+    uint64_t recordCount;
+    uint64_t dictionaryOffset;
+    uint32_t productCount;
+    uint32_t flags;
+    char reserved[24];
+};
+
+/**
+ * A product id in the dictionary, NUL-padded. The entry's position is the product handle.
+ */
+struct BinaryProductEntry {
+    char productId[16];
+};
+
+static_assert(sizeof(BinaryPriceRecord) == 24, "BinaryPriceRecord layout changed");
+static_assert(sizeof(BinaryMarketDataRecord) == 136, "BinaryMarketDataRecord layout changed");
+static_assert(sizeof(BinaryInputHeader) == 64, "BinaryInputHeader layout changed");
+
+static const char BINARY_INPUT_MAGIC[8] = { 'B', 'T', 'S', 'B', 'I', 'N', '1', '\0' };
+
+/**
+ * Writes a binary input file.
+ * Type R is the record type.
+ */
+template<typename R>
+class BinaryInputWriter {
+
+public:
+
+    BinaryInputWriter(const string& path, bool hasTimestamps);
+    ~BinaryInputWriter();
+
+    // Get the handle of a product, adding it to the dictionary if it is new
+    uint32_t Intern(const string& productId);
+
+    void Append(const R& record);
+    void Append(const R* records, size_t count);
+
+    // Write the dictionary and header. Called by the destructor if not called before.
+    void Close();
+
+    uint64_t GetRecordCount() const;
+
+private:
+    string path;
+    FILE* file;
+    uint32_t flags;
+    uint64_t recordCount;
+    vector<string> productIds;
+    unordered_map<string, uint32_t> handles;
+
+};
+
+/**
+ * A memory-mapped binary input file.
+ */
+class BinaryInputFile {
+
+public:
+
+    explicit BinaryInputFile(const string& path);
+    ~BinaryInputFile();
+
+    uint32_t GetRecordType() const;
+    uint64_t GetRecordCount() const;
+    bool HasTimestamps() const;
+
+    uint32_t GetProductCount() const;
+    string GetProductId(uint32_t handle) const;
+
+    // Get the records as an array. Exits if the file does not hold records of type R.
+    template<typename R>
+    const R* GetRecords() const;
+
+private:
+    string path;
+    const char* mapping;
+    size_t size;
+    const BinaryInputHeader* header;
+
+    BinaryInputFile(const BinaryInputFile&);
+    BinaryInputFile& operator=(const BinaryInputFile&);
+
+};
+
+/**
+ * This class is used to read binary input files into services. Implementing classes resolve the product dictionary once
+ * in 'resolve' and turn each record into a value in 'decode'.
+ * Type R is the record type.
+ */
+template<typename K, typename V, typename R>
+class BinaryInputConnector : public Connector<V> {
+private:
+    string filePath;
+    ReplayOptions replay;
+
+protected:
+    Service<K, V>* connectedService;
+    MetricCounter* events;
+
+    // Look up whatever 'decode' needs for each product handle in the file
+    virtual void resolve(const BinaryInputFile& file) = 0;
+
+    // Build the value a record holds. Throws SkippedInput if the record cannot be delivered.
+    virtual V decode(const R& record) = 0;
+
+public:
+    void Publish(V& data) override {
+        //do nothing since this is a subscribe only connector.
+    }
+
+    // Replay the file at recorded (or synthetic) event times on the next read
+    void SetReplay(const ReplayOptions& options) {
+        replay = options;
+    }
+
+    void read() {
+        BinaryInputFile file(filePath);
+        const R* records = file.GetRecords<R>();
+        uint64_t count = file.GetRecordCount();
+        uint32_t productCount = file.GetProductCount();
+        bool timed = replay.enabled && file.HasTimestamps();
+        resolve(file);
+
+        InputWatermark* watermark = Checkpointer::GetInstance().GetWatermark(filePath);
+        if (watermark && watermark->events > count) {
+            cerr << "File " << filePath << " is shorter than its snapshot watermark";
+            exit(1);
+        }
+
+        LATENCY_BEGIN_SOURCE(filePath);
+        ReplayScheduler scheduler(replay);
+        // Pacing is measured from the first record this read delivers, which follows the watermark after a restore.
+        int64_t firstTimestamp = 0;
+        uint64_t eventIndex = 0;
+        scheduler.Start();
+        for (uint64_t i = watermark ? watermark->events : 0; i < count; ++i) {
+            const R& record = records[i];
+            if (watermark) {
+                watermark->events = i + 1;
+            }
+            if (record.product >= productCount) {
+                continue;
+            }
+            if (timed) {
+                if (eventIndex == 0) {
+                    firstTimestamp = record.timestamp;
+                }
+                scheduler.WaitFor((record.timestamp - firstTimestamp) * 1000);
+            }
+            else if (replay.enabled) {
+                scheduler.WaitFor(scheduler.GetSyntheticOffset(eventIndex));
+            }
+            eventIndex++;
+            LATENCY_BEGIN_EVENT();
+            TRACE_BEGIN_EVENT();
+            try {
+                V value = decode(record);
+                DeliverInput(events, connectedService, value);
+            }
+            catch (const SkippedInput& skip) {
+                ReportSkippedInput(filePath + " for product " + file.GetProductId(record.product), skip);
+            }
+            if (watermark) {
+                Checkpointer::GetInstance().OnEvent();
+            }
+        }
+        if (replay.enabled) {
+            scheduler.GetStats().Report(std::cout, filePath, scheduler.GetElapsedSeconds());
+        }
+    }
+
+    BinaryInputConnector(const string& filePath, Service<K, V>* connectedService)
+        : filePath(filePath), connectedService(connectedService),
+        events(MetricsRegistry::GetInstance().GetCounter("input." + filePath)) {
+    }
+};
+
+template<typename R>
+BinaryInputWriter<R>::BinaryInputWriter(const string& _path, bool hasTimestamps) : path(_path) {
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+        cerr << "Unable to open file " << path;
+        exit(1);
+    }
+    setvbuf(file, nullptr, _IOFBF, 1 << 16);
+    flags = hasTimestamps ? BinaryInputHeader::HAS_TIMESTAMPS : 0;
+    recordCount = 0;
+    // Reserve the header; it is filled in on Close once the counts are known.
+    BinaryInputHeader header = {};
+    fwrite(&header, sizeof(header), 1, file);
+}
+
+template<typename R>
+BinaryInputWriter<R>::~BinaryInputWriter() {
+    Close();
+}
+
+template<typename R>
+uint32_t BinaryInputWriter<R>::Intern(const string& productId) {
+    auto inserted = handles.insert(make_pair(productId, static_cast<uint32_t>(productIds.size())));
+    if (inserted.second) {
+        if (productId.size() >= sizeof(BinaryProductEntry::productId)) {
+            cerr << "Product id too long for binary input: " << productId;
+            exit(1);
+        }
+        productIds.push_back(productId);
+    }
+    return inserted.first->second;
+}
+
+template<typename R>
+void BinaryInputWriter<R>::Append(const R& record) {
+    fwrite(&record, sizeof(R), 1, file);
+    recordCount++;
+}
+
+template<typename R>
+void BinaryInputWriter<R>::Append(const R* records, size_t count) {
+    fwrite(records, sizeof(R), count, file);
+    recordCount += count;
+}
+
+template<typename R>
+void BinaryInputWriter<R>::Close() {
+    if (!file) {
+        return;
+    }
+    BinaryInputHeader header = {};
+    memcpy(header.magic, BINARY_INPUT_MAGIC, sizeof(BINARY_INPUT_MAGIC));
+    header.recordType = R::RECORD_TYPE;
+    header.recordSize = sizeof(R);
+    header.recordCount = recordCount;
+    header.dictionaryOffset = sizeof(BinaryInputHeader) + recordCount * sizeof(R);
+    header.productCount = static_cast<uint32_t>(productIds.size());
+    header.flags = flags;
+
+    for (const auto& productId : productIds) {
+        BinaryProductEntry entry = {};
+        memcpy(entry.productId, productId.data(), productId.size());
+        fwrite(&entry, sizeof(entry), 1, file);
+    }
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file);
+    fclose(file);
+    file = nullptr;
+}
+
+template<typename R>
+uint64_t BinaryInputWriter<R>::GetRecordCount() const {
+    return recordCount;
+}
+
+BinaryInputFile::BinaryInputFile(const string& _path) : path(_path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(BinaryInputHeader)) {
+        cerr << "Unable to open file " << path;
+        exit(1);
+    }
+    size = size_t(info.st_size);
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        cerr << "Unable to map file " << path;
+        exit(1);
+    }
+    madvise(mapped, size, MADV_SEQUENTIAL);
+    mapping = static_cast<const char*>(mapped);
+    header = reinterpret_cast<const BinaryInputHeader*>(mapping);
+
+    if (memcmp(header->magic, BINARY_INPUT_MAGIC, sizeof(BINARY_INPUT_MAGIC)) != 0) {
+        cerr << "Not a binary input file: " << path;
+        exit(1);
+    }
+    if (header->dictionaryOffset != sizeof(BinaryInputHeader) + header->recordCount * header->recordSize
+        || header->dictionaryOffset + uint64_t(header->productCount) * sizeof(BinaryProductEntry) > size) {
+        cerr << "Truncated binary input file: " << path;
+        exit(1);
+    }
+}
+
+BinaryInputFile::~BinaryInputFile() {
+    munmap(const_cast<char*>(mapping), size);
+}
+
+uint32_t BinaryInputFile::GetRecordType() const {
+    return header->recordType;
+}
+
+uint64_t BinaryInputFile::GetRecordCount() const {
+    return header->recordCount;
+}
+
+bool BinaryInputFile::HasTimestamps() const {
+    return (header->flags & BinaryInputHeader::HAS_TIMESTAMPS) != 0;
+}
+
+uint32_t BinaryInputFile::GetProductCount() const {
+    return header->productCount;
+}
+
+string BinaryInputFile::GetProductId(uint32_t handle) const {
+    const auto* entries = reinterpret_cast<const BinaryProductEntry*>(mapping + header->dictionaryOffset);
+    const char* productId = entries[handle].productId;
+    return string(productId, strnlen(productId, sizeof(BinaryProductEntry::productId)));
+}
+
+template<typename R>
+const R* BinaryInputFile::GetRecords() const {
+    if (header->recordType != R::RECORD_TYPE || header->recordSize != sizeof(R)) {
+        cerr << "Unexpected record type in file " << path;
+        exit(1);
+    }
+    return reinterpret_cast<const R*>(mapping + sizeof(BinaryInputHeader));
+}
+
+/**
+ * Open a CSV input file for conversion and find its 'Timestamp' column, if any (-1 if there is none).
+ */
+void OpenInputCSV(const string& csvPath, ifstream& input, int& timestampColumn) {
+    input.open(csvPath);
+    if (!input) {
+        cerr << "Unable to open file " << csvPath;
+        exit(1);
+    }
+    string header;
+    getline(input, header);
+    if (!header.empty() && header.back() == '\r') {
+        header.pop_back();
+    }
+    auto columns = splitString(header, ',');
+    timestampColumn = -1;
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (columns[i] == "Timestamp") {
+            timestampColumn = int(i);
+        }
+    }
+}
+
+/**
+ * Read the next data line of a CSV input file, with its timestamp (in microseconds) taken out of the cells.
+ * Returns false at the end of the file.
+ */
+bool ReadInputCSV(ifstream& input, int timestampColumn, vector<string>& cells, int64_t& timestamp) {
+    string line;
+    while (getline(input, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty()) {
+            continue;
+        }
+        cells = splitString(line, ',');
+        timestamp = 0;
+        if (timestampColumn >= 0 && size_t(timestampColumn) < cells.size()) {
+            int64_t nanos;
+            if (ReplayScheduler::ParseTimestamp(cells[timestampColumn], nanos)) {
+                timestamp = nanos / 1000;
+            }
+            cells.erase(cells.begin() + timestampColumn);
+        }
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Convert prices.csv (ProductId,Mid,Spread) to binary. Returns the number of records written.
+ */
+uint64_t ConvertPricesToBinary(const string& csvPath, const string& binaryPath) {
+    ifstream input;
+    int timestampColumn;
+    OpenInputCSV(csvPath, input, timestampColumn);
+    BinaryInputWriter<BinaryPriceRecord> writer(binaryPath, timestampColumn >= 0);
+
+    vector<string> cells;
+    int64_t timestamp;
+    while (ReadInputCSV(input, timestampColumn, cells, timestamp)) {
+        if (cells.size() < 3) {
+            continue;
+        }
+        BinaryPriceRecord record = {};
+        record.timestamp = timestamp;
+        record.product = writer.Intern(cells[0]);
+        record.midTicks = PriceToTicks(convertFractionalPriceToDouble(cells[1]));
+        record.spreadTicks = PriceToTicks(convertFractionalPriceToDouble(cells[2]));
+        writer.Append(record);
+    }
+    writer.Close();
+    return writer.GetRecordCount();
+}
+
+/**
+ * Convert marketdata.csv (ProductId, then price and quantity for five bids and then five offers) to binary.
+ * Returns the number of records written.
+ */
+uint64_t ConvertMarketDataToBinary(const string& csvPath, const string& binaryPath) {
+    ifstream input;
+    int timestampColumn;
+    OpenInputCSV(csvPath, input, timestampColumn);
+    BinaryInputWriter<BinaryMarketDataRecord> writer(binaryPath, timestampColumn >= 0);
+
+    vector<string> cells;
+    int64_t timestamp;
+    while (ReadInputCSV(input, timestampColumn, cells, timestamp)) {
+        if (cells.size() < size_t(1 + 4 * BINARY_BOOK_DEPTH)) {
+            continue;
+        }
+        BinaryMarketDataRecord record = {};
+        record.timestamp = timestamp;
+        record.product = writer.Intern(cells[0]);
+        record.depth = BINARY_BOOK_DEPTH;
+        for (int i = 0; i < BINARY_BOOK_DEPTH; ++i) {
+            record.bidTicks[i] = PriceToTicks(convertFractionalPriceToDouble(cells[1 + 2 * i]));
+            record.bidQuantities[i] = stoll(cells[2 + 2 * i]);
+            record.offerTicks[i] = PriceToTicks(convertFractionalPriceToDouble(cells[1 + 2 * (BINARY_BOOK_DEPTH + i)]));
+            record.offerQuantities[i] = stoll(cells[2 + 2 * (BINARY_BOOK_DEPTH + i)]);
+        }
+        writer.Append(record);
+    }
+    writer.Close();
+    return writer.GetRecordCount();
+}
+
+#endif //BINARY_INPUT_HPP
@@ -9,7 +9,8 @@
  *   triggers the BondAlgoExecutionService's order processing method.
  *
  * The service alternates between BID and OFFER sides for executing orders, aiming to execute the full volume available
- * when the spread is minimal. It's designed to work within a larger bond trading system, integrating with other services
+ * when the spread is minimal. The side it is on and its order id sequence are checkpointed, so a restored run carries on
+ * where the snapshot left off. It's designed to work within a larger bond trading system, integrating with other services
  * like position management and execution services.
  */
 
@@ -20,27 +21,42 @@
 #include "products.hpp"
 #include "soa.hpp"
 #include "executionservice.hpp"
+#include "identifiers.hpp"
+#include "objectpool.hpp"
+#include "snapshot.hpp"
 
+/**
+ * Owns its ExecutionOrder through a pooled handle, so copies of an AlgoExecution
+ * share one order with a stable address instead of referring to a caller's local.
+ */
 template<typename T>
 class AlgoExecution {
 public:
-    explicit AlgoExecution(const ExecutionOrder<T>& executionOrder) : executionOrder(executionOrder) {}
+    explicit AlgoExecution(const Pooled<ExecutionOrder<T>>& executionOrder) : executionOrder(executionOrder) {}
+
+    explicit AlgoExecution(const ExecutionOrder<T>& executionOrder)
+        : executionOrder(Pooled<ExecutionOrder<T>>::Make(executionOrder)) {}
 
     const ExecutionOrder<T>& getExecutionOrder() const {
-        return executionOrder;
+        return *executionOrder;
     }
 
 private:
-    const ExecutionOrder<T>& executionOrder;
+    Pooled<ExecutionOrder<T>> executionOrder;
 };
 
 /**
  * Listens to updates from the BondMarketDataService
  * and acts on the OrderBook information as it becomes available.
  */
-class BondAlgoExecutionService : public Service<string, AlgoExecution<Bond>> {
+class BondAlgoExecutionService : public Service<string, AlgoExecution<Bond>>, public Checkpointable {
 public:
-    BondAlgoExecutionService() {}
+    /**
+     * @param session the trading session stamped on generated order ids
+     * @param shard the worker shard stamped on generated order ids
+     */
+    explicit BondAlgoExecutionService(unsigned int session = 1, unsigned int shard = 0)
+        : orderIds(ORDER_ID, session, shard) {}
 
     /**
    * Process an OrderBook update.
@@ -48,6 +64,7 @@ public:
    * Alternate between BID and OFFER.
    */
     void ProcessOrderBook(OrderBook<Bond>& orderBook) {
+        books->Increment();
         auto topBid = orderBook.GetBidStack()[0];
         auto topOffer = orderBook.GetOfferStack()[0];
         double spread = topOffer.GetPrice() - topBid.GetPrice();
@@ -58,19 +75,20 @@ public:
             double price = states[currentState] == BID ? topBid.GetPrice()
                 : topOffer.GetPrice();
 
-            ExecutionOrder<Bond>
-                executionOrder
+            AlgoExecution<Bond> algoExecution(Pooled<ExecutionOrder<Bond>>::Make
                 (orderBook.GetProduct(),
                     states[currentState],
-                    "Order_" + to_string(orderNumber),
+                    orderIds.Next(),
                     MARKET,
                     price,
                     volume,
                     0,
-                    "",
-                    false);
-            AlgoExecution<Bond> algoExecution(executionOrder);
+                    OrderId(),
+                    false));
+            orders->Increment();
             for (auto listener : this->GetListeners()) {
+                LATENCY_SCOPE(LISTENER_STAGE);
+                TRACE_SPAN("ProcessAdd", *listener);
                 listener->ProcessAdd(algoExecution);
             }
             cycleState();
@@ -81,14 +99,28 @@ public:
 
     }
 
+    void SaveSnapshot(SnapshotWriter& writer) override {
+        writer.AddSection("algo_execution", vector<SnapshotGeneratorRecord>{ { orderIds.GetNextSequence(), currentState, 0 } });
+    }
+
+    void RestoreSnapshot(const SnapshotFile& snapshot) override {
+        uint64_t count;
+        const SnapshotGeneratorRecord* records = snapshot.GetSection<SnapshotGeneratorRecord>("algo_execution", count);
+        if (count > 0) {
+            orderIds.SetNextSequence(records[0].nextSequence);
+            currentState = records[0].state % states.size();
+        }
+    }
+
 private:
     std::array<PricingSide, 2> states = { {PricingSide::BID, PricingSide::OFFER} };
     unsigned int currentState = 0;
     void cycleState() {
         currentState = (currentState + 1) % states.size();
-        orderNumber++;
     }
-    unsigned long int orderNumber = 1;
+    IdGenerator orderIds;
+    MetricCounter* books = MetricsRegistry::GetInstance().GetCounter("algo_execution.books");
+    MetricCounter* orders = MetricsRegistry::GetInstance().GetCounter("algo_execution.orders");
 };
 
 class BondMarketDataServiceListener : public ServiceListener<OrderBook<Bond>> {
@@ -16,18 +16,26 @@
 #include "products.hpp"
 #include "soa.hpp"
 #include "streamingservice.hpp"
+#include "objectpool.hpp"
 
+/**
+ * Owns its PriceStream through a pooled handle, so the copy kept in the dataStore
+ * and any copies handed downstream share one stream with a stable address.
+ */
 template<typename T>
 class AlgoStream {
 public:
-    explicit AlgoStream(const PriceStream<T>& priceStream) : priceStream(priceStream) {}
+    explicit AlgoStream(const Pooled<PriceStream<T>>& priceStream) : priceStream(priceStream) {}
+
+    explicit AlgoStream(const PriceStream<T>& priceStream)
+        : priceStream(Pooled<PriceStream<T>>::Make(priceStream)) {}
 
     const PriceStream<T>& getPriceStream() const {
-        return priceStream;
+        return *priceStream;
     }
 
 private:
-    const PriceStream<T>& priceStream;
+    Pooled<PriceStream<T>> priceStream;
 };
 
 class BondAlgoStreamingService : public Service<string, AlgoStream<Bond>> {
@@ -51,21 +59,12 @@ public:
             states[currentState],
             2 * states[currentState],
             PricingSide::OFFER);
-        PriceStream<Bond> priceStream(bond, bidOrder, offerOrder);
-        AlgoStream<Bond> algoStream(priceStream);
+        AlgoStream<Bond> algoStream(Pooled<PriceStream<Bond>>::Make(bond, bidOrder, offerOrder));
 
         cycleState();
-        dataStore.insert(make_pair(bond.GetProductId(), algoStream));
-        if (dataStore.find(bond.GetProductId()) == dataStore.end()) {
-            for (auto listener : this->GetListeners()) {
-                listener->ProcessAdd(algoStream);
-            }
-        }
-        else {
-            for (auto listener : this->GetListeners()) {
-                listener->ProcessUpdate(algoStream);
-            }
-        }
+        auto result = Upsert(bond.GetProductId(), algoStream);
+        streams->Increment();
+        Notify(result.stored, result.added);
     }
 
     void OnMessage(AlgoStream<Bond>& data) override {
@@ -78,6 +77,7 @@ private:
     void cycleState() {
         currentState = (currentState + 1) % states.size();
     }
+    MetricCounter* streams = MetricsRegistry::GetInstance().GetCounter("algo_streaming.streams");
 };
 
 class BondPricesServiceListener : public ServiceListener<Price<Bond>> {
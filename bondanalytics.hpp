@@ -0,0 +1,689 @@
+/**
+ * bondanalytics.hpp
+ *
+ * This file defines the bond analytics kernel for the bond trading system. Key components include:
+ * - 'BondAnalyticsEngine': Computes dirty price, yield to maturity, modified duration and PV01 for every registered bond from its
+ *   coupon, maturity and the latest clean (mid) price.
+ * - Cash-flow schedules: Each bond's semi-annual coupon schedule is built once on registration and cached. The schedules of the whole
+ *   universe are packed step-major (cash flow k of every bond is contiguous), so the pricing loops run across bonds and vectorize.
+ * - 'CurveShock': A yield curve shock given as basis point shifts at a set of tenors, linearly interpolated in between and held flat
+ *   outside. Parallel shifts, twists and key-rate bumps are all expressed this way, and bonds are fully repriced under them.
+ * - 'TenorBucket': A tenor bucket with a trapezoidal weight over cash-flow time. Each cash flow's share of PV01 is mapped onto buckets
+ *   by these weights, giving key-rate (triangular) and range (rectangular) exposures.
+ *
+ * Prices and PV01 are quoted per 100 face value. PV01 is the price change for a one basis point fall in yield.
+ */
+
+#ifndef BOND_ANALYTICS_HPP
+#define BOND_ANALYTICS_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <unordered_map>
+#include "products.hpp"
+
+using namespace std;
+
+/**
+ * A shock to the yield curve, as basis point shifts at a set of tenors (in years).
+ */
+class CurveShock {
+
+public:
+
+    // ctor for a shock from tenor/shift nodes; tenors must be increasing
+    CurveShock(string _name, const vector<double>& _tenors, const vector<double>& _shifts);
+
+    // A parallel shift of the whole curve
+    static CurveShock Parallel(const string& name, double shift);
+
+    // A twist that moves the 2Y point by shortShift and the 30Y point by longShift, linear in between
+    static CurveShock Twist(const string& name, double shortShift, double longShift);
+
+    // A triangular bump at one of the key tenors, fading to zero at the neighbouring key tenors
+    static CurveShock KeyRate(const string& name, const vector<double>& keyTenors, size_t keyIndex, double shift);
+
+    // Get the name of the shock
+    const string& GetName() const;
+
+    // Get the shift in yield (as a decimal) at a time in years
+    double GetShift(double years) const;
+
+    // Get the shifts at count semi-annual flow times, the first one firstPeriods half-years away; out[i * outStride] is flow i
+    void GetShifts(double firstPeriods, size_t count, double* out, size_t outStride) const;
+
+private:
+    string name;
+    vector<double> tenors;
+    vector<double> shifts;
+
+};
+
+/**
+ * A tenor bucket over cash-flow time (in years). The weight of a flow at time t rises linearly from 0 at start to 1 at
+ * peakStart, stays 1 until peakEnd and falls linearly to 0 at end. A bucket with start == peakStart (or peakEnd == end)
+ * has a hard edge there: inclusive at the start, exclusive at the end.
+ */
+class TenorBucket {
+
+public:
+
+    // ctor for a bucket
+    TenorBucket(string _name, double _start, double _peakStart, double _peakEnd, double _end);
+
+    // A bucket covering [start, end) with weight 1
+    static TenorBucket Range(const string& name, double start, double end);
+
+    // Triangular key-rate buckets at the given tenors; the first and last extend flat to zero and infinity
+    static vector<TenorBucket> KeyRates(const vector<double>& keyTenors);
+
+    // FrontEnd (0-3Y), Belly (3-10Y) and LongEnd (10Y+) ranges followed by key rates at the given tenors
+    static vector<TenorBucket> StandardBuckets(const vector<double>& keyTenors);
+
+    // Get the name of the bucket
+    const string& GetName() const;
+
+    // Get the weight of a cash flow at a time in years
+    double GetWeight(double years) const;
+
+    double GetStart() const { return start; }
+    double GetPeakStart() const { return peakStart; }
+    double GetPeakEnd() const { return peakEnd; }
+    double GetEnd() const { return end; }
+
+private:
+    string name;
+    double start;
+    double peakStart;
+    double peakEnd;
+    double end;
+
+};
+
+class BondAnalyticsEngine {
+
+public:
+
+    // ctor for an engine valuing bonds as of the given settlement date
+    explicit BondAnalyticsEngine(const date& _valuationDate);
+
+    // Register a bond and build its cash-flow schedule. Registering the same product again returns its existing index.
+    size_t Register(const Bond& bond);
+
+    // Is the product registered?
+    bool Contains(const string& productId) const;
+
+    // Get the index of a registered product
+    size_t GetIndex(const string& productId) const;
+
+    // Get the number of registered bonds
+    size_t GetBondCount() const;
+
+    // Get the product id of a registered bond
+    const string& GetProductId(size_t index) const;
+
+    // Set the latest clean price of a bond. Its analytics are recomputed on the next read or Refresh.
+    void SetCleanPrice(size_t index, double cleanPrice);
+
+    // Has a clean price been set for the bond?
+    bool HasCleanPrice(size_t index) const;
+
+    // Get the latest clean price of a bond
+    double GetCleanPrice(size_t index) const;
+
+    // Recompute the analytics of the whole universe in one pass.
+    void Refresh();
+
+    // Get the yield to maturity (semi-annual, as a decimal)
+    double GetYield(size_t index);
+
+    // Get the dirty price per 100 face
+    double GetDirtyPrice(size_t index);
+
+    // Get the accrued interest per 100 face
+    double GetAccruedInterest(size_t index) const;
+
+    // Get the modified duration in years
+    double GetModifiedDuration(size_t index);
+
+    // Get the PV01 per 100 face
+    double GetPV01(size_t index);
+
+    // Reprice a bond under each shock, writing dirty prices per 100 face, and return its unshocked dirty price.
+    // The bond's analytics must be fresh (see Refresh); nothing is recomputed, so bonds can be repriced on several threads.
+    double RepriceUnderShocks(size_t index, const vector<CurveShock>& shocks, double* prices) const;
+
+    // Map the PV01 (per 100 face) of every bond onto the buckets in one pass. exposures[j * GetBondCount() + b] is bucket j of bond b.
+    void ComputeBucketExposures(const vector<TenorBucket>& buckets, vector<double>& exposures);
+
+    // Map the PV01 (per 100 face) of one bond onto the buckets. exposures[j] is bucket j.
+    void ComputeBucketExposures(size_t index, const vector<TenorBucket>& buckets, double* exposures);
+
+    // Get the valuation date
+    const date& GetValuationDate() const;
+
+private:
+    static const int MAX_NEWTON_ITERATIONS = 20;
+
+    date valuationDate;
+    unordered_map<string, size_t> indices;
+    vector<string> productIds;
+
+    // Cached per-bond schedule: coupon amounts per period, with the redemption added to the last one.
+    vector<vector<double>> cashFlows;
+    // Periods (in half-years) from the valuation date to the first remaining cash flow.
+    vector<double> firstPeriods;
+    vector<double> coupons;
+    vector<double> accrued;
+
+    // Packed step-major schedule: packedFlows[k * stride + b] is cash flow k of bond b.
+    vector<double> packedFlows;
+    size_t stride;
+    size_t steps;
+    bool layoutStale;
+
+    // Per-bond scratch for Solve and Bucket, sized to stride in Pack so a single-bond solve on a price tick allocates nothing.
+    vector<double> discounts;
+    vector<double> ratios;
+    vector<double> scratchPrices;
+    vector<double> scratchWeights;
+    vector<double> targets;
+
+    vector<double> cleanPrices;
+    vector<char> hasPrice;
+    vector<char> stale;
+    vector<double> yields;
+    vector<double> dirtyPrices;
+    vector<double> durations;
+    vector<double> pv01s;
+
+    void Pack();
+    void Solve(size_t begin, size_t end);
+    void Bucket(size_t begin, size_t end, const vector<TenorBucket>& buckets, double* exposures);
+    void EnsureFresh(size_t index);
+};
+
+CurveShock::CurveShock(string _name, const vector<double>& _tenors, const vector<double>& _shifts) :
+    tenors(_tenors), shifts(_shifts) {
+    name = _name;
+}
+
+CurveShock CurveShock::Parallel(const string& name, double shift) {
+    return CurveShock(name, { 0.0 }, { shift });
+}
+
+CurveShock CurveShock::Twist(const string& name, double shortShift, double longShift) {
+    return CurveShock(name, { 2.0, 30.0 }, { shortShift, longShift });
+}
+
+/**
+ * The first key rate also covers everything shorter than it and the last key rate everything longer,
+ * so the key-rate shocks of a grid add up to a parallel shift.
+ */
+CurveShock CurveShock::KeyRate(const string& name, const vector<double>& keyTenors, size_t keyIndex, double shift) {
+    vector<double> nodeTenors, nodeShifts;
+    if (keyIndex > 0) {
+        nodeTenors.push_back(keyTenors[keyIndex - 1]);
+        nodeShifts.push_back(0.0);
+    }
+    nodeTenors.push_back(keyTenors[keyIndex]);
+    nodeShifts.push_back(shift);
+    if (keyIndex + 1 < keyTenors.size()) {
+        nodeTenors.push_back(keyTenors[keyIndex + 1]);
+        nodeShifts.push_back(0.0);
+    }
+    return CurveShock(name, nodeTenors, nodeShifts);
+}
+
+const string& CurveShock::GetName() const {
+    return name;
+}
+
+double CurveShock::GetShift(double years) const {
+    double basisPoints;
+    if (years <= tenors.front()) {
+        basisPoints = shifts.front();
+    }
+    else if (years >= tenors.back()) {
+        basisPoints = shifts.back();
+    }
+    else {
+        size_t upper = 1;
+        while (tenors[upper] < years) {
+            upper++;
+        }
+        double weight = (years - tenors[upper - 1]) / (tenors[upper] - tenors[upper - 1]);
+        basisPoints = shifts[upper - 1] + weight * (shifts[upper] - shifts[upper - 1]);
+    }
+    return basisPoints * 1e-4;
+}
+
+/**
+ * Same interpolation as GetShift, but flow times only increase, so the tenor cursor walks forward instead of searching.
+ */
+void CurveShock::GetShifts(double firstPeriods, size_t count, double* out, size_t outStride) const {
+    size_t upper = 1;
+    for (size_t i = 0; i < count; ++i) {
+        double years = (firstPeriods + static_cast<double>(i)) / 2.0;
+        double basisPoints;
+        if (years <= tenors.front()) {
+            basisPoints = shifts.front();
+        }
+        else if (years >= tenors.back()) {
+            basisPoints = shifts.back();
+        }
+        else {
+            while (tenors[upper] < years) {
+                upper++;
+            }
+            double weight = (years - tenors[upper - 1]) / (tenors[upper] - tenors[upper - 1]);
+            basisPoints = shifts[upper - 1] + weight * (shifts[upper] - shifts[upper - 1]);
+        }
+        out[i * outStride] = basisPoints * 1e-4;
+    }
+}
+
+TenorBucket::TenorBucket(string _name, double _start, double _peakStart, double _peakEnd, double _end) {
+    name = _name;
+    start = _start;
+    peakStart = _peakStart;
+    peakEnd = _peakEnd;
+    end = _end;
+}
+
+TenorBucket TenorBucket::Range(const string& name, double start, double end) {
+    return TenorBucket(name, start, start, end, end);
+}
+
+vector<TenorBucket> TenorBucket::KeyRates(const vector<double>& keyTenors) {
+    vector<TenorBucket> buckets;
+    double infinity = numeric_limits<double>::infinity();
+    for (size_t i = 0; i < keyTenors.size(); ++i) {
+        double tenor = keyTenors[i];
+        double previous = i > 0 ? keyTenors[i - 1] : 0.0;
+        double next = i + 1 < keyTenors.size() ? keyTenors[i + 1] : infinity;
+        std::ostringstream name;
+        name << "KR" << tenor << "Y";
+        buckets.push_back(TenorBucket(name.str(),
+            previous,
+            i > 0 ? tenor : 0.0,
+            i + 1 < keyTenors.size() ? tenor : infinity,
+            next));
+    }
+    return buckets;
+}
+
+vector<TenorBucket> TenorBucket::StandardBuckets(const vector<double>& keyTenors) {
+    double infinity = numeric_limits<double>::infinity();
+    vector<TenorBucket> buckets = {
+        Range("FrontEnd(0-3Y)", 0.0, 3.0),
+        Range("Belly(3-10Y)", 3.0, 10.0),
+        Range("LongEnd(10Y+)", 10.0, infinity)
+    };
+    vector<TenorBucket> keyRates = KeyRates(keyTenors);
+    buckets.insert(buckets.end(), keyRates.begin(), keyRates.end());
+    return buckets;
+}
+
+const string& TenorBucket::GetName() const {
+    return name;
+}
+
+double TenorBucket::GetWeight(double years) const {
+    double rise = peakStart > start ? (years - start) / (peakStart - start) : (years >= start ? 1.0 : 0.0);
+    double fall = end > peakEnd ? (end - years) / (end - peakEnd) : (years < end ? 1.0 : 0.0);
+    return max(0.0, min(1.0, min(rise, fall)));
+}
+
+BondAnalyticsEngine::BondAnalyticsEngine(const date& _valuationDate) : valuationDate(_valuationDate) {
+    stride = 0;
+    steps = 0;
+    layoutStale = false;
+}
+
+/**
+ * Build the semi-annual coupon schedule by stepping back from maturity.
+ * Accrued interest and the fraction of the current period use actual/actual day counts.
+ *
+ * @param bond the bond to register
+ * @return the index of the bond in the engine
+ */
+size_t BondAnalyticsEngine::Register(const Bond& bond) {
+    auto found = indices.find(bond.GetProductId());
+    if (found != indices.end()) {
+        return found->second;
+    }
+
+    size_t index = cashFlows.size();
+    indices.insert(make_pair(bond.GetProductId(), index));
+    productIds.push_back(bond.GetProductId());
+
+    double coupon = bond.GetCoupon();
+    double periodCoupon = coupon / 2.0;
+    vector<double> flows;
+    date nextCoupon = bond.GetMaturityDate();
+    date previousCoupon = nextCoupon;
+    while (previousCoupon > valuationDate) {
+        nextCoupon = previousCoupon;
+        previousCoupon = nextCoupon - months(6);
+        flows.push_back(periodCoupon);
+    }
+
+    double firstPeriod = 0.0;
+    double accruedInterest = 0.0;
+    if (!flows.empty()) {
+        // Flows were collected from maturity backwards.
+        vector<double> forward(flows.rbegin(), flows.rend());
+        forward.back() += 100.0;
+        flows.swap(forward);
+        double periodDays = static_cast<double>((nextCoupon - previousCoupon).days());
+        firstPeriod = static_cast<double>((nextCoupon - valuationDate).days()) / periodDays;
+        accruedInterest = periodCoupon * (1.0 - firstPeriod);
+    }
+
+    cashFlows.push_back(flows);
+    firstPeriods.push_back(firstPeriod);
+    coupons.push_back(coupon);
+    accrued.push_back(accruedInterest);
+    cleanPrices.push_back(0.0);
+    hasPrice.push_back(0);
+    stale.push_back(1);
+    yields.push_back(coupon / 100.0);
+    dirtyPrices.push_back(0.0);
+    durations.push_back(0.0);
+    pv01s.push_back(0.0);
+    layoutStale = true;
+    return index;
+}
+
+bool BondAnalyticsEngine::Contains(const string& productId) const {
+    return indices.find(productId) != indices.end();
+}
+
+size_t BondAnalyticsEngine::GetIndex(const string& productId) const {
+    return indices.at(productId);
+}
+
+size_t BondAnalyticsEngine::GetBondCount() const {
+    return cashFlows.size();
+}
+
+const string& BondAnalyticsEngine::GetProductId(size_t index) const {
+    return productIds[index];
+}
+
+void BondAnalyticsEngine::SetCleanPrice(size_t index, double cleanPrice) {
+    cleanPrices[index] = cleanPrice;
+    hasPrice[index] = 1;
+    stale[index] = 1;
+}
+
+bool BondAnalyticsEngine::HasCleanPrice(size_t index) const {
+    return hasPrice[index] != 0;
+}
+
+double BondAnalyticsEngine::GetCleanPrice(size_t index) const {
+    return cleanPrices[index];
+}
+
+void BondAnalyticsEngine::Refresh() {
+    if (GetBondCount() == 0) {
+        return;
+    }
+    Solve(0, GetBondCount());
+}
+
+double BondAnalyticsEngine::GetYield(size_t index) {
+    EnsureFresh(index);
+    return yields[index];
+}
+
+double BondAnalyticsEngine::GetDirtyPrice(size_t index) {
+    EnsureFresh(index);
+    return dirtyPrices[index];
+}
+
+double BondAnalyticsEngine::GetAccruedInterest(size_t index) const {
+    return accrued[index];
+}
+
+double BondAnalyticsEngine::GetModifiedDuration(size_t index) {
+    EnsureFresh(index);
+    return durations[index];
+}
+
+double BondAnalyticsEngine::GetPV01(size_t index) {
+    EnsureFresh(index);
+    return pv01s[index];
+}
+
+/**
+ * Full repricing: each cash flow is discounted at the bond's yield plus the shock at the flow's time.
+ * The shift grid is built once per (step, scenario) up front. Like Solve, the discount then runs step by step with a
+ * running factor per scenario, so the scenario loop is straight-line. Only where a scenario's shift moves between
+ * two flows (inside an interpolated segment) is that scenario's factor rebuilt with pow; parallel shocks and the flat
+ * wings of twists and key rates never need it.
+ * Scratch space is per thread, so repricing on pool workers allocates only when the grid outgrows it.
+ */
+double BondAnalyticsEngine::RepriceUnderShocks(size_t index, const vector<CurveShock>& shocks, double* prices) const {
+    static thread_local vector<double> scratch;
+    size_t scenarioCount = shocks.size();
+    const vector<double>& flows = cashFlows[index];
+    size_t flowCount = flows.size();
+    double first = firstPeriods[index];
+    double yield = yields[index];
+    if (scratch.size() < (flowCount + 2) * scenarioCount) {
+        scratch.resize((flowCount + 2) * scenarioCount);
+    }
+    // shifts[k * scenarioCount + s] is the shift of scenario s at flow k
+    double* shifts = scratch.data();
+    double* ratio = shifts + flowCount * scenarioCount;
+    double* discount = ratio + scenarioCount;
+
+    for (size_t s = 0; s < scenarioCount; ++s) {
+        shocks[s].GetShifts(first, flowCount, shifts + s, scenarioCount);
+        prices[s] = 0.0;
+    }
+    if (flowCount == 0) {
+        return dirtyPrices[index];
+    }
+    for (size_t s = 0; s < scenarioCount; ++s) {
+        ratio[s] = 1.0 / (1.0 + (yield + shifts[s]) / 2.0);
+        discount[s] = pow(ratio[s], first);
+    }
+    for (size_t k = 0; k < flowCount; ++k) {
+        double flow = flows[k];
+        for (size_t s = 0; s < scenarioCount; ++s) {
+            prices[s] += flow * discount[s];
+            discount[s] *= ratio[s];
+        }
+        if (k + 1 == flowCount) {
+            break;
+        }
+        const double* current = shifts + k * scenarioCount;
+        const double* next = current + scenarioCount;
+        double periods = first + static_cast<double>(k + 1);
+        for (size_t s = 0; s < scenarioCount; ++s) {
+            if (next[s] != current[s]) {
+                ratio[s] = 1.0 / (1.0 + (yield + next[s]) / 2.0);
+                discount[s] = pow(ratio[s], periods);
+            }
+        }
+    }
+    return dirtyPrices[index];
+}
+
+void BondAnalyticsEngine::ComputeBucketExposures(const vector<TenorBucket>& buckets, vector<double>& exposures) {
+    exposures.assign(buckets.size() * GetBondCount(), 0.0);
+    if (GetBondCount() == 0) {
+        return;
+    }
+    Refresh();
+    Bucket(0, GetBondCount(), buckets, exposures.data());
+}
+
+void BondAnalyticsEngine::ComputeBucketExposures(size_t index, const vector<TenorBucket>& buckets, double* exposures) {
+    EnsureFresh(index);
+    Bucket(index, index + 1, buckets, exposures);
+}
+
+/**
+ * The PV01 share of flow k is 1e-4 * A_k * n_k / 2 * v^(n_k + 1); these shares add up to the bond's PV01.
+ * Like Solve, this walks flows step by step across bonds [begin, end) with a running discount factor. The edge
+ * handling of each bucket is chosen once per bucket, so the inner loops are straight-line and vectorize.
+ * Output is bucket-major: exposures[j * (end - begin) + (b - begin)].
+ */
+void BondAnalyticsEngine::Bucket(size_t begin, size_t end, const vector<TenorBucket>& buckets, double* exposures) {
+    if (layoutStale) {
+        Pack();
+    }
+    size_t count = end - begin;
+    size_t bucketCount = buckets.size();
+    for (size_t i = 0; i < count * bucketCount; ++i) {
+        exposures[i] = 0.0;
+    }
+    double* discount = discounts.data();
+    double* ratio = ratios.data();
+    double* share = scratchPrices.data();
+    double* years = scratchWeights.data();
+    const double* first = &firstPeriods[begin];
+    for (size_t b = 0; b < count; ++b) {
+        ratio[b] = 1.0 / (1.0 + yields[begin + b] / 2.0);
+        discount[b] = pow(ratio[b], first[b]) * ratio[b];
+    }
+    for (size_t k = 0; k < steps; ++k) {
+        const double* flows = &packedFlows[k * stride + begin];
+        double period = static_cast<double>(k);
+        for (size_t b = 0; b < count; ++b) {
+            double periods = first[b] + period;
+            share[b] = 0.5e-4 * flows[b] * periods * discount[b];
+            years[b] = periods / 2.0;
+            discount[b] *= ratio[b];
+        }
+        for (size_t j = 0; j < bucketCount; ++j) {
+            const TenorBucket& bucket = buckets[j];
+            double* out = exposures + j * count;
+            bool softStart = bucket.GetPeakStart() > bucket.GetStart();
+            bool softEnd = bucket.GetEnd() > bucket.GetPeakEnd();
+            double riseScale = softStart ? 1.0 / (bucket.GetPeakStart() - bucket.GetStart()) : 0.0;
+            double fallScale = softEnd ? 1.0 / (bucket.GetEnd() - bucket.GetPeakEnd()) : 0.0;
+            for (size_t b = 0; b < count; ++b) {
+                double t = years[b];
+                double rise = softStart ? (t - bucket.GetStart()) * riseScale : (t >= bucket.GetStart() ? 1.0 : 0.0);
+                double fall = softEnd ? (bucket.GetEnd() - t) * fallScale : (t < bucket.GetEnd() ? 1.0 : 0.0);
+                double weight = max(0.0, min(1.0, min(rise, fall)));
+                out[b] += weight * share[b];
+            }
+        }
+    }
+}
+
+const date& BondAnalyticsEngine::GetValuationDate() const {
+    return valuationDate;
+}
+
+void BondAnalyticsEngine::EnsureFresh(size_t index) {
+    if (stale[index]) {
+        Solve(index, index + 1);
+    }
+}
+
+/**
+ * Rebuild the step-major cash-flow matrix after bonds were registered, and grow the scratch buffers to match.
+ * Bonds with fewer remaining flows are padded with zeros.
+ */
+void BondAnalyticsEngine::Pack() {
+    stride = cashFlows.size();
+    steps = 0;
+    for (const auto& flows : cashFlows) {
+        steps = max(steps, flows.size());
+    }
+    packedFlows.assign(steps * stride, 0.0);
+    for (size_t b = 0; b < stride; ++b) {
+        for (size_t k = 0; k < cashFlows[b].size(); ++k) {
+            packedFlows[k * stride + b] = cashFlows[b][k];
+        }
+    }
+    discounts.resize(stride);
+    ratios.resize(stride);
+    scratchPrices.resize(stride);
+    scratchWeights.resize(stride);
+    targets.resize(stride);
+    layoutStale = false;
+}
+
+/**
+ * Solve yields for bonds [begin, end) by Newton's method on the dirty price, then compute duration and PV01.
+ * With v = 1 / (1 + y/2) and n_k the period count of flow k, P = sum A_k v^n_k and dP/dy = -v/2 * sum n_k A_k v^n_k.
+ * Each pass walks the flows step by step with a running discount factor, so the inner loop runs across bonds
+ * with no transcendental calls and no cross-lane dependencies.
+ * Bonds without a price are valued at a yield equal to their coupon.
+ */
+void BondAnalyticsEngine::Solve(size_t begin, size_t end) {
+    if (layoutStale) {
+        Pack();
+    }
+    size_t count = end - begin;
+    double* discount = discounts.data();
+    double* ratio = ratios.data();
+    double* price = scratchPrices.data();
+    double* weighted = scratchWeights.data();
+    double* target = targets.data();
+    const double* first = &firstPeriods[begin];
+    double* yield = &yields[begin];
+
+    for (size_t b = 0; b < count; ++b) {
+        target[b] = cleanPrices[begin + b] + accrued[begin + b];
+        if (!hasPrice[begin + b]) {
+            yield[b] = coupons[begin + b] / 100.0;
+        }
+    }
+
+    for (int iteration = 0; iteration <= MAX_NEWTON_ITERATIONS; ++iteration) {
+        for (size_t b = 0; b < count; ++b) {
+            ratio[b] = 1.0 / (1.0 + yield[b] / 2.0);
+            discount[b] = pow(ratio[b], first[b]);
+            price[b] = 0.0;
+            weighted[b] = 0.0;
+        }
+        for (size_t k = 0; k < steps; ++k) {
+            const double* flows = &packedFlows[k * stride + begin];
+            double period = static_cast<double>(k);
+            for (size_t b = 0; b < count; ++b) {
+                double presentValue = flows[b] * discount[b];
+                price[b] += presentValue;
+                weighted[b] += (first[b] + period) * presentValue;
+                discount[b] *= ratio[b];
+            }
+        }
+        if (iteration == MAX_NEWTON_ITERATIONS) {
+            break;
+        }
+        double largestStep = 0.0;
+        for (size_t b = 0; b < count; ++b) {
+            double slope = -0.5 * ratio[b] * weighted[b];
+            double step = (hasPrice[begin + b] && slope != 0.0) ? (price[b] - target[b]) / slope : 0.0;
+            yield[b] -= step;
+            largestStep = max(largestStep, fabs(step));
+        }
+        if (largestStep < 1e-12) {
+            // One more pass is not needed: price and weighted already reflect the converged yields to within 1e-12.
+            break;
+        }
+    }
+
+    for (size_t b = 0; b < count; ++b) {
+        double sensitivity = 0.5 * ratio[b] * weighted[b];
+        dirtyPrices[begin + b] = price[b];
+        durations[begin + b] = price[b] > 0.0 ? sensitivity / price[b] : 0.0;
+        pv01s[begin + b] = sensitivity * 1e-4;
+        stale[begin + b] = 0;
+    }
+}
+
+#endif //BOND_ANALYTICS_HPP
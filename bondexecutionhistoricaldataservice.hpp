@@ -4,7 +4,8 @@
  * This file defines the BondExecutionHistoricalDataService and its related components for persisting execution order data in a bond trading system. Key elements include:
  * - 'BondExecutionOrderServiceListener': A listener that processes ExecutionOrder<Bond> data and forwards it to the historical data service.
  * - 'BondExecutionOrderConnector': An OutputFileConnector that formats ExecutionOrder<Bond> data into CSV strings and writes them to 'executions.csv'.
- * - 'BondExecutionHistoricalDataService': A service that extends HistoricalDataService for ExecutionOrder<Bond>. It manages the persistence of execution order data to a file.
+ * - 'BondExecutionHistoricalDataService': A service that extends HistoricalDataService for ExecutionOrder<Bond>. It manages the persistence of execution order data to a file,
+ *   or to the 'execution' columnar table when COLUMNAR_STORAGE is chosen.
  *
  * This service is integral for recording historical data of bond execution orders, which is vital for analysis, compliance, and auditing purposes within the trading system.
  */
@@ -17,6 +18,7 @@
 #include "OutputFileConnector.hpp"
 #include "streamingservice.hpp"
 #include "executionservice.hpp"
+#include "columnarstore.hpp"
 
 /**
  * Writes all ExecutionOrder to executions.csv
@@ -41,17 +43,48 @@ private:
 
 class BondExecutionHistoricalDataService : public HistoricalDataService<ExecutionOrder<Bond>> {
 public:
-    BondExecutionHistoricalDataService();
+    /**
+     * @param storage write execution.csv or the columnar 'execution' table
+     * @param directory the directory holding columnar tables
+     */
+    explicit BondExecutionHistoricalDataService(HistoricalStorage storage = CSV_STORAGE, const string& directory = "history");
     void PersistData(string persistKey, const ExecutionOrder<Bond>& data) override;
 private:
     void OnMessage(ExecutionOrder<Bond>& data) override;
     BondExecutionOrderConnector* connector;
+    ColumnarWriter* columnar;
 };
 
 void BondExecutionHistoricalDataService::PersistData(string persistKey, const ExecutionOrder<Bond>& data) {
+    Cache(persistKey, data);
+    if (columnar) {
+        columnar->Append({ ColumnValue::Integer(ColumnarWriter::Now()),
+            ColumnValue::Integer(columnar->Intern(data.GetProduct().GetProductId())),
+            ColumnValue::Integer(data.GetSide()),
+            ColumnValue::Integer(int64_t(data.GetOrderId().GetValue())),
+            ColumnValue::Integer(data.GetOrderType()),
+            ColumnValue::Real(data.GetPrice()),
+            ColumnValue::Integer(data.GetVisibleQuantity()),
+            ColumnValue::Integer(data.GetHiddenQuantity()),
+            ColumnValue::Integer(int64_t(data.GetParentOrderId().GetValue())),
+            ColumnValue::Integer(data.IsChildOrder()) });
+        return;
+    }
     connector->Publish(const_cast<ExecutionOrder<Bond> &>(data));
 }
-BondExecutionHistoricalDataService::BondExecutionHistoricalDataService() {
+BondExecutionHistoricalDataService::BondExecutionHistoricalDataService(HistoricalStorage storage, const string& directory)
+    : connector(nullptr), columnar(nullptr) {
+    // Bars track the execution price, weighted by the full order size, so the VWAP is the average execution price.
+    SetRollup([](const ExecutionOrder<Bond>& order) { return order.GetPrice(); },
+        [](const ExecutionOrder<Bond>& order) { return double(order.GetVisibleQuantity() + order.GetHiddenQuantity()); });
+    if (storage == COLUMNAR_STORAGE) {
+        columnar = new ColumnarWriter(directory, "execution", {
+            { "Timestamp", TIMESTAMP_COLUMN }, { "CUSIP", PRODUCT_COLUMN }, { "PricingSide", INT64_COLUMN },
+            { "OrderId", ENTITY_ID_COLUMN }, { "OrderType", INT64_COLUMN }, { "Price", DOUBLE_COLUMN },
+            { "VisibleQuantity", INT64_COLUMN }, { "HiddenQuantity", INT64_COLUMN },
+            { "ParentOrderId", ENTITY_ID_COLUMN }, { "IsChildOrder", INT64_COLUMN } });
+        return;
+    }
     connector = new BondExecutionOrderConnector("execution.csv");
     connector->WriteHeader();
 }
@@ -64,12 +97,12 @@ string BondExecutionOrderConnector::toCSVString(ExecutionOrder<Bond>& data) {
     oss << boost::posix_time::microsec_clock::universal_time() << "," <<
         data.GetProduct().GetProductId() << "," <<
         data.GetSide() << "," <<
-        data.GetOrderId() << "," <<
+        data.GetOrderId().ToString() << "," <<
         data.GetOrderType() << "," <<
         data.GetPrice() << "," <<
         data.GetVisibleQuantity() << "," <<
         data.GetHiddenQuantity() << "," <<
-        data.GetParentOrderId() << "," <<
+        data.GetParentOrderId().ToString() << "," <<
         data.IsChildOrder();
     return oss.str();;
 }
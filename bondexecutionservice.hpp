@@ -25,10 +25,16 @@ public:
 
     // Execute an order and notify listeners.
     void ExecuteOrder(const ExecutionOrder<Bond>& order, Market market) override {
+        executed->Increment();
         for (auto listener : this->GetListeners()) {
+            LATENCY_SCOPE(LISTENER_STAGE);
+            TRACE_SPAN("ProcessAdd", *listener);
             listener->ProcessAdd(const_cast<ExecutionOrder<Bond> &>(order));
         }
     }
+
+private:
+    MetricCounter* executed = MetricsRegistry::GetInstance().GetCounter("execution.orders");
 };
 
 class BondAlgoExecutionServiceListener : public ServiceListener<AlgoExecution<Bond>> {
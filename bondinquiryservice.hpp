@@ -5,6 +5,7 @@
  * - 'BondInquirySubscriber': An InputFileConnector to read inquiries from a file and update the InquiryService with new data.
  * - 'BondInquiryPublisher': An OutputFileConnector to output Inquiry data to a CSV file, including formatting methods for CSV strings.
  * - 'BondInquiryService': Manages bond inquiries, handling incoming messages, sending quotes, and publishing completed inquiries.
+ *   Its store of inquiries and their states can be checkpointed and restored.
  * - 'BondInquiryServiceListener': A listener for the BondInquiryService, processing added, removed, or updated inquiries.
  *
  * The service facilitates the management of bond inquiries, enabling interaction between market participants and the bond market.
@@ -25,14 +26,13 @@ public:
         connectedService) {}
 
 private:
-    void parse(string line) override {
+    Inquiry<Bond> decode(const string& line) const override {
         auto split = splitString(line, ',');
         string productId = split[0], inquiryId = split[1];
         Side side = (split[2].compare("0") == 0) ? BUY : SELL;
         long quantity = stol(split[3]);
-        auto bond = BondProductService::GetInstance()->GetData(productId);
-        auto inquiry = Inquiry<Bond>(inquiryId, bond, side, quantity, 0.0, InquiryState::RECEIVED);
-        connectedService->OnMessage(inquiry);
+        auto& bond = BondProductService::GetInstance()->GetInputProduct(productId);
+        return Inquiry<Bond>(inquiryId, bond, side, quantity, 0.0, InquiryState::RECEIVED);
     }
 };
 
@@ -57,7 +57,7 @@ public:
     }
 };
 
-class BondInquiryService : public InquiryService<Bond> {
+class BondInquiryService : public InquiryService<Bond>, public Checkpointable {
 public:
     BondInquiryService() {
         publishConnector = new BondInquiryPublisher("allinquires.csv");
@@ -65,19 +65,22 @@ public:
     }
 
     void OnMessage(Inquiry<Bond>& data) override {
-        // Store the inquiry
-        dataStore.insert(make_pair(data.GetInquiryId(), data));
+        // Store the inquiry, replacing any earlier state
+        Inquiry<Bond>& stored = Upsert(data.GetInquiryId(), data).stored;
+        messages->Increment();
 
-        if (data.GetState() == InquiryState::RECEIVED) {
+        if (stored.GetState() == InquiryState::RECEIVED) {
             // If this is a new inquiry, send a quote.
-            SendQuote(data.GetInquiryId(), 100.0);
+            SendQuote(stored.GetInquiryId(), 100.0);
         }
-        else if (data.GetState() == InquiryState::QUOTED) {
+        else if (stored.GetState() == InquiryState::QUOTED) {
             // If this is already quoted, then mark as completed and update listeners.
-            data.SetState(InquiryState::DONE);
-            publishConnector->Publish(data);
+            stored.SetState(InquiryState::DONE);
+            publishConnector->Publish(stored);
             for (auto listener : this->GetListeners()) {
-                listener->ProcessUpdate(data);
+                LATENCY_SCOPE(LISTENER_STAGE);
+                TRACE_SPAN("ProcessUpdate", *listener);
+                listener->ProcessUpdate(stored);
             }
         }
     }
@@ -88,9 +91,12 @@ public:
      * @param price
      */
     void SendQuote(const string& inquiryId, double price) override {
-        auto data = dataStore.at(inquiryId);
+        auto& data = dataStore.at(inquiryId);
         data.SetPrice(price);
+        quotes->Increment();
         for (auto listener : this->GetListeners()) {
+            LATENCY_SCOPE(LISTENER_STAGE);
+            TRACE_SPAN("ProcessAdd", *listener);
             listener->ProcessAdd(data);
         }
     }
@@ -99,8 +105,35 @@ public:
         subscribeConnector->read();
     }
 
+    void SaveSnapshot(SnapshotWriter& writer) override {
+        vector<SnapshotInquiryRecord> records;
+        records.reserve(dataStore.size());
+        for (const auto& entry : dataStore) {
+            const Inquiry<Bond>& inquiry = entry.second;
+            records.push_back(SnapshotInquiryRecord{ writer.Intern(entry.first), writer.Intern(inquiry.GetProduct().GetProductId()),
+                inquiry.GetSide(), inquiry.GetState(), inquiry.GetQuantity(), inquiry.GetPrice() });
+        }
+        writer.AddSection("inquiries", records);
+    }
+
+    void RestoreSnapshot(const SnapshotFile& snapshot) override {
+        uint64_t count;
+        const SnapshotInquiryRecord* records = snapshot.GetSection<SnapshotInquiryRecord>("inquiries", count);
+        dataStore.clear();
+        dataStore.reserve(count);
+        for (uint64_t i = 0; i < count; ++i) {
+            const SnapshotInquiryRecord& record = records[i];
+            string inquiryId = snapshot.GetString(record.inquiry);
+            const Bond& bond = BondProductService::GetInstance()->GetData(snapshot.GetString(record.product));
+            dataStore.insert(make_pair(inquiryId, Inquiry<Bond>(inquiryId, bond, static_cast<Side>(record.side), record.quantity,
+                record.price, static_cast<InquiryState>(record.state))));
+        }
+    }
+
 private:
     BondInquiryPublisher* publishConnector;
+    MetricCounter* messages = MetricsRegistry::GetInstance().GetCounter("inquiry.messages");
+    MetricCounter* quotes = MetricsRegistry::GetInstance().GetCounter("inquiry.quotes");
 };
 
 class BondInquiryServiceListener : public ServiceListener<Inquiry<Bond>> {
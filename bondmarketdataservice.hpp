@@ -3,8 +3,9 @@
  * 
  * This file defines the BondMarketDataService and related components for a bond trading system. It includes:
  * - 'BondMarketDataConnector': An InputFileConnector responsible for parsing bond market data from a file and updating the service.
+ * - 'BondMarketDataBinaryConnector': A BinaryInputConnector that reads the same order books from 'marketdata.bin' without any parsing.
  * - 'BondMarketDataService': A service that provides market data specifically for bonds. It includes methods to get the best bid/offer
- *   and aggregate depth of the order book.
+ *   and aggregate depth of the order book. Its store of latest order books can be checkpointed and restored.
  * - Functionality: The connector parses bond data from a CSV file, creating OrderBook objects. The service manages this data,
  *   offering access to the best bid/offer and aggregated depth information. It integrates with the overall bond trading system,
  *   providing crucial market data for trading decisions.
@@ -17,28 +18,47 @@
 #include "products.hpp"
 #include "marketdataservice.hpp"
 #include "InputFileConnector.hpp"
+#include "binaryinput.hpp"
 #include "formatting.hpp"
 
 class BondMarketDataConnector : public InputFileConnector<string, OrderBook<Bond>> {
 public:
     BondMarketDataConnector(const string& filePath, Service<string, OrderBook<Bond>>* connectedService);
 private:
-    void parse(string line) override;
+    OrderBook<Bond> decode(const string& line) const override;
 };
 
-class BondMarketDataService : public MarketDataService<Bond> {
+class BondMarketDataBinaryConnector : public BinaryInputConnector<string, OrderBook<Bond>, BinaryMarketDataRecord> {
+public:
+    BondMarketDataBinaryConnector(const string& filePath, Service<string, OrderBook<Bond>>* connectedService);
+private:
+    vector<const Bond*> bonds;
+    vector<Order> bidStack;
+    vector<Order> offerStack;
+    void resolve(const BinaryInputFile& file) override;
+    OrderBook<Bond> decode(const BinaryMarketDataRecord& record) override;
+};
+
+class BondMarketDataService : public MarketDataService<Bond>, public Checkpointable {
 public:
     BondMarketDataService() {}
     const BidOffer& GetBestBidOffer(const string& productId) override;
     const OrderBook<Bond>& AggregateDepth(const string& productId) override;
     void Subscribe(BondMarketDataConnector* connector);
+    void Subscribe(BondMarketDataBinaryConnector* connector);
     void OnMessage(OrderBook<Bond>& data) override;
+    void SaveSnapshot(SnapshotWriter& writer) override;
+    void RestoreSnapshot(const SnapshotFile& snapshot) override;
+
+private:
+    MetricCounter* adds = MetricsRegistry::GetInstance().GetCounter("marketdata.adds");
+    MetricCounter* updates = MetricsRegistry::GetInstance().GetCounter("marketdata.updates");
 };
 
-void BondMarketDataConnector::parse(string line) {
+OrderBook<Bond> BondMarketDataConnector::decode(const string& line) const {
     auto split = splitString(line, ',');
     string id = split[0];
-    auto bond = BondProductService::GetInstance()->GetData(id);
+    auto& bond = BondProductService::GetInstance()->GetInputProduct(id);
     vector<Order> bidStack;
     vector<Order> offerStack;
     for (int i = 1; i <= 5; ++i) {
@@ -47,37 +67,59 @@ void BondMarketDataConnector::parse(string line) {
         bidStack.push_back(bid);
         offerStack.push_back(offer);
     }
-    auto book = OrderBook<Bond>(bond, bidStack, offerStack);
-    connectedService->OnMessage(book);
+    return OrderBook<Bond>(bond, bidStack, offerStack);
 }
 
 BondMarketDataConnector::BondMarketDataConnector(const string& filePath,
     Service<string, OrderBook<Bond>>* connectedService)
     : InputFileConnector(filePath, connectedService) {}
 
+BondMarketDataBinaryConnector::BondMarketDataBinaryConnector(const string& filePath,
+    Service<string, OrderBook<Bond>>* connectedService)
+    : BinaryInputConnector(filePath, connectedService) {}
+
+void BondMarketDataBinaryConnector::resolve(const BinaryInputFile& file) {
+    bonds.clear();
+    for (uint32_t handle = 0; handle < file.GetProductCount(); ++handle) {
+        // Records of an unknown product are skipped
+        bonds.push_back(BondProductService::GetInstance()->Find(file.GetProductId(handle)));
+    }
+}
+
+/**
+ * The stacks are reused from record to record, so the only allocations are the copies the OrderBook takes.
+ */
+OrderBook<Bond> BondMarketDataBinaryConnector::decode(const BinaryMarketDataRecord& record) {
+    if (!bonds[record.product]) {
+        throw SkippedInput("Unknown product");
+    }
+    bidStack.clear();
+    offerStack.clear();
+    for (uint32_t i = 0; i < record.depth && i < uint32_t(BINARY_BOOK_DEPTH); ++i) {
+        bidStack.push_back(Order(TicksToPrice(record.bidTicks[i]), record.bidQuantities[i], PricingSide::BID));
+        offerStack.push_back(Order(TicksToPrice(record.offerTicks[i]), record.offerQuantities[i], PricingSide::OFFER));
+    }
+    return OrderBook<Bond>(*bonds[record.product], bidStack, offerStack);
+}
+
 /**
  * Store the OrderBook and notify listeners to process the new state of the OrderBook.
  * @param data
  */
 void BondMarketDataService::OnMessage(OrderBook<Bond>& data) {
-    if (dataStore.find(data.GetProduct().GetProductId()) == dataStore.end()) {
-        dataStore.insert(make_pair(data.GetProduct().GetProductId(), data));
-        for (auto listener : this->GetListeners()) {
-            listener->ProcessAdd(data);
-        }
-    }
-    else {
-        dataStore.insert(make_pair(data.GetProduct().GetProductId(), data));
-        for (auto listener : this->GetListeners()) {
-            listener->ProcessUpdate(data);
-        }
-    }
+    auto result = Upsert(data.GetProduct().GetProductId(), data);
+    (result.added ? adds : updates)->Increment();
+    Notify(result.stored, result.added);
 }
 
 void BondMarketDataService::Subscribe(BondMarketDataConnector* connector) {
     connector->read();
 }
 
+void BondMarketDataService::Subscribe(BondMarketDataBinaryConnector* connector) {
+    connector->read();
+}
+
 /**
  * Get the best bid and offer(with their price and quantity) in the current OrderBook.
  * @param productId
@@ -126,4 +168,51 @@ const OrderBook<Bond>& BondMarketDataService::AggregateDepth(const string& produ
     }
 }
 
+/**
+ * Save the latest order book of each product. Levels beyond SNAPSHOT_BOOK_DEPTH are not kept.
+ * @param writer
+ */
+void BondMarketDataService::SaveSnapshot(SnapshotWriter& writer) {
+    vector<SnapshotOrderBookRecord> records;
+    records.reserve(dataStore.size());
+    for (const auto& entry : dataStore) {
+        const vector<Order>& bids = entry.second.GetBidStack();
+        const vector<Order>& offers = entry.second.GetOfferStack();
+        SnapshotOrderBookRecord record = {};
+        record.product = writer.Intern(entry.first);
+        record.bidDepth = static_cast<uint16_t>(min<size_t>(bids.size(), SNAPSHOT_BOOK_DEPTH));
+        record.offerDepth = static_cast<uint16_t>(min<size_t>(offers.size(), SNAPSHOT_BOOK_DEPTH));
+        for (int i = 0; i < record.bidDepth; ++i) {
+            record.bidPrices[i] = bids[i].GetPrice();
+            record.bidQuantities[i] = bids[i].GetQuantity();
+        }
+        for (int i = 0; i < record.offerDepth; ++i) {
+            record.offerPrices[i] = offers[i].GetPrice();
+            record.offerQuantities[i] = offers[i].GetQuantity();
+        }
+        records.push_back(record);
+    }
+    writer.AddSection("orderbooks", records);
+}
+
+void BondMarketDataService::RestoreSnapshot(const SnapshotFile& snapshot) {
+    uint64_t count;
+    const SnapshotOrderBookRecord* records = snapshot.GetSection<SnapshotOrderBookRecord>("orderbooks", count);
+    dataStore.clear();
+    dataStore.reserve(count);
+    for (uint64_t i = 0; i < count; ++i) {
+        const SnapshotOrderBookRecord& record = records[i];
+        string productId = snapshot.GetString(record.product);
+        vector<Order> bidStack, offerStack;
+        for (int level = 0; level < record.bidDepth; ++level) {
+            bidStack.push_back(Order(record.bidPrices[level], record.bidQuantities[level], PricingSide::BID));
+        }
+        for (int level = 0; level < record.offerDepth; ++level) {
+            offerStack.push_back(Order(record.offerPrices[level], record.offerQuantities[level], PricingSide::OFFER));
+        }
+        const Bond& bond = BondProductService::GetInstance()->GetData(productId);
+        dataStore.insert(make_pair(productId, OrderBook<Bond>(bond, bidStack, offerStack)));
+    }
+}
+
 #endif //BOND_MARKET_DATA_SERVICE_HPP
\ No newline at end of file
@@ -5,6 +5,7 @@
  * - 'BondPositionServiceListener': A listener that processes updates from the BondPositionService, forwarding them to the historical data service.
  * - 'BondPositionConnector': An OutputFileConnector for formatting Position<Bond> data into CSV strings and writing them to 'positions.csv'.
  * - 'BondPositionHistoricalDataService': A service that extends HistoricalDataService for Position<Bond> objects, handling the persistence of bond position data.
+ *   Positions go to 'positions.csv', or to the 'positions' columnar table when COLUMNAR_STORAGE is chosen.
  *
  * The main goal of this service is to maintain a historical record of bond positions, crucial for portfolio tracking, compliance, and analysis within the trading system.
  */
@@ -16,6 +17,7 @@
 #include "products.hpp"
 #include "OutputFileConnector.hpp"
 #include "positionservice.hpp"
+#include "columnarstore.hpp"
 
 /**
  * Listens to updates in positions from BondPositionService.
@@ -43,17 +45,36 @@ private:
 
 class BondPositionHistoricalDataService : public HistoricalDataService<Position<Bond>> {
 public:
-    BondPositionHistoricalDataService();
+    /**
+     * @param storage write positions.csv or the columnar 'positions' table
+     * @param directory the directory holding columnar tables
+     */
+    explicit BondPositionHistoricalDataService(HistoricalStorage storage = CSV_STORAGE, const string& directory = "history");
     void PersistData(string persistKey, const Position<Bond>& data) override;
 private:
     void OnMessage(Position<Bond>& data) override;
     BondPositionConnector* connector;
+    ColumnarWriter* columnar;
 };
 
 void BondPositionHistoricalDataService::PersistData(string persistKey, const Position<Bond>& data) {
+    Cache(persistKey, data);
+    if (columnar) {
+        columnar->Append({ ColumnValue::Integer(ColumnarWriter::Now()),
+            ColumnValue::Integer(columnar->Intern(data.GetProduct().GetProductId())),
+            ColumnValue::Integer(data.GetAggregatePosition()) });
+        return;
+    }
     connector->Publish(const_cast<Position<Bond> &>(data));
 }
-BondPositionHistoricalDataService::BondPositionHistoricalDataService() {
+BondPositionHistoricalDataService::BondPositionHistoricalDataService(HistoricalStorage storage, const string& directory)
+    : connector(nullptr), columnar(nullptr) {
+    SetRollup([](const Position<Bond>& position) { return double(position.GetAggregatePosition()); });
+    if (storage == COLUMNAR_STORAGE) {
+        columnar = new ColumnarWriter(directory, "positions", {
+            { "Timestamp", TIMESTAMP_COLUMN }, { "CUSIP", PRODUCT_COLUMN }, { "Position", INT64_COLUMN } });
+        return;
+    }
     connector = new BondPositionConnector("positions.csv");
     connector->WriteHeader();
 }
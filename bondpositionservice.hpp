@@ -4,7 +4,12 @@
  * This file defines the BondPositionService and related listener for the bond trading system. Key functionalities include:
  * - 'BondPositionService': A service that extends PositionService for bonds. It manages positions in bonds by adding
  *   or updating them based on newly executed trades.
- * - 'AddTrade': Adds a new bond position or updates an existing one, triggered by a new trade execution.
+ * - 'AddTrade': Adds a new bond position or updates an existing one in place, triggered by a new trade execution. Listeners
+ *   receive the stored position, and delta listeners receive the change the trade made to it.
+ * - 'SetPosition': Sets the quantity held in one book, e.g. when recovering from the journal. Listeners are notified of the change
+ *   as if it had been made by a trade.
+ * - 'SaveSnapshot' and 'RestoreSnapshot': Checkpoint the nonzero positions of every product; a book missing from a snapshot holds
+ *   nothing.
  * - 'BondTradesServiceListener': Listens to the Trade<Bond> service and processes new trades by updating the bond positions
  *   through the BondPositionService.
  *
@@ -18,8 +23,11 @@
 #include "positionservice.hpp"
 #include "products.hpp"
 #include "soa.hpp"
+#include "snapshot.hpp"
+#include "bookregistry.hpp"
+#include "bondproductservice.hpp"
 
-class BondPositionService : public PositionService<Bond> {
+class BondPositionService : public PositionService<Bond>, public Checkpointable {
 public:
     BondPositionService() {}
 
@@ -28,26 +36,84 @@ public:
      * @param trade a new trade that has been recently executed
      */
     void AddTrade(const Trade<Bond>& trade) override {
-        if (dataStore.find(trade.GetProduct().GetProductId()) == dataStore.end()) {
-            Position<Bond> newPosition = Position<Bond>(trade.GetProduct());
-            newPosition.UpdatePosition(trade); // TODO: Move this to ctor?
-            dataStore.insert(make_pair(trade.GetProduct().GetProductId(), newPosition));
-            for (auto listener : this->GetListeners()) {
-                listener->ProcessAdd(newPosition);
-            }
+        auto result = FindOrInsert(trade.GetProduct().GetProductId(), Position<Bond>(trade.GetProduct()));
+        bool added = result.added;
+        Position<Bond>& position = result.stored;
+        position.UpdatePosition(trade);
+        trades->Increment();
+        Notify(position, added);
+        NotifyDelta(position, trade.GetBookId(), (trade.GetSide() == BUY ? 1 : -1) * trade.GetQuantity(), added);
+    }
+
+    /**
+     * Set the quantity held in one book of a position, adding the position if it does not exist.
+     * @param product
+     * @param book
+     * @param quantity
+     */
+    void SetPosition(const Bond& product, BookId book, long quantity) {
+        auto result = FindOrInsert(product.GetProductId(), Position<Bond>(product));
+        Position<Bond>& position = result.stored;
+        long change = quantity - position.GetPosition(book);
+        if (change == 0 && !result.added) {
+            return;
         }
-        else {
-            auto position = dataStore.at(trade.GetProduct().GetProductId());
-            position.UpdatePosition(trade);
-            for (auto listener : this->GetListeners()) {
-                listener->ProcessUpdate(position);
+        position.SetPosition(book, quantity);
+        Notify(position, result.added);
+        NotifyDelta(position, book, change, result.added);
+    }
+
+    void OnMessage(Position<Bond>& data) override {
+
+    }
+
+    void SaveSnapshot(SnapshotWriter& writer) override {
+        BookRegistry& books = BookRegistry::GetInstance();
+        vector<SnapshotPositionRecord> records;
+        for (const auto& entry : dataStore) {
+            const Position<Bond>& position = entry.second;
+            for (BookId book = 0; book < position.GetBookLimit(); ++book) {
+                if (position.GetPosition(book) != 0) {
+                    records.push_back(SnapshotPositionRecord{ writer.Intern(entry.first), writer.Intern(books.GetName(book)),
+                        position.GetPosition(book) });
+                }
             }
         }
+        writer.AddSection("positions", records);
     }
 
-    void OnMessage(Position<Bond>& data) override {
+    void RestoreSnapshot(const SnapshotFile& snapshot) override {
+        uint64_t count;
+        const SnapshotPositionRecord* records = snapshot.GetSection<SnapshotPositionRecord>("positions", count);
+        dataStore.clear();
+        for (uint64_t i = 0; i < count; ++i) {
+            string productId = snapshot.GetString(records[i].product);
+            const Bond& bond = BondProductService::GetInstance()->GetData(productId);
+            Position<Bond>& position = FindOrInsert(productId, Position<Bond>(bond)).stored;
+            position.SetPosition(BookRegistry::GetInstance().Intern(snapshot.GetString(records[i].book)), records[i].quantity);
+        }
+    }
 
+private:
+    // Notify the delta listeners of a change to one book of a position
+    void NotifyDelta(Position<Bond>& position, BookId book, long quantity, bool added) {
+        if (this->GetDeltaListeners().empty()) {
+            return;
+        }
+        PositionDelta<Bond> delta(position.GetProduct(), book, quantity, position.GetAggregatePosition());
+        for (auto listener : this->GetDeltaListeners()) {
+            LATENCY_SCOPE(LISTENER_STAGE);
+            TRACE_SPAN(added ? "ProcessAdd" : "ProcessUpdate", *listener);
+            if (added) {
+                listener->ProcessAdd(delta);
+            }
+            else {
+                listener->ProcessUpdate(delta);
+            }
+        }
     }
+
+    MetricCounter* trades = MetricsRegistry::GetInstance().GetCounter("position.trades");
 };
 
 class BondTradesServiceListener : public ServiceListener<Trade<Bond>> {
@@ -5,6 +5,7 @@
  * - 'BondPriceStreamsServiceListener': A listener that processes additions, updates, and removals of PriceStream objects and forwards them to the historical data service.
  * - 'BondPriceStreamsConnector': An OutputFileConnector responsible for formatting PriceStream data into CSV strings and writing them to a file.
  * - 'BondPriceStreamsHistoricalDataService': A service that extends HistoricalDataService for PriceStream objects, managing the persistence of bond price stream data.
+ *   Streams go to 'streaming.csv', or to the 'streaming' columnar table when COLUMNAR_STORAGE is chosen.
  *
  * The service's primary function is to capture and record the historical data of bond price streams, facilitating analysis and record-keeping in the bond trading system.
  */
@@ -16,6 +17,7 @@
 #include "products.hpp"
 #include "OutputFileConnector.hpp"
 #include "streamingservice.hpp"
+#include "columnarstore.hpp"
 
 /**
  * Listens to price stream updats from StreamingService
@@ -41,17 +43,47 @@ private:
 
 class BondPriceStreamsHistoricalDataService : public HistoricalDataService<PriceStream<Bond>> {
 public:
-    BondPriceStreamsHistoricalDataService();
+    /**
+     * @param storage write streaming.csv or the columnar 'streaming' table
+     * @param directory the directory holding columnar tables
+     */
+    explicit BondPriceStreamsHistoricalDataService(HistoricalStorage storage = CSV_STORAGE, const string& directory = "history");
     void PersistData(string persistKey, const PriceStream<Bond>& data) override;
 private:
     void OnMessage(PriceStream<Bond>& data) override;
     BondPriceStreamsConnector* connector;
+    ColumnarWriter* columnar;
 };
 
 void BondPriceStreamsHistoricalDataService::PersistData(string persistKey, const PriceStream<Bond>& data) {
+    Cache(persistKey, data);
+    if (columnar) {
+        columnar->Append({ ColumnValue::Integer(ColumnarWriter::Now()),
+            ColumnValue::Integer(columnar->Intern(data.GetProduct().GetProductId())),
+            ColumnValue::Real(data.GetBidOrder().GetPrice()),
+            ColumnValue::Integer(data.GetBidOrder().GetVisibleQuantity()),
+            ColumnValue::Integer(data.GetBidOrder().GetHiddenQuantity()),
+            ColumnValue::Real(data.GetOfferOrder().GetPrice()),
+            ColumnValue::Integer(data.GetOfferOrder().GetVisibleQuantity()),
+            ColumnValue::Integer(data.GetOfferOrder().GetHiddenQuantity()) });
+        return;
+    }
     connector->Publish(const_cast<PriceStream<Bond> &>(data));
 }
-BondPriceStreamsHistoricalDataService::BondPriceStreamsHistoricalDataService() {
+BondPriceStreamsHistoricalDataService::BondPriceStreamsHistoricalDataService(HistoricalStorage storage, const string& directory)
+    : connector(nullptr), columnar(nullptr) {
+    // Bars track the mid, weighted by the visible size shown on both sides.
+    SetRollup([](const PriceStream<Bond>& stream) { return (stream.GetBidOrder().GetPrice() + stream.GetOfferOrder().GetPrice()) / 2.0; },
+        [](const PriceStream<Bond>& stream) {
+            return double(stream.GetBidOrder().GetVisibleQuantity() + stream.GetOfferOrder().GetVisibleQuantity());
+        });
+    if (storage == COLUMNAR_STORAGE) {
+        columnar = new ColumnarWriter(directory, "streaming", {
+            { "Timestamp", TIMESTAMP_COLUMN }, { "CUSIP", PRODUCT_COLUMN },
+            { "BidPrice", DOUBLE_COLUMN }, { "BidVisibleQuantity", INT64_COLUMN }, { "BidHiddenQuantity", INT64_COLUMN },
+            { "OfferPrice", DOUBLE_COLUMN }, { "OfferVisibleQuantity", INT64_COLUMN }, { "OfferHiddenQuantity", INT64_COLUMN } });
+        return;
+    }
     connector = new BondPriceStreamsConnector("streaming.csv");
     connector->WriteHeader();
 }
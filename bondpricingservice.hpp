@@ -3,7 +3,9 @@
  * 
  * This file defines the BondPricingService for a bond trading system, which is responsible for processing and updating bond prices. Key components include:
  * - 'BondPricesConnector': An InputFileConnector that reads and parses bond price data from 'prices.csv', and updates the pricing service with new data.
+ * - 'BondPricesBinaryConnector': A BinaryInputConnector that reads the same prices from 'prices.bin' without any parsing.
  * - 'BondPricingService': A service that extends PricingService for bonds, managing the processing and storage of bond price data.
+ *   Its store of latest prices can be checkpointed and restored.
  *
  * The service aims to maintain an up-to-date record of bond prices, essential for accurate and effective trading and valuation within the bond trading system.
  */
@@ -15,6 +17,7 @@
 #include "products.hpp"
 #include "pricingservice.hpp"
 #include "InputFileConnector.hpp"
+#include "binaryinput.hpp"
 #include "formatting.hpp"
 #include "bondproductservice.hpp"
 
@@ -25,53 +28,106 @@ class BondPricesConnector : public InputFileConnector<string, Price<Bond>> {
 public:
     BondPricesConnector(const string& filePath, Service<string, Price<Bond>>* connectedService);
 private:
-    void parse(string line) override;
+    Price<Bond> decode(const string& line) const override;
+};
+
+/**
+ * Reads data from prices.bin, written from prices.csv by csv_to_binary
+ */
+class BondPricesBinaryConnector : public BinaryInputConnector<string, Price<Bond>, BinaryPriceRecord> {
+public:
+    BondPricesBinaryConnector(const string& filePath, Service<string, Price<Bond>>* connectedService);
+private:
+    vector<const Bond*> bonds;
+    void resolve(const BinaryInputFile& file) override;
+    Price<Bond> decode(const BinaryPriceRecord& record) override;
 };
 
 /**
  * Processes prices.csv
  */
-class BondPricingService : public PricingService<Bond> {
+class BondPricingService : public PricingService<Bond>, public Checkpointable {
 public:
     BondPricingService() {}
     void Subscribe(BondPricesConnector* connector);
+    void Subscribe(BondPricesBinaryConnector* connector);
     void OnMessage(Price<Bond>& data) override;
+    void SaveSnapshot(SnapshotWriter& writer) override;
+    void RestoreSnapshot(const SnapshotFile& snapshot) override;
+
+private:
+    MetricCounter* adds = MetricsRegistry::GetInstance().GetCounter("pricing.adds");
+    MetricCounter* updates = MetricsRegistry::GetInstance().GetCounter("pricing.updates");
 };
 
-void BondPricesConnector::parse(string line) {
+Price<Bond> BondPricesConnector::decode(const string& line) const {
     auto split = splitString(line, ',');
     string id = split[0];
     double mid = convertFractionalPriceToDouble(split[1]), bidOfferSpread = convertFractionalPriceToDouble(split[2]);
 
-    auto bond = BondProductService::GetInstance()->GetData(id);
-    auto price = Price<Bond>(bond, mid, bidOfferSpread);
-    connectedService->OnMessage(price);
+    auto& bond = BondProductService::GetInstance()->GetInputProduct(id);
+    return Price<Bond>(bond, mid, bidOfferSpread);
 }
 
 BondPricesConnector::BondPricesConnector(const string& filePath, Service<string, Price<Bond>>* connectedService)
     : InputFileConnector(filePath, connectedService) {}
 
+BondPricesBinaryConnector::BondPricesBinaryConnector(const string& filePath, Service<string, Price<Bond>>* connectedService)
+    : BinaryInputConnector(filePath, connectedService) {}
+
+void BondPricesBinaryConnector::resolve(const BinaryInputFile& file) {
+    bonds.clear();
+    for (uint32_t handle = 0; handle < file.GetProductCount(); ++handle) {
+        // Records of an unknown product are skipped
+        bonds.push_back(BondProductService::GetInstance()->Find(file.GetProductId(handle)));
+    }
+}
+
+Price<Bond> BondPricesBinaryConnector::decode(const BinaryPriceRecord& record) {
+    if (!bonds[record.product]) {
+        throw SkippedInput("Unknown product");
+    }
+    return Price<Bond>(*bonds[record.product], TicksToPrice(record.midTicks), TicksToPrice(record.spreadTicks));
+}
+
 /**
  * Store the new price and update all listeners.
  *
  * @param data
  */
 void BondPricingService::OnMessage(Price<Bond>& data) {
-    if (dataStore.find(data.GetProduct().GetProductId()) == dataStore.end()) {
-        dataStore.insert(make_pair(data.GetProduct().GetProductId(), data));
-        for (auto listener : this->GetListeners()) {
-            listener->ProcessAdd(data);
-        }
-    }
-    else {
-        dataStore.insert(make_pair(data.GetProduct().GetProductId(), data));
-        for (auto listener : this->GetListeners()) {
-            listener->ProcessUpdate(data);
-        }
-    }
+    auto result = Upsert(data.GetProduct().GetProductId(), data);
+    (result.added ? adds : updates)->Increment();
+    Notify(result.stored, result.added);
 }
 
 void BondPricingService::Subscribe(BondPricesConnector* connector) {
     connector->read();
 }
+
+void BondPricingService::Subscribe(BondPricesBinaryConnector* connector) {
+    connector->read();
+}
+
+void BondPricingService::SaveSnapshot(SnapshotWriter& writer) {
+    vector<SnapshotPriceRecord> records;
+    records.reserve(dataStore.size());
+    for (const auto& entry : dataStore) {
+        records.push_back(SnapshotPriceRecord{ writer.Intern(entry.first), 0, entry.second.GetMid(), entry.second.GetBidOfferSpread() });
+    }
+    writer.AddSection("prices", records);
+}
+
+void BondPricingService::RestoreSnapshot(const SnapshotFile& snapshot) {
+    uint64_t count;
+    const SnapshotPriceRecord* records = snapshot.GetSection<SnapshotPriceRecord>("prices", count);
+    dataStore.clear();
+    dataStore.reserve(count);
+    for (uint64_t i = 0; i < count; ++i) {
+        string productId = snapshot.GetString(records[i].product);
+        const Bond& bond = BondProductService::GetInstance()->GetData(productId);
+        dataStore.insert(make_pair(productId, Price<Bond>(bond, records[i].mid, records[i].bidOfferSpread)));
+    }
+}
+
 #endif //BOND_PRICING_SERVICE_HPP
\ No newline at end of file
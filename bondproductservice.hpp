@@ -2,27 +2,56 @@
  * bondproductservice.hpp
  * 
  * This file defines the BondProductService, a singleton service responsible for managing bond product data within the bond trading system. Key features include:
- * - 'BondProductService': A service that extends the base Service class for bond products. It maintains a reference data set of bond securities, with functionality to retrieve and add bond data.
- * - 'GetData': Retrieves bond data for a given product identifier (productId).
- * - 'Add': Adds a new bond to the service's internal data set.
- * - 'GetBonds': Returns all bonds matching a specified ticker.
+ * - 'BondUniverse': One immutable version of the reference data: the bonds by product id and the secondary indexes by ticker,
+ *   issuer and maturity.
+ * - 'BondProductService': A service that extends the base Service class for bond products. It publishes the current
+ *   BondUniverse through an atomic pointer, so any number of threads can read it without locks while new issues are added.
+ * - 'GetData', 'Find' and 'GetInputProduct': Retrieve bond data for a given product identifier (productId). A miss is reported
+ *   (GetData throws out_of_range, as the base Service does; Find returns nullptr; GetInputProduct throws SkippedInput, so input
+ *   connectors skip the record), never inserted.
+ * - 'Add' and 'AddAll': Add new bonds copy-on-write: the current version is copied, extended and published as the next version.
+ *   Adding a batch at once costs one copy.
+ * - 'LoadSecurities': Bulk-loads a securities file (ProductId,Ticker,Issuer,Coupon,Maturity, as written by generate_data) as a
+ *   single new version, in storage sized for the whole file up front.
+ * - 'GetBonds', 'GetBondsByIssuer' and 'GetBondsMaturingBetween': Look bonds up by ticker, issuer or maturity range. Each is served
+ *   from a secondary index, so queries cost the size of the answer, not of the universe.
  * - Singleton Pattern: Ensures a single instance of the BondProductService is created, accessible via 'GetInstance' method.
  *
+ * Bonds are never moved or freed once added, and neither are old versions, so a reference or a version a reader holds stays valid
+ * for the life of the process. Writers are serialized by a mutex; readers never wait for them.
+ *
  * This service acts as the central repository for bond product information, crucial for various trading and risk management operations within the system.
  */
 
 #ifndef BOND_PRODUCT_SERVICE_HPP
 #define BOND_PRODUCT_SERVICE_HPP
 
-/**
- * Defines Bond and IRSwap ProductServices
- */
-
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <fstream>
+#include <functional>
 #include <iostream>
-#include <map>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
 #include "products.hpp"
 #include "soa.hpp"
 
+/**
+ * One published version of the bond reference data. Never modified once published.
+ */
+struct BondUniverse {
+    uint64_t version;
+    unordered_map<string, Bond*> bonds;
+    unordered_map<string, vector<const Bond*>> tickerIndex;
+    unordered_map<string, vector<const Bond*>> issuerIndex;
+    // Sorted by maturity
+    vector<const Bond*> maturityIndex;
+};
+
  /**
   * Bond Product Service to own reference data over a set of bond securities.
   * Key is the productId string, value is a Bond.
@@ -32,26 +61,66 @@ class BondProductService : public Service<string, Bond> {
 public:
     static BondProductService* GetInstance();
 
-    // Return the bond data for a particular bond product identifier
+    // Return the bond data for a particular bond product identifier. Throws out_of_range if there is no such bond.
     Bond& GetData(string productId) override;
 
+    // Return the bond data for a particular bond product identifier, or nullptr if there is no such bond
+    const Bond* Find(const string& productId) const;
+
+    // Return the bond an input record names. Throws SkippedInput if there is no such bond, so the record is skipped.
+    const Bond& GetInputProduct(const string& productId) const;
+
     // Add a bond to the service (convenience method)
     void Add(Bond& bond);
 
+    // Add several bonds as one new version. Bonds already in the service are kept as they are.
+    void AddAll(const vector<Bond>& newBonds);
+
+    /**
+     * Add every security in a CSV file with a ProductId,Ticker,Issuer,Coupon,Maturity header (maturities as YYYY-MM-DD).
+     * Bonds already in the service are kept as they are.
+     * @return the number of securities in the file
+     */
+    size_t LoadSecurities(const string& path);
+
     // Get all Bonds with the specified ticker.
     vector<Bond> GetBonds(string& _ticker);
+
+    // Get all Bonds from the specified issuer.
+    vector<Bond> GetBondsByIssuer(const string& issuer);
+
+    // Get all Bonds maturing on or after from and before to, in order of maturity.
+    vector<Bond> GetBondsMaturingBetween(const date& from, const date& to);
+
+    // Get the number of bonds in the service
+    size_t GetBondCount() const;
+
+    // Get the current version of the reference data. It stays valid, and unchanged, however many versions follow it.
+    const BondUniverse& GetUniverse() const;
+
     void OnMessage(Bond& data) override;
 
 private:
-    unordered_map<string, Bond> bondMap; // cache of bond products
-    static BondProductService* instance; // reference to singleton instance
+    atomic<const BondUniverse*> current;
+    // Every version ever published, and the bonds they point to
+    vector<unique_ptr<BondUniverse>> versions;
+    deque<Bond> storage;
+    mutex writeLock;
+
+    // Publish a copy of the current version extended with the given bonds. Called with writeLock held.
+    template<typename Producer>
+    size_t Publish(size_t expected, Producer produce);
+
+    static vector<Bond> Copy(const vector<const Bond*>* bonds);
 
     // Private ctor to disallow direct initialization.
     BondProductService();
 };
 
 BondProductService::BondProductService() {
-    bondMap = unordered_map<string, Bond>();
+    versions.emplace_back(new BondUniverse());
+    versions.back()->version = 0;
+    current.store(versions.back().get(), memory_order_release);
 }
 
 void BondProductService::OnMessage(Bond& data) {
@@ -59,11 +128,93 @@ void BondProductService::OnMessage(Bond& data) {
 }
 
 Bond& BondProductService::GetData(string productId) {
-    return bondMap[productId];
+    const BondUniverse* universe = current.load(memory_order_acquire);
+    auto found = universe->bonds.find(productId);
+    if (found == universe->bonds.end()) {
+        throw out_of_range("Unknown product " + productId);
+    }
+    return *found->second;
+}
+
+const Bond* BondProductService::Find(const string& productId) const {
+    const BondUniverse* universe = current.load(memory_order_acquire);
+    auto found = universe->bonds.find(productId);
+    return found == universe->bonds.end() ? nullptr : found->second;
+}
+
+const Bond& BondProductService::GetInputProduct(const string& productId) const {
+    const Bond* bond = Find(productId);
+    if (!bond) {
+        throw SkippedInput("Unknown product " + productId);
+    }
+    return *bond;
 }
 
 void BondProductService::Add(Bond& bond) {
-    bondMap.insert(make_pair(bond.GetProductId(), bond));
+    lock_guard<mutex> guard(writeLock);
+    Publish(1, [&bond](const function<void(Bond&&)>& add) {
+        add(Bond(bond));
+    });
+}
+
+void BondProductService::AddAll(const vector<Bond>& newBonds) {
+    lock_guard<mutex> guard(writeLock);
+    Publish(newBonds.size(), [&newBonds](const function<void(Bond&&)>& add) {
+        for (const auto& bond : newBonds) {
+            add(Bond(bond));
+        }
+    });
+}
+
+size_t BondProductService::LoadSecurities(const string& path) {
+    ifstream inFile(path, ios_base::binary);
+    if (!inFile) {
+        std::cerr << "Unable to open file " << path;
+        exit(1);
+    }
+    // Read the whole file at once so the new version can be sized from its line count before anything is inserted.
+    string text((istreambuf_iterator<char>(inFile)), istreambuf_iterator<char>());
+    size_t lines = size_t(count(text.begin(), text.end(), '\n'));
+
+    size_t loaded = 0;
+    lock_guard<mutex> guard(writeLock);
+    Publish(lines, [&](const function<void(Bond&&)>& add) {
+        size_t begin = text.find('\n');   // skip headers
+        vector<string> fields(5);
+        while (begin != string::npos && begin + 1 < text.size()) {
+            begin++;
+            size_t end = text.find('\n', begin);
+            size_t lineEnd = end == string::npos ? text.size() : end;
+            if (lineEnd > begin && text[lineEnd - 1] == '\r') {
+                lineEnd--;
+            }
+            size_t field = 0;
+            size_t fieldBegin = begin;
+            while (field < fields.size()) {
+                size_t comma = text.find(',', fieldBegin);
+                size_t fieldEnd = comma == string::npos || comma > lineEnd ? lineEnd : comma;
+                fields[field++].assign(text, fieldBegin, fieldEnd - fieldBegin);
+                if (fieldEnd == lineEnd) {
+                    break;
+                }
+                fieldBegin = fieldEnd + 1;
+            }
+            begin = end;
+            if (field < fields.size()) {
+                continue;
+            }
+            const string& maturity = fields[4];
+            if (maturity.size() != 10) {
+                std::cerr << "Bad maturity " << maturity << " in " << path;
+                exit(1);
+            }
+            // Parsed by hand: boost's date parser dominates the load time of a large universe.
+            date maturityDate(greg_year(atoi(maturity.c_str())), greg_month(atoi(maturity.c_str() + 5)), greg_day(atoi(maturity.c_str() + 8)));
+            add(Bond(fields[0], fields[0].size() == 12 ? ISIN : CUSIP, fields[1], stof(fields[3]), maturityDate, fields[2]));
+            loaded++;
+        }
+    });
+    return loaded;
 }
 
 /**
@@ -73,22 +224,94 @@ void BondProductService::Add(Bond& bond) {
  * @return A vector of matching bond objects.
  */
 vector<Bond> BondProductService::GetBonds(string& _ticker) {
+    const BondUniverse* universe = current.load(memory_order_acquire);
+    auto found = universe->tickerIndex.find(_ticker);
+    return Copy(found == universe->tickerIndex.end() ? nullptr : &found->second);
+}
+
+vector<Bond> BondProductService::GetBondsByIssuer(const string& issuer) {
+    const BondUniverse* universe = current.load(memory_order_acquire);
+    auto found = universe->issuerIndex.find(issuer);
+    return Copy(found == universe->issuerIndex.end() ? nullptr : &found->second);
+}
+
+vector<Bond> BondProductService::GetBondsMaturingBetween(const date& from, const date& to) {
+    const BondUniverse* universe = current.load(memory_order_acquire);
+    auto first = lower_bound(universe->maturityIndex.begin(), universe->maturityIndex.end(), from,
+        [](const Bond* bond, const date& maturity) { return bond->GetMaturityDate() < maturity; });
     auto bonds = vector<Bond>();
-    for (const auto& entry : bondMap) {
-        if (entry.second.GetTicker() == _ticker) {
-            bonds.push_back(entry.second);
-        }
+    for (auto it = first; it != universe->maturityIndex.end() && (*it)->GetMaturityDate() < to; ++it) {
+        bonds.push_back(**it);
     }
     return bonds;
 }
 
-BondProductService* BondProductService::GetInstance() {
-    if (!instance) {
-        instance = new BondProductService;
+size_t BondProductService::GetBondCount() const {
+    return current.load(memory_order_acquire)->bonds.size();
+}
+
+const BondUniverse& BondProductService::GetUniverse() const {
+    return *current.load(memory_order_acquire);
+}
+
+/**
+ * Copy the current version, let produce add bonds to the copy, then publish it. expected sizes the copy.
+ * @return the number of bonds added
+ */
+template<typename Producer>
+size_t BondProductService::Publish(size_t expected, Producer produce) {
+    const BondUniverse* previous = current.load(memory_order_relaxed);
+    unique_ptr<BondUniverse> next(new BondUniverse(*previous));
+    next->version = previous->version + 1;
+    next->bonds.reserve(previous->bonds.size() + expected);
+    size_t sorted = next->maturityIndex.size();
+    next->maturityIndex.reserve(sorted + expected);
+
+    size_t added = 0;
+    BondUniverse* universe = next.get();
+    produce([this, universe, &added](Bond&& bond) {
+        if (universe->bonds.find(bond.GetProductId()) != universe->bonds.end()) {
+            return;
+        }
+        storage.push_back(move(bond));
+        Bond* stored = &storage.back();
+        universe->bonds.emplace(stored->GetProductId(), stored);
+        universe->tickerIndex[stored->GetTicker()].push_back(stored);
+        if (!stored->GetIssuer().empty()) {
+            universe->issuerIndex[stored->GetIssuer()].push_back(stored);
+        }
+        universe->maturityIndex.push_back(stored);
+        added++;
+    });
+    if (added == 0) {
+        return 0;
     }
-    return instance;
+
+    // Only the new bonds need sorting; they are then merged into the already sorted ones.
+    auto byMaturity = [](const Bond* left, const Bond* right) { return left->GetMaturityDate() < right->GetMaturityDate(); };
+    auto middle = universe->maturityIndex.begin() + sorted;
+    stable_sort(middle, universe->maturityIndex.end(), byMaturity);
+    inplace_merge(universe->maturityIndex.begin(), middle, universe->maturityIndex.end(), byMaturity);
+
+    versions.push_back(move(next));
+    current.store(universe, memory_order_release);
+    return added;
 }
 
-BondProductService* BondProductService::instance = 0;
+vector<Bond> BondProductService::Copy(const vector<const Bond*>* bonds) {
+    auto copies = vector<Bond>();
+    if (bonds) {
+        copies.reserve(bonds->size());
+        for (const Bond* bond : *bonds) {
+            copies.push_back(*bond);
+        }
+    }
+    return copies;
+}
+
+BondProductService* BondProductService::GetInstance() {
+    static BondProductService* instance = new BondProductService();
+    return instance;
+}
 
 #endif //BOND_PRODUCT_SERVICE_HPP
\ No newline at end of file
@@ -5,6 +5,8 @@
  * - 'BondRiskServiceListener': A listener that processes updates from the BondRiskService, forwarding PV01 data (Price Value of a Basis Point) to the historical data service.
  * - 'BondRiskConnector': An OutputFileConnector for formatting PV01<Bond> data into CSV strings and writing them to 'risk.csv'.
  * - 'BondRiskHistoricalDataService': A service that extends HistoricalDataService for PV01<Bond> objects, focusing on the storage and historical tracking of bond risk data.
+ *   Risk goes to 'risk.csv', or to the 'risk' columnar table when COLUMNAR_STORAGE is chosen.
+ * - 'BondBucketedRiskServiceListener' and 'BondBucketedRiskConnector': Forward sector risk updates from the BondRiskService and write them to 'bucketedrisk.csv'.
  *
  * The primary aim of this service is to maintain a record of bond risk metrics, essential for risk management and analysis within the trading system.
  */
@@ -16,6 +18,7 @@
 #include "products.hpp"
 #include "OutputFileConnector.hpp"
 #include "riskservice.hpp"
+#include "columnarstore.hpp"
 
 /**
  * Listens to updates from BondRiskService.
@@ -41,21 +44,73 @@ private:
     string getCSVHeader() override;
 };
 
+/**
+ * Writes sector risk to bucketedrisk.csv
+ */
+class BondBucketedRiskConnector : public OutputFileConnector<PV01<BucketedSector<Bond>>> {
+public:
+    explicit BondBucketedRiskConnector(const string& filePath);
+private:
+    string toCSVString(PV01<BucketedSector<Bond>>& data) override;
+    string getCSVHeader() override;
+};
+
 class BondRiskHistoricalDataService : public HistoricalDataService<PV01<Bond>> {
 public:
-    BondRiskHistoricalDataService();
+    /**
+     * @param storage write risk.csv or the columnar 'risk' table. Sector risk always goes to bucketedrisk.csv.
+     * @param directory the directory holding columnar tables
+     */
+    explicit BondRiskHistoricalDataService(HistoricalStorage storage = CSV_STORAGE, const string& directory = "history");
     void PersistData(string persistKey, const PV01<Bond>& data) override;
+    void PersistBucketedData(const PV01<BucketedSector<Bond>>& data);
 private:
     void OnMessage(PV01<Bond>& data) override;
     BondRiskConnector* connector;
+    BondBucketedRiskConnector* bucketedConnector;
+    ColumnarWriter* columnar;
+};
+
+/**
+ * Listens to sector risk updates from BondRiskService.
+ */
+class BondBucketedRiskServiceListener : public ServiceListener<PV01<BucketedSector<Bond>>> {
+public:
+    explicit BondBucketedRiskServiceListener(BondRiskHistoricalDataService* listeningService);
+    void ProcessAdd(PV01<BucketedSector<Bond>>& data) override;
+    void ProcessRemove(PV01<BucketedSector<Bond>>& data) override;
+    void ProcessUpdate(PV01<BucketedSector<Bond>>& data) override;
+private:
+    BondRiskHistoricalDataService* listeningService;
 };
 
 void BondRiskHistoricalDataService::PersistData(string persistKey, const PV01<Bond>& data) {
+    Cache(persistKey, data);
+    if (columnar) {
+        columnar->Append({ ColumnValue::Integer(ColumnarWriter::Now()),
+            ColumnValue::Integer(columnar->Intern(data.GetProduct().GetProductId())),
+            ColumnValue::Integer(data.GetQuantity()),
+            ColumnValue::Real(data.GetPV01()) });
+        return;
+    }
     connector->Publish(const_cast<PV01<Bond> &>(data));
 }
-BondRiskHistoricalDataService::BondRiskHistoricalDataService() {
-    connector = new BondRiskConnector("risk.csv");
-    connector->WriteHeader();
+void BondRiskHistoricalDataService::PersistBucketedData(const PV01<BucketedSector<Bond>>& data) {
+    bucketedConnector->Publish(const_cast<PV01<BucketedSector<Bond>> &>(data));
+}
+BondRiskHistoricalDataService::BondRiskHistoricalDataService(HistoricalStorage storage, const string& directory)
+    : connector(nullptr), columnar(nullptr) {
+    SetRollup([](const PV01<Bond>& risk) { return risk.GetPV01(); });
+    if (storage == COLUMNAR_STORAGE) {
+        columnar = new ColumnarWriter(directory, "risk", {
+            { "Timestamp", TIMESTAMP_COLUMN }, { "CUSIP", PRODUCT_COLUMN }, { "Quantity", INT64_COLUMN }, { "PV01", DOUBLE_COLUMN } });
+    }
+    else {
+        connector = new BondRiskConnector("risk.csv");
+        connector->WriteHeader();
+    }
+    bucketedConnector = new BondBucketedRiskConnector("bucketedrisk.csv");
+    bucketedConnector->WriteHeader();
 }
 
 BondRiskConnector::BondRiskConnector(const string& filePath) : OutputFileConnector(filePath) {
@@ -73,6 +128,35 @@ string BondRiskConnector::getCSVHeader() {
     return "Timestamp,CUSIP,Quantity,PV01";
 }
 
+BondBucketedRiskConnector::BondBucketedRiskConnector(const string& filePath) : OutputFileConnector(filePath) {
+}
+
+string BondBucketedRiskConnector::toCSVString(PV01<BucketedSector<Bond>>& data) {
+    std::ostringstream oss;
+    oss << boost::posix_time::microsec_clock::universal_time() << "," <<
+        data.GetProduct().GetName() << "," <<
+        data.GetQuantity() << "," <<
+        data.GetPV01();
+    return oss.str();
+}
+string BondBucketedRiskConnector::getCSVHeader() {
+    return "Timestamp,Sector,Quantity,PV01";
+}
+
+BondBucketedRiskServiceListener::BondBucketedRiskServiceListener(BondRiskHistoricalDataService* listeningService)
+    : listeningService(listeningService) {}
+
+void BondBucketedRiskServiceListener::ProcessAdd(PV01<BucketedSector<Bond>>& data) {
+    listeningService->PersistBucketedData(data);
+}
+
+void BondBucketedRiskServiceListener::ProcessRemove(PV01<BucketedSector<Bond>>& data) {
+
+}
+void BondBucketedRiskServiceListener::ProcessUpdate(PV01<BucketedSector<Bond>>& data) {
+    listeningService->PersistBucketedData(data);
+}
+
 BondRiskServiceListener::BondRiskServiceListener(HistoricalDataService<PV01<Bond>>* listeningService)
     : listeningService(
         listeningService) {}
@@ -4,8 +4,16 @@
  * This file defines the BondRiskService for a bond trading system. It is focused on assessing and managing the risk associated with bond positions. Key components include:
  * - 'BondRiskService': A service extending RiskService for bonds, responsible for calculating and updating the PV01 risk metric based on bond positions.
  * - 'BondPositionRiskServiceListener': A listener for the BondPositionService, which processes updates to bond positions and recalculates risk metrics accordingly.
+ * - 'BondPositionDeltaRiskServiceListener': A delta listener for the BondPositionService, which applies the change each trade makes to a position.
+ * - 'BondPriceRiskServiceListener': A listener for the BondPricingService, which feeds new mids into the analytics kernel so risk reprices as the market moves.
  *
  * The service calculates PV01 (Price Value of a Basis Point), a common risk metric in fixed income trading, for individual bonds and aggregated sectors, providing essential risk management capabilities within the trading system.
+ * PV01 per 100 face is computed by the BondAnalyticsEngine from each bond's coupon, maturity and latest mid.
+ * Sectors are registered up front; their totals are updated by delta whenever a member's risk changes, so bucketed risk is a single lookup.
+ * In key-rate mode each bond's PV01 is also split across tenor buckets by the timing of its cash flows. Per-bond exposures are cached
+ * and recomputed only when the bond reprices, and bucket totals are published to the sector listeners alongside sector risk.
+ * The latest clean price and risk of each bond can be checkpointed; a restore rebuilds the sector and bucket totals without
+ * notifying anyone.
  */
 
 #ifndef BOND_RISK_SERVICE_HPP
@@ -15,52 +23,328 @@
 #include "products.hpp"
 #include "streamingservice.hpp"
 #include "riskservice.hpp"
+#include "pricingservice.hpp"
+#include "bondanalytics.hpp"
+#include "bondproductservice.hpp"
+#include "snapshot.hpp"
 
-class BondRiskService : public RiskService<Bond> {
+class BondRiskService : public RiskService<Bond>, public Checkpointable {
 public:
-    BondRiskService() {}
+    /**
+     * @param valuationDate the settlement date that cash flows are discounted to
+     */
+    explicit BondRiskService(const date& valuationDate = day_clock::universal_day()) : analytics(valuationDate) {}
     void OnMessage(PV01<Bond>& data) override {
         // Do nothing. Since streaming service does not have a connector.
     }
 
     /**
-     * Update risk based on each products pre-determined pv01 values and their current positions.
+     * Update risk based on each product's PV01, computed from its current price, and its current position.
      * @param position
      */
     void AddPosition(Position<Bond>& position) override {
         auto product = position.GetProduct();
-        // source of PV01 values : https://eiptrading.com/risk-management/
-        PV01<Bond> risk(product, position.GetAggregatePosition() * product.GetPV01(), position.GetAggregatePosition());
-        if (dataStore.find(position.GetProduct().GetProductId()) == dataStore.end()) {
-            dataStore.insert(make_pair(position.GetProduct().GetProductId(), risk));
-            for (auto listener : this->GetListeners()) {
-                listener->ProcessAdd(risk);
+        size_t index = analytics.Register(product);
+        PV01<Bond> risk(product, position.GetAggregatePosition() * analytics.GetPV01(index), position.GetAggregatePosition());
+        StoreRisk(risk);
+    }
+
+    /**
+     * Apply the change a trade made to a position. Risk moves by delta * PV01 on top of what is already held,
+     * so the full position never has to be read.
+     * @param delta
+     */
+    void AddPositionDelta(const PositionDelta<Bond>& delta) {
+        positionDeltas->Increment();
+        const Bond& product = delta.GetProduct();
+        size_t index = analytics.Register(product);
+        auto existing = dataStore.find(product.GetProductId());
+        long quantity = delta.GetQuantity() + (existing == dataStore.end() ? 0 : existing->second.GetQuantity());
+        PV01<Bond> risk(product, quantity * analytics.GetPV01(index), quantity);
+        StoreRisk(risk);
+    }
+
+    /**
+     * Reprice a bond from a new mid and re-risk its position if we hold one.
+     * @param price
+     */
+    void UpdatePrice(const Price<Bond>& price) {
+        prices->Increment();
+        const Bond& product = price.GetProduct();
+        size_t index = analytics.Register(product);
+        analytics.SetCleanPrice(index, price.GetMid());
+        if (index < exposuresStale.size()) {
+            exposuresStale[index] = 1;
+        }
+        auto existing = dataStore.find(product.GetProductId());
+        if (existing != dataStore.end()) {
+            long quantity = existing->second.GetQuantity();
+            PV01<Bond> risk(product, quantity * analytics.GetPV01(index), quantity);
+            StoreRisk(risk);
+        }
+    }
+
+    // Get the analytics kernel that prices the bonds behind this service
+    BondAnalyticsEngine& GetAnalytics() {
+        return analytics;
+    }
+
+    /**
+     * Register a sector up front. Its total is seeded from the risk already held
+     * and from then on maintained by delta as product risk changes.
+     * @param sector
+     */
+    void RegisterSector(const BucketedSector<Bond>& sector) {
+        if (sectorIndices.find(sector.GetName()) != sectorIndices.end()) {
+            return;
+        }
+        size_t sectorIndex = sectorRisks.size();
+        sectorIndices.insert(make_pair(sector.GetName(), sectorIndex));
+        double totalPV01 = 0;
+        long totalPosition = 0;
+        for (const auto& productId : sector.GetProductIds()) {
+            sectorMembership[productId].push_back(sectorIndex);
+            auto existing = dataStore.find(productId);
+            if (existing != dataStore.end()) {
+                totalPV01 += existing->second.GetPV01();
+                totalPosition += existing->second.GetQuantity();
             }
         }
-        else {
-            dataStore.insert(make_pair(position.GetProduct().GetProductId(), risk));
-            for (auto listener : this->GetListeners()) {
-                listener->ProcessUpdate(risk);
+        sectorRisks.push_back(PV01<BucketedSector<Bond>>(sector, totalPV01, totalPosition));
+    }
+
+    /**
+     * Turn on key-rate risk. From then on every position change moves the bucket totals by delta,
+     * and bucket risk is published to the sector listeners.
+     * @param buckets the tenor buckets, e.g. TenorBucket::StandardBuckets
+     */
+    void EnableKeyRateRisk(const vector<TenorBucket>& buckets) {
+        tenorBuckets = buckets;
+        keyRateRisks.clear();
+        for (const auto& bucket : tenorBuckets) {
+            keyRateRisks.push_back(PV01<BucketedSector<Bond>>(BucketedSector<Bond>(vector<string>(), bucket.GetName()), 0, 0));
+        }
+        exposures.clear();
+        contributions.clear();
+        exposuresStale.clear();
+        RefreshKeyRateRisk();
+    }
+
+    /**
+     * Recompute the bucket exposures of the whole book in one pass and rebuild the bucket totals from them.
+     * Every bucket is published to the sector listeners.
+     */
+    void RefreshKeyRateRisk() {
+        if (tenorBuckets.empty()) {
+            return;
+        }
+        size_t bondCount = analytics.GetBondCount();
+        size_t bucketCount = tenorBuckets.size();
+        vector<double> book;
+        analytics.ComputeBucketExposures(tenorBuckets, book);
+        TrackKeyRates(bondCount);
+        vector<long> held(bondCount, 0);
+        for (const auto& entry : dataStore) {
+            held[analytics.GetIndex(entry.first)] = entry.second.GetQuantity();
+        }
+        vector<double> deltaPV01(bucketCount, 0.0);
+        vector<long> deltaQuantity(bucketCount, 0);
+        for (size_t index = 0; index < bondCount; ++index) {
+            for (size_t j = 0; j < bucketCount; ++j) {
+                exposures[index * bucketCount + j] = book[j * bondCount + index];
+            }
+            exposuresStale[index] = 0;
+            ApplyKeyRates(index, held[index], deltaPV01, deltaQuantity);
+        }
+        for (size_t j = 0; j < bucketCount; ++j) {
+            auto& bucketRisk = keyRateRisks[j];
+            bucketRisk.Add(deltaPV01[j], deltaQuantity[j]);
+            for (auto listener : sectorListeners) {
+                listener->ProcessUpdate(bucketRisk);
             }
         }
     }
 
+    // Get the key-rate risk of every tenor bucket, in the order the buckets were given
+    const vector<PV01<BucketedSector<Bond>>>& GetKeyRateRisks() const {
+        return keyRateRisks;
+    }
+
+    // Add a listener that is notified whenever the risk of a registered sector changes
+    void AddSectorListener(ServiceListener<PV01<BucketedSector<Bond>>>* listener) {
+        sectorListeners.push_back(listener);
+    }
+
     /**
-     * Aggregate the risk of all products that belong to a sector.
+     * Get the aggregated risk of a registered sector. Totals are kept up to date incrementally,
+     * so this is a single lookup.
      * @param sector
      * @return
      */
     const PV01<BucketedSector<Bond>>& GetBucketedRisk(const BucketedSector<Bond>& sector) const override {
-        double totalPV01 = 0;
-        long totalPosition = 0;
-        for (const auto& product : sector.GetProducts()) {
-            if (dataStore.find(product.GetProductId()) != dataStore.end()) {
-                totalPV01 += dataStore.at(product.GetProductId()).GetPV01();
-                totalPosition += dataStore.at(product.GetProductId()).GetQuantity();
+        return sectorRisks[sectorIndices.at(sector.GetName())];
+    }
+
+    /**
+     * Save the clean price and risk of every bond the analytics kernel knows, in registration order.
+     * @param writer
+     */
+    void SaveSnapshot(SnapshotWriter& writer) override {
+        vector<SnapshotRiskRecord> records;
+        records.reserve(analytics.GetBondCount());
+        for (size_t index = 0; index < analytics.GetBondCount(); ++index) {
+            const string& productId = analytics.GetProductId(index);
+            SnapshotRiskRecord record = { writer.Intern(productId), 0, 0.0, 0.0, 0 };
+            if (analytics.HasCleanPrice(index)) {
+                record.flags |= SnapshotRiskRecord::HAS_PRICE;
+                record.cleanPrice = analytics.GetCleanPrice(index);
+            }
+            auto existing = dataStore.find(productId);
+            if (existing != dataStore.end()) {
+                record.flags |= SnapshotRiskRecord::HAS_RISK;
+                record.pv01 = existing->second.GetPV01();
+                record.quantity = existing->second.GetQuantity();
+            }
+            records.push_back(record);
+        }
+        writer.AddSection("risk", records);
+    }
+
+    /**
+     * Restore prices and risk. Sectors and key-rate buckets must be set up first; their totals are rebuilt from the restored risk.
+     * @param snapshot
+     */
+    void RestoreSnapshot(const SnapshotFile& snapshot) override {
+        uint64_t count;
+        const SnapshotRiskRecord* records = snapshot.GetSection<SnapshotRiskRecord>("risk", count);
+        for (uint64_t i = 0; i < count; ++i) {
+            const SnapshotRiskRecord& record = records[i];
+            const Bond& bond = BondProductService::GetInstance()->GetData(snapshot.GetString(record.product));
+            size_t index = analytics.Register(bond);
+            if (record.flags & SnapshotRiskRecord::HAS_PRICE) {
+                analytics.SetCleanPrice(index, record.cleanPrice);
+                if (index < exposuresStale.size()) {
+                    exposuresStale[index] = 1;
+                }
+            }
+            if (record.flags & SnapshotRiskRecord::HAS_RISK) {
+                PV01<Bond> risk(bond, record.pv01, record.quantity);
+                StoreRisk(risk, false);
+            }
+        }
+    }
+
+private:
+    BondAnalyticsEngine analytics;
+    vector<PV01<BucketedSector<Bond>>> sectorRisks;
+    unordered_map<string, size_t> sectorIndices;
+    unordered_map<string, vector<size_t>> sectorMembership;
+    vector<ServiceListener<PV01<BucketedSector<Bond>>>*> sectorListeners;
+    MetricCounter* positionDeltas = MetricsRegistry::GetInstance().GetCounter("risk.position_deltas");
+    MetricCounter* prices = MetricsRegistry::GetInstance().GetCounter("risk.prices");
+
+    // Key-rate mode. exposures and contributions are laid out bond-major by analytics index: [index * bucketCount + j].
+    vector<TenorBucket> tenorBuckets;
+    vector<PV01<BucketedSector<Bond>>> keyRateRisks;
+    vector<double> exposures;
+    vector<double> contributions;
+    vector<long> contributedQuantities;
+    vector<char> exposuresStale;
+
+    // Grow the per-bond key-rate caches to cover the first bondCount bonds
+    void TrackKeyRates(size_t bondCount) {
+        size_t bucketCount = tenorBuckets.size();
+        if (exposuresStale.size() < bondCount) {
+            exposuresStale.resize(bondCount, 1);
+            exposures.resize(bondCount * bucketCount, 0.0);
+            contributions.resize(bondCount * bucketCount, 0.0);
+            contributedQuantities.resize(bondCount * bucketCount, 0);
+        }
+    }
+
+    /**
+     * Replace a bond's contribution to each bucket with quantity * exposure, accumulating the change into the deltas.
+     * A bond counts towards a bucket's quantity if any of its cash flows fall into the bucket.
+     */
+    void ApplyKeyRates(size_t index, long quantity, vector<double>& deltaPV01, vector<long>& deltaQuantity) {
+        size_t bucketCount = tenorBuckets.size();
+        for (size_t j = 0; j < bucketCount; ++j) {
+            size_t slot = index * bucketCount + j;
+            double contribution = quantity * exposures[slot];
+            long contributedQuantity = exposures[slot] != 0.0 ? quantity : 0;
+            deltaPV01[j] += contribution - contributions[slot];
+            deltaQuantity[j] += contributedQuantity - contributedQuantities[slot];
+            contributions[slot] = contribution;
+            contributedQuantities[slot] = contributedQuantity;
+        }
+    }
+
+    /**
+     * Move the bucket totals for one bond's new position, recomputing its exposures first if it has repriced.
+     * Only buckets that actually changed are published, and only if notify is set.
+     */
+    void UpdateKeyRates(const string& productId, long quantity, bool notify) {
+        size_t index = analytics.GetIndex(productId);
+        size_t bucketCount = tenorBuckets.size();
+        TrackKeyRates(index + 1);
+        if (exposuresStale[index]) {
+            analytics.ComputeBucketExposures(index, tenorBuckets, &exposures[index * bucketCount]);
+            exposuresStale[index] = 0;
+        }
+        vector<double> deltaPV01(bucketCount, 0.0);
+        vector<long> deltaQuantity(bucketCount, 0);
+        ApplyKeyRates(index, quantity, deltaPV01, deltaQuantity);
+        for (size_t j = 0; j < bucketCount; ++j) {
+            if (deltaPV01[j] == 0.0 && deltaQuantity[j] == 0) {
+                continue;
+            }
+            auto& bucketRisk = keyRateRisks[j];
+            bucketRisk.Add(deltaPV01[j], deltaQuantity[j]);
+            if (!notify) {
+                continue;
+            }
+            for (auto listener : sectorListeners) {
+                listener->ProcessUpdate(bucketRisk);
             }
         }
-        auto pv01 = new PV01<BucketedSector<Bond>>(sector, totalPV01, totalPosition);
-        return *pv01;
+    }
+
+    /**
+     * Store the risk of a product, notify listeners and apply the change to every sector the product belongs to.
+     * @param risk
+     * @param notify false to update the totals without notifying any listener, e.g. when restoring a snapshot
+     */
+    void StoreRisk(PV01<Bond>& risk, bool notify = true) {
+        const string& productId = risk.GetProduct().GetProductId();
+        double deltaPV01 = risk.GetPV01();
+        long deltaQuantity = risk.GetQuantity();
+        auto result = FindOrInsert(productId, risk);
+        if (!result.added) {
+            deltaPV01 -= result.stored.GetPV01();
+            deltaQuantity -= result.stored.GetQuantity();
+            result.stored = risk;
+        }
+        if (notify) {
+            Notify(result.stored, result.added);
+        }
+
+        auto membership = sectorMembership.find(productId);
+        if (membership != sectorMembership.end()) {
+            for (size_t sectorIndex : membership->second) {
+                auto& sectorRisk = sectorRisks[sectorIndex];
+                sectorRisk.Add(deltaPV01, deltaQuantity);
+                if (!notify) {
+                    continue;
+                }
+                for (auto listener : sectorListeners) {
+                    listener->ProcessUpdate(sectorRisk);
+                }
+            }
+        }
+
+        if (!tenorBuckets.empty()) {
+            UpdateKeyRates(productId, risk.GetQuantity(), notify);
+        }
     }
 };
 
@@ -82,5 +366,49 @@ public:
 private:
     BondRiskService* listeningService;
 
+};
+
+/**
+ * Listens to position deltas from BondPositionService. Use instead of BondPositionRiskServiceListener, not alongside it.
+ */
+class BondPositionDeltaRiskServiceListener : public ServiceListener<PositionDelta<Bond>> {
+public:
+    explicit BondPositionDeltaRiskServiceListener(BondRiskService* listeningService) : listeningService(listeningService) {}
+
+    void ProcessAdd(PositionDelta<Bond>& data) override {
+        listeningService->AddPositionDelta(data);
+    }
+    void ProcessRemove(PositionDelta<Bond>& data) override {
+        // NO-OP : Positions are never removed in this project.
+    }
+    void ProcessUpdate(PositionDelta<Bond>& data) override {
+        listeningService->AddPositionDelta(data);
+    }
+
+private:
+    BondRiskService* listeningService;
+
+};
+
+/**
+ * Listens to BondPricingService so that risk reprices as the market moves.
+ */
+class BondPriceRiskServiceListener : public ServiceListener<Price<Bond>> {
+public:
+    explicit BondPriceRiskServiceListener(BondRiskService* listeningService) : listeningService(listeningService) {}
+
+    void ProcessAdd(Price<Bond>& data) override {
+        listeningService->UpdatePrice(data);
+    }
+    void ProcessRemove(Price<Bond>& data) override {
+        // NO-OP : Prices are never removed in this project.
+    }
+    void ProcessUpdate(Price<Bond>& data) override {
+        listeningService->UpdatePrice(data);
+    }
+
+private:
+    BondRiskService* listeningService;
+
 };
 #endif //BOND_RISK_SERVICE_HPP
\ No newline at end of file
@@ -0,0 +1,281 @@
+/**
+ * bondscenarioservice.hpp
+ *
+ * This file defines the BondScenarioService for pre-trade and end-of-day stress checks in the bond trading system. Key components include:
+ * - 'ScenarioPnL': The profit and loss of the whole book under one CurveShock.
+ * - 'BondScenarioService': Fully reprices every held bond under a grid of curve shocks (parallel shifts, twists and key-rate bumps)
+ *   on a ThreadPool. Per-bond price changes are cached and recomputed only for bonds whose price changed; per-bond P&L is recomputed
+ *   only for bonds whose price or position changed, and book totals are adjusted by delta.
+ * - 'BondScenarioConnector': An OutputFileConnector that writes scenario results to 'scenarios.csv'.
+ * - 'BondPositionScenarioServiceListener' and 'BondPriceScenarioServiceListener': Invalidate cached results as positions and prices change.
+ *
+ * Bonds are priced with the BondAnalyticsEngine owned by the BondRiskService, so the scenario and risk views share one set of yields.
+ * On restore, positions are rebuilt from the BondPositionService's snapshot section rather than saved a second time.
+ */
+
+#ifndef BOND_SCENARIO_SERVICE_HPP
+#define BOND_SCENARIO_SERVICE_HPP
+
+#include <sstream>
+#include "soa.hpp"
+#include "products.hpp"
+#include "positionservice.hpp"
+#include "pricingservice.hpp"
+#include "bondanalytics.hpp"
+#include "outputfileconnector.hpp"
+#include "threadpool.hpp"
+#include "snapshot.hpp"
+#include "bondproductservice.hpp"
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+/**
+ * Book P&L under one curve shock.
+ */
+class ScenarioPnL {
+
+public:
+
+    // ctor for a scenario result
+    ScenarioPnL(const CurveShock& _scenario, double _pnl) : scenario(_scenario), pnl(_pnl) {}
+
+    // Get the scenario
+    const CurveShock& GetScenario() const { return scenario; }
+
+    // Get the P&L of the book under the scenario
+    double GetPnL() const { return pnl; }
+
+private:
+    CurveShock scenario;
+    double pnl;
+
+};
+
+/**
+ * Writes scenario results to scenarios.csv
+ */
+class BondScenarioConnector : public OutputFileConnector<ScenarioPnL> {
+public:
+    explicit BondScenarioConnector(const string& filePath) : OutputFileConnector(filePath) {}
+
+    string toCSVString(ScenarioPnL& data) override {
+        std::ostringstream oss;
+        oss << boost::posix_time::microsec_clock::universal_time() << "," <<
+            data.GetScenario().GetName() << "," <<
+            data.GetPnL();
+        return oss.str();
+    }
+
+    string getCSVHeader() override {
+        return "Timestamp,Scenario,PnL";
+    }
+};
+
+/**
+ * Scenario P&L service keyed on scenario name.
+ */
+class BondScenarioService : public Service<string, ScenarioPnL>, public Checkpointable {
+public:
+    /**
+     * @param analytics the analytics kernel pricing the bonds (normally the BondRiskService's)
+     * @param scenarios the grid of curve shocks to run
+     * @param pool the thread pool that bonds are repriced on
+     */
+    BondScenarioService(BondAnalyticsEngine& analytics, const vector<CurveShock>& scenarios, ThreadPool* pool);
+
+    void OnMessage(ScenarioPnL& data) override {
+        // Do nothing. Since this service does not have a connector.
+    }
+
+    // Record a new position for a bond; only its P&L is invalidated.
+    void AddPosition(Position<Bond>& position);
+
+    // Record a new price for a bond; its repriced scenario prices are invalidated.
+    void UpdatePrice(const Price<Bond>& price);
+
+    // Recompute what was invalidated, update the book totals and notify listeners of every scenario.
+    void Run();
+
+    // Write the current results to scenarios.csv
+    void PublishResults();
+
+    // The standard grid: +/-25/50/100bp parallel, steepener/flattener twists and 25bp key-rate bumps at 2Y/3Y/5Y/7Y/10Y/30Y.
+    static vector<CurveShock> StandardScenarios();
+
+    // Nothing to add: the positions are saved by the BondPositionService, and results are recomputed by the next Run.
+    void SaveSnapshot(SnapshotWriter& writer) override {}
+
+    // Take the aggregate position of each bond from the positions section.
+    void RestoreSnapshot(const SnapshotFile& snapshot) override;
+
+private:
+    BondAnalyticsEngine& analytics;
+    vector<CurveShock> scenarios;
+    ThreadPool* pool;
+    BondScenarioConnector* connector;
+
+    // Per bond (by analytics index): position, cached scenario price changes and P&L, and invalidation flags.
+    vector<long> quantities;
+    vector<vector<double>> priceChanges;
+    vector<vector<double>> pnls;
+    vector<char> pricesStale;
+    vector<char> pnlStale;
+    vector<double> totals;
+
+    size_t Track(const Bond& bond);
+};
+
+BondScenarioService::BondScenarioService(BondAnalyticsEngine& analytics, const vector<CurveShock>& scenarios, ThreadPool* pool)
+    : analytics(analytics), scenarios(scenarios), pool(pool), totals(scenarios.size(), 0.0) {
+    for (const auto& scenario : scenarios) {
+        dataStore.insert(make_pair(scenario.GetName(), ScenarioPnL(scenario, 0.0)));
+    }
+    connector = new BondScenarioConnector("scenarios.csv");
+    connector->WriteHeader();
+}
+
+void BondScenarioService::AddPosition(Position<Bond>& position) {
+    size_t index = Track(position.GetProduct());
+    quantities[index] = position.GetAggregatePosition();
+    pnlStale[index] = 1;
+}
+
+void BondScenarioService::UpdatePrice(const Price<Bond>& price) {
+    size_t index = Track(price.GetProduct());
+    pricesStale[index] = 1;
+    pnlStale[index] = 1;
+}
+
+void BondScenarioService::RestoreSnapshot(const SnapshotFile& snapshot) {
+    uint64_t count;
+    const SnapshotPositionRecord* records = snapshot.GetSection<SnapshotPositionRecord>("positions", count);
+    for (uint64_t i = 0; i < count; ++i) {
+        const Bond& bond = BondProductService::GetInstance()->GetData(snapshot.GetString(records[i].product));
+        size_t index = Track(bond);
+        quantities[index] += records[i].quantity;
+        pnlStale[index] = 1;
+    }
+}
+
+/**
+ * Bonds with stale prices are repriced in parallel, one bond per task, under the full scenario grid.
+ * P&L is then rebuilt for bonds with a stale price or position and applied to the totals by delta.
+ */
+void BondScenarioService::Run() {
+    analytics.Refresh();
+
+    vector<size_t> repriced;
+    for (size_t index = 0; index < pricesStale.size(); ++index) {
+        if (pricesStale[index] && quantities[index] != 0) {
+            repriced.push_back(index);
+        }
+    }
+    pool->ParallelFor(0, repriced.size(), 1, [this, &repriced](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            size_t index = repriced[i];
+            vector<double>& changes = priceChanges[index];
+            double basePrice = analytics.RepriceUnderShocks(index, scenarios, changes.data());
+            for (double& change : changes) {
+                change -= basePrice;
+            }
+            pricesStale[index] = 0;
+        }
+    });
+
+    for (size_t index = 0; index < pnlStale.size(); ++index) {
+        if (!pnlStale[index]) {
+            continue;
+        }
+        // Prices are per 100 face and quantities are in face value. Flat bonds were not repriced and carry no P&L.
+        double scale = quantities[index] / 100.0;
+        for (size_t s = 0; s < scenarios.size(); ++s) {
+            double pnl = quantities[index] == 0 ? 0.0 : scale * priceChanges[index][s];
+            totals[s] += pnl - pnls[index][s];
+            pnls[index][s] = pnl;
+        }
+        pnlStale[index] = 0;
+    }
+
+    for (size_t s = 0; s < scenarios.size(); ++s) {
+        ScenarioPnL& result = dataStore.at(scenarios[s].GetName());
+        result = ScenarioPnL(scenarios[s], totals[s]);
+        for (auto listener : this->GetListeners()) {
+            listener->ProcessUpdate(result);
+        }
+    }
+}
+
+void BondScenarioService::PublishResults() {
+    for (const auto& scenario : scenarios) {
+        connector->Publish(dataStore.at(scenario.GetName()));
+    }
+}
+
+vector<CurveShock> BondScenarioService::StandardScenarios() {
+    vector<CurveShock> grid;
+    for (double shift : { -100.0, -50.0, -25.0, 25.0, 50.0, 100.0 }) {
+        std::ostringstream name;
+        name << "Parallel" << (shift > 0 ? "+" : "") << shift << "bp";
+        grid.push_back(CurveShock::Parallel(name.str(), shift));
+    }
+    grid.push_back(CurveShock::Twist("Steepener2s30s+25bp", -12.5, 12.5));
+    grid.push_back(CurveShock::Twist("Flattener2s30s-25bp", 12.5, -12.5));
+    vector<double> keyTenors = { 2.0, 3.0, 5.0, 7.0, 10.0, 30.0 };
+    vector<string> keyNames = { "KR2Y", "KR3Y", "KR5Y", "KR7Y", "KR10Y", "KR30Y" };
+    for (size_t i = 0; i < keyTenors.size(); ++i) {
+        grid.push_back(CurveShock::KeyRate(keyNames[i] + "+25bp", keyTenors, i, 25.0));
+    }
+    return grid;
+}
+
+/**
+ * Make sure the bond is registered with the analytics kernel and that the per-bond caches cover it.
+ */
+size_t BondScenarioService::Track(const Bond& bond) {
+    size_t index = analytics.Register(bond);
+    while (quantities.size() <= index) {
+        quantities.push_back(0);
+        priceChanges.push_back(vector<double>(scenarios.size(), 0.0));
+        pnls.push_back(vector<double>(scenarios.size(), 0.0));
+        pricesStale.push_back(1);
+        pnlStale.push_back(1);
+    }
+    return index;
+}
+
+class BondPositionScenarioServiceListener : public ServiceListener<Position<Bond>> {
+public:
+    explicit BondPositionScenarioServiceListener(BondScenarioService* listeningService) : listeningService(listeningService) {}
+
+    void ProcessAdd(Position<Bond>& data) override {
+        listeningService->AddPosition(data);
+    }
+    void ProcessRemove(Position<Bond>& data) override {
+        // NO-OP : Positions are never removed in this project.
+    }
+    void ProcessUpdate(Position<Bond>& data) override {
+        listeningService->AddPosition(data);
+    }
+
+private:
+    BondScenarioService* listeningService;
+};
+
+class BondPriceScenarioServiceListener : public ServiceListener<Price<Bond>> {
+public:
+    explicit BondPriceScenarioServiceListener(BondScenarioService* listeningService) : listeningService(listeningService) {}
+
+    void ProcessAdd(Price<Bond>& data) override {
+        listeningService->UpdatePrice(data);
+    }
+    void ProcessRemove(Price<Bond>& data) override {
+        // NO-OP : Prices are never removed in this project.
+    }
+    void ProcessUpdate(Price<Bond>& data) override {
+        listeningService->UpdatePrice(data);
+    }
+
+private:
+    BondScenarioService* listeningService;
+};
+
+#endif //BOND_SCENARIO_SERVICE_HPP
@@ -29,18 +29,13 @@ public:
      * @param priceStream
      */
     void PublishPrice(const PriceStream<Bond>& priceStream) override {
-        dataStore.insert(make_pair(priceStream.GetProduct().GetProductId(), priceStream));
-        if (dataStore.find(priceStream.GetProduct().GetProductId()) == dataStore.end()) {
-            for (auto listener : this->GetListeners()) {
-                listener->ProcessAdd(const_cast<PriceStream<Bond> &>(priceStream));
-            }
-        }
-        else {
-            for (auto listener : this->GetListeners()) {
-                listener->ProcessUpdate(const_cast<PriceStream<Bond> &>(priceStream));
-            }
-        }
+        auto result = Upsert(priceStream.GetProduct().GetProductId(), priceStream);
+        published->Increment();
+        Notify(result.stored, result.added);
     }
+
+private:
+    MetricCounter* published = MetricsRegistry::GetInstance().GetCounter("streaming.published");
 };
 
 class BondAlgoStreamServiceListener : public ServiceListener<AlgoStream<Bond>> {
@@ -5,8 +5,11 @@
  * 
  * This file defines the BondTradeBookingService and related components for the bond trading system. The main elements include:
  * - 'BondTradesConnector': An InputFileConnector that reads and parses trade data from 'trades.csv' and updates the trade booking service.
- * - 'BondTradeBookingService': A service that extends TradeBookingService for bonds. It processes trades, storing new trade data, and notifies listeners of new trades.
+ * - 'BondTradeBookingService': A service that extends TradeBookingService for bonds. It processes trades, drops trades it has already seen,
+ *   and notifies listeners of new trades. Full trade objects are only kept if asked for; duplicates are detected with a TradeIdIndex.
  * - 'BondExecutionServiceListener': Listens to the ExecutionOrder<Bond> service. It creates and processes trades based on execution orders, updating the BondTradeBookingService.
+ *   Generated trades are numbered in the order the executions arrive, so replaying the same market data regenerates the same ids,
+ *   and they pass through the same duplicate check as trades read from a file. The id sequence and book cycle are checkpointed.
  *
  * The BondTradeBookingService plays a crucial role in managing trade data within the bond trading system, ensuring trades are booked accurately and efficiently.
  */
@@ -17,17 +20,19 @@
 #include "products.hpp"
 #include "tradebookingservice.hpp"
 #include "executionservice.hpp"
+#include "identifiers.hpp"
+#include "tradeidindex.hpp"
 #include "inputfileconnector.hpp"
 #include "formatting.hpp"
 
 /**
  * Reads data from trades.csv
  */
-class BondTradesConnector : public InputFileConnector<string, Trade<Bond>> {
+class BondTradesConnector : public InputFileConnector<TradeId, Trade<Bond>> {
 public:
-    BondTradesConnector(const string& filePath, Service<string, Trade<Bond>>* connectedService);
+    BondTradesConnector(const string& filePath, Service<TradeId, Trade<Bond>>* connectedService);
 private:
-    void parse(string line) override;
+    Trade<Bond> decode(const string& line) const override;
 };
 
 /**
@@ -35,36 +40,83 @@ private:
  */
 class BondTradeBookingService : public TradeBookingService<Bond> {
 public:
-    BondTradeBookingService() {}
+    /**
+     * @param retainTrades keep every booked trade so it can be read back with GetData
+     * @param dedupWindow the number of most recent distinct trade ids that are guaranteed to be recognised as duplicates
+     */
+    explicit BondTradeBookingService(bool retainTrades = false, size_t dedupWindow = 1 << 20)
+        : retainTrades(retainTrades), bookedIds(dedupWindow), duplicateCount(0), hashedDuplicateCount(0) {}
     void Subscribe(BondTradesConnector* connector);
     void OnMessage(Trade<Bond>& data) override;
     void BookTrade(const Trade<Bond>& trade) override;
+
+    // Get the number of trades dropped as duplicates
+    size_t GetDuplicateCount() const;
+
+    // Get the number of those whose id was hashed from the input, which may be distinct trades whose ids collided
+    size_t GetHashedDuplicateCount() const;
+
+    // Remember a trade id as booked without booking it, e.g. one recovered from the journal
+    void MarkBooked(const TradeId& tradeId);
+
+private:
+    bool retainTrades;
+    TradeIdIndex bookedIds;
+    size_t duplicateCount;
+    size_t hashedDuplicateCount;
+    MetricCounter* booked = MetricsRegistry::GetInstance().GetCounter("trade_booking.booked");
+    MetricCounter* duplicates = MetricsRegistry::GetInstance().GetCounter("trade_booking.duplicates");
+    MetricCounter* hashedDuplicates = MetricsRegistry::GetInstance().GetCounter("trade_booking.hashed_duplicates");
 };
 
-void BondTradesConnector::parse(string line) {
+Trade<Bond> BondTradesConnector::decode(const string& line) const {
     auto split = splitString(line, ',');
-    string productId = split[0], tradeId = split[1], bookId = split[3];
+    string productId = split[0], book = split[3];
+    TradeId tradeId = TradeId::FromExternal(split[1]);
     double price = stod(split[2]);
     long quantity = stol(split[4]);
     Side side = split[5].compare("0") == 0 ? Side::BUY : Side::SELL;
 
-    auto bond = BondProductService::GetInstance()->GetData(productId);
-    auto trade = Trade<Bond>(bond, tradeId, price, bookId, quantity, side);
-    connectedService->OnMessage(trade);
+    auto& bond = BondProductService::GetInstance()->GetInputProduct(productId);
+    return Trade<Bond>(bond, tradeId, price, book, quantity, side);
 }
-BondTradesConnector::BondTradesConnector(const string& filePath, Service<string, Trade<Bond>>* connectedService)
+BondTradesConnector::BondTradesConnector(const string& filePath, Service<TradeId, Trade<Bond>>* connectedService)
     : InputFileConnector(filePath, connectedService) {}
 
 /**
- * Store the new trade data.
+ * Book a trade from the connector unless it has already been booked.
+ * A dropped trade with a hashed id is counted and reported on its own, since it may be a hash collision rather than a repeat.
  * @param data
  */
 void BondTradeBookingService::OnMessage(Trade<Bond>& data) {
-    // TODO: Check if trade has already been processed (Not part of project, since we never generate duplicate trades)
-    dataStore.insert(make_pair(data.GetTradeId(), data));
+    if (!bookedIds.Insert(data.GetTradeId())) {
+        duplicateCount++;
+        duplicates->Increment();
+        if (data.GetTradeId().IsHashed()) {
+            hashedDuplicateCount++;
+            hashedDuplicates->Increment();
+            std::cerr << "Dropped trade " << data.GetTradeId() << " as a duplicate of a hashed trade id" << std::endl;
+        }
+        return;
+    }
+    if (retainTrades) {
+        dataStore.insert(make_pair(data.GetTradeId(), data));
+    }
     BookTrade(data);
 }
 
+size_t BondTradeBookingService::GetDuplicateCount() const {
+    return duplicateCount;
+}
+
+size_t BondTradeBookingService::GetHashedDuplicateCount() const {
+    return hashedDuplicateCount;
+}
+
+void BondTradeBookingService::MarkBooked(const TradeId& tradeId) {
+    bookedIds.Insert(tradeId);
+}
+
 void BondTradeBookingService::Subscribe(BondTradesConnector* connector) {
     connector->read();
 }
@@ -74,33 +126,48 @@ void BondTradeBookingService::Subscribe(BondTradesConnector* connector) {
  * @param trade
  */
 void BondTradeBookingService::BookTrade(const Trade<Bond>& trade) {
+    LATENCY_MARK(BOOKED_STAGE);
+    booked->Increment();
     for (auto listener : this->GetListeners()) {
+        LATENCY_SCOPE(LISTENER_STAGE);
+        TRACE_SPAN("ProcessAdd", *listener);
         listener->ProcessAdd(const_cast<Trade<Bond> &>(trade));
     }
 }
 
-class BondExecutionServiceListener : public ServiceListener<ExecutionOrder<Bond>> {
+class BondExecutionServiceListener : public ServiceListener<ExecutionOrder<Bond>>, public Checkpointable {
 private:
     BondTradeBookingService* listeningService;
-    std::array<string, 3> states = { {"TRSY1", "TRSY2", "TRSY3"} };
+    IdGenerator tradeIds;
+    std::array<BookId, 3> states;
     unsigned int currentState = 0;
     void cycleState() {
         currentState = (currentState + 1) % states.size();
     }
 
 public:
-    BondExecutionServiceListener(BondTradeBookingService* listeningService) : listeningService(listeningService) {}
+    /**
+     * @param session the trading session stamped on generated trade ids
+     * @param shard the worker shard stamped on generated trade ids
+     */
+    explicit BondExecutionServiceListener(BondTradeBookingService* listeningService,
+        unsigned int session = 1,
+        unsigned int shard = 0)
+        : listeningService(listeningService), tradeIds(TRADE_ID, session, shard) {
+        BookRegistry& books = BookRegistry::GetInstance();
+        states = { { books.Intern("TRSY1"), books.Intern("TRSY2"), books.Intern("TRSY3") } };
+    }
     void ProcessAdd(ExecutionOrder<Bond>& data) override {
 
         // This is called by the ExecutionService after deciding to execute a trade.
-        // TODO: Generate tradeId here
         Trade<Bond> trade(data.GetProduct(),
-            "tradeid",
+            tradeIds.Next(),
             data.GetPrice(),
             states[currentState],
             data.GetVisibleQuantity() + data.GetHiddenQuantity(),
             data.GetSide() == OFFER ? BUY : SELL);
-        listeningService->BookTrade(trade);
+        // A trade already booked by an earlier run (e.g. recovered from the journal) is dropped rather than booked again.
+        listeningService->OnMessage(trade);
     }
 
     void ProcessRemove(ExecutionOrder<Bond>& data) override {
@@ -110,6 +177,19 @@ public:
     void ProcessUpdate(ExecutionOrder<Bond>& data) override {
         // NO-OP : ExecutionOrders are never updated in this project.
     }
+
+    void SaveSnapshot(SnapshotWriter& writer) override {
+        writer.AddSection("trade_generation", vector<SnapshotGeneratorRecord>{ { tradeIds.GetNextSequence(), currentState, 0 } });
+    }
+
+    void RestoreSnapshot(const SnapshotFile& snapshot) override {
+        uint64_t count;
+        const SnapshotGeneratorRecord* records = snapshot.GetSection<SnapshotGeneratorRecord>("trade_generation", count);
+        if (count > 0) {
+            tradeIds.SetNextSequence(records[0].nextSequence);
+            currentState = records[0].state % states.size();
+        }
+    }
 };
 
 #endif //BOND_TRADE_BOOKING_SERVICE_HPP
\ No newline at end of file
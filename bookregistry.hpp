@@ -0,0 +1,87 @@
+/**
+ * bookregistry.hpp
+ *
+ * This file defines the interning of trading book names for the bond trading system. Key components include:
+ * - 'BookId': A small dense integer standing in for a book name, usable directly as an index into per-book arrays.
+ * - 'BookRegistry': A process-wide table that hands out BookIds in first-seen order and maps them back to names.
+ *
+ * Book names are interned once where they enter the system (input connectors, execution listeners), so positions can be
+ * kept in dense arrays indexed by BookId and names are only looked up again when writing output.
+ */
+
+#ifndef BOOK_REGISTRY_HPP
+#define BOOK_REGISTRY_HPP
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+using namespace std;
+
+typedef unsigned int BookId;
+
+class BookRegistry {
+
+public:
+
+    // Get the registry shared by the whole process
+    static BookRegistry& GetInstance();
+
+    // Get the id of a book, assigning the next free id if the book has not been seen before
+    BookId Intern(const string& name);
+
+    // Look up the id of a book without interning it. Returns false if the book is unknown.
+    bool Find(const string& name, BookId& id) const;
+
+    // Get the name of an interned book
+    const string& GetName(BookId id) const;
+
+    // Get the number of interned books. Ids run from 0 to GetBookCount() - 1.
+    size_t GetBookCount() const;
+
+private:
+    BookRegistry() {}
+
+    // A deque keeps names at stable addresses, so references returned by GetName stay valid as books are added.
+    deque<string> names;
+    unordered_map<string, BookId> ids;
+    mutable mutex lock;
+
+};
+
+BookRegistry& BookRegistry::GetInstance() {
+    static BookRegistry* instance = new BookRegistry();
+    return *instance;
+}
+
+BookId BookRegistry::Intern(const string& name) {
+    lock_guard<mutex> guard(lock);
+    auto inserted = ids.insert(make_pair(name, static_cast<BookId>(names.size())));
+    if (inserted.second) {
+        names.push_back(name);
+    }
+    return inserted.first->second;
+}
+
+bool BookRegistry::Find(const string& name, BookId& id) const {
+    lock_guard<mutex> guard(lock);
+    auto existing = ids.find(name);
+    if (existing == ids.end()) {
+        return false;
+    }
+    id = existing->second;
+    return true;
+}
+
+const string& BookRegistry::GetName(BookId id) const {
+    lock_guard<mutex> guard(lock);
+    return names.at(id);
+}
+
+size_t BookRegistry::GetBookCount() const {
+    lock_guard<mutex> guard(lock);
+    return names.size();
+}
+
+#endif //BOOK_REGISTRY_HPP
@@ -0,0 +1,32 @@
+/**
+ * columnar_to_csv.cpp
+ * Converts a columnar historical table back to the CSV layout written by the historical data services.
+ *
+ * Usage: columnar_to_csv <directory> <table> [output.csv]
+ * e.g.   columnar_to_csv history positions positions.csv
+ * Without an output file the CSV is written to standard output.
+ */
+
+#include <fstream>
+#include <iostream>
+#include "columnarstore.hpp"
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <directory> <table> [output.csv]" << std::endl;
+        return 1;
+    }
+    ColumnarReader reader(argv[1], argv[2]);
+    if (argc > 3) {
+        ofstream output(argv[3], ios_base::trunc);
+        if (!output) {
+            std::cerr << "Unable to open file " << argv[3] << std::endl;
+            return 1;
+        }
+        ConvertColumnarToCSV(reader, output);
+    }
+    else {
+        ConvertColumnarToCSV(reader, std::cout);
+    }
+    return 0;
+}
@@ -0,0 +1,505 @@
+/**
+ * columnarstore.hpp
+ *
+ * This file defines the binary columnar store used as an alternative backend by the historical data services. Key components include:
+ * - 'ColumnType' and 'ColumnSpec': The schema of a table. Every column is 8 bytes wide; the first column is always the record
+ *   timestamp and the second the product handle.
+ * - 'ColumnValue': One 8-byte cell, either an integer or a double.
+ * - 'ColumnarWriter': Appends fixed-width records to one append-only file per column, interns product ids to small handles and
+ *   maintains a block index (first record, timestamp range and a product mask per block of records).
+ * - 'ColumnarReader': Memory-maps a table so each column can be scanned as a plain array, and uses the block index to skip to a
+ *   timestamp or to blocks holding a product.
+ * - 'ConvertColumnarToCSV': Writes a table back out in the same CSV layout as the OutputFileConnectors.
+ *
+ * A table named 'positions' in directory 'history' consists of:
+ *   history/positions.schema       column names and types, one per line
+ *   history/positions.products     product ids, one per line; the line number is the handle
+ *   history/positions.index        one BlockIndexEntry per complete block of BLOCK_RECORDS records
+ *   history/positions.<column>.col a 64-byte ColumnHeader followed by one 8-byte value per record
+ * Record counts are derived from file sizes, so a table stays readable even if the writer never shut down cleanly.
+ */
+
+#ifndef COLUMNAR_STORE_HPP
+#define COLUMNAR_STORE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include "latency.hpp"
+#include "tracing.hpp"
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "identifiers.hpp"
+#include "formatting.hpp"
+
+using namespace std;
+
+enum ColumnType {
+    TIMESTAMP_COLUMN = 1,   // microseconds since the Unix epoch
+    PRODUCT_COLUMN = 2,     // product handle from the table's dictionary
+    INT64_COLUMN = 3,
+    DOUBLE_COLUMN = 4,
+    ENTITY_ID_COLUMN = 5    // raw EntityId value
+};
+
+/**
+ * Name and type of a column. Names are used as the CSV header when converting back.
+ */
+struct ColumnSpec {
+    string name;
+    ColumnType type;
+};
+
+/**
+ * One 8-byte cell of a record.
+ */
+union ColumnValue {
+    int64_t integer;
+    double real;
+
+    static ColumnValue Integer(int64_t value) { ColumnValue cell; cell.integer = value; return cell; }
+    static ColumnValue Real(double value) { ColumnValue cell; cell.real = value; return cell; }
+};
+
+/**
+ * Header at the start of every column file. 64 bytes, so the values that follow are cache-line aligned in a mapping.
+ */
+struct ColumnHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t type;
+    uint32_t width;
+    uint32_t reserved;
+    char name[40];
+};
+
+/**
+ * Summary of one block of records, used to skip blocks by time or product without touching the columns.
+ * Bit (handle % 64) of productMask is set if a product with that handle appears in the block.
+ */
+struct BlockIndexEntry {
+    uint64_t firstRecord;
+    int64_t minTimestamp;
+    int64_t maxTimestamp;
+    uint64_t productMask;
+};
+
+static const char COLUMN_MAGIC[8] = { 'B', 'T', 'S', 'C', 'O', 'L', '1', '\0' };
+static const size_t BLOCK_RECORDS = 1024;
+
+class ColumnarWriter {
+
+public:
+
+    /**
+     * Create (or truncate) a table.
+     * @param directory the directory holding the table files; created if it does not exist
+     * @param table the table name, used as the file name prefix
+     * @param columns the schema; the first two columns must be TIMESTAMP_COLUMN and PRODUCT_COLUMN
+     */
+    ColumnarWriter(const string& directory, const string& table, const vector<ColumnSpec>& columns);
+
+    ~ColumnarWriter();
+
+    ColumnarWriter(const ColumnarWriter&) = delete;
+    ColumnarWriter& operator=(const ColumnarWriter&) = delete;
+
+    // Get the handle of a product, adding it to the dictionary on first sight
+    int64_t Intern(const string& productId);
+
+    // Append one record. Values are given in schema order.
+    void Append(initializer_list<ColumnValue> values);
+
+    // Push buffered values to the operating system
+    void Flush();
+
+    // Get the number of records appended
+    uint64_t GetRecordCount() const;
+
+    // Get the current time in microseconds since the Unix epoch
+    static int64_t Now();
+
+private:
+    string prefix;
+    vector<ColumnSpec> columns;
+    vector<FILE*> columnFiles;
+    FILE* indexFile;
+    FILE* productFile;
+    unordered_map<string, int64_t> handles;
+    uint64_t recordCount;
+    BlockIndexEntry block;
+
+    static FILE* Open(const string& path);
+
+};
+
+class ColumnarReader {
+
+public:
+
+    // Map a table for reading
+    ColumnarReader(const string& directory, const string& table);
+
+    ~ColumnarReader();
+
+    ColumnarReader(const ColumnarReader&) = delete;
+    ColumnarReader& operator=(const ColumnarReader&) = delete;
+
+    // Get the schema
+    const vector<ColumnSpec>& GetColumns() const;
+
+    // Get the number of complete records
+    uint64_t GetRecordCount() const;
+
+    // Get a column as an array of GetRecordCount() integers. The pointer stays valid for the life of the reader.
+    const int64_t* GetIntegerColumn(size_t column) const;
+
+    // Get a column as an array of GetRecordCount() doubles
+    const double* GetDoubleColumn(size_t column) const;
+
+    // Get the position of a column by name. Returns false if there is no such column.
+    bool FindColumn(const string& name, size_t& column) const;
+
+    // Get the product id behind a handle
+    const string& GetProductId(int64_t handle) const;
+
+    // Get the handle of a product. Returns false if the product never appears in the table.
+    bool FindHandle(const string& productId, int64_t& handle) const;
+
+    // Get the first record with a timestamp at or after the given one
+    uint64_t LowerBound(int64_t timestamp) const;
+
+    // Call visit(record) for every record of a product with a timestamp in [from, to), skipping blocks that cannot match
+    void Scan(int64_t handle, int64_t from, int64_t to, const function<void(uint64_t)>& visit) const;
+
+private:
+    vector<ColumnSpec> columns;
+    vector<const char*> mappings;
+    vector<size_t> mappingSizes;
+    vector<string> productIds;
+    vector<BlockIndexEntry> blocks;
+    uint64_t recordCount;
+
+    const int64_t* Timestamps() const;
+    const int64_t* Handles() const;
+
+};
+
+// Write a table as CSV with a header row, in the layout the CSV connectors use
+void ConvertColumnarToCSV(const ColumnarReader& reader, ostream& output);
+
+ColumnarWriter::ColumnarWriter(const string& directory, const string& table, const vector<ColumnSpec>& _columns)
+    : columns(_columns), recordCount(0) {
+    if (columns.size() < 2 || columns[0].type != TIMESTAMP_COLUMN || columns[1].type != PRODUCT_COLUMN) {
+        cerr << "Columnar table " << table << " must start with a timestamp and a product column";
+        exit(1);
+    }
+    mkdir(directory.c_str(), 0755);
+    prefix = directory + "/" + table;
+
+    ofstream schema(prefix + ".schema", ios_base::trunc);
+    for (const auto& column : columns) {
+        schema << column.name << "," << column.type << endl;
+    }
+
+    for (const auto& column : columns) {
+        FILE* file = Open(prefix + "." + column.name + ".col");
+        ColumnHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, COLUMN_MAGIC, sizeof(header.magic));
+        header.version = 1;
+        header.type = column.type;
+        header.width = sizeof(ColumnValue);
+        strncpy(header.name, column.name.c_str(), sizeof(header.name) - 1);
+        fwrite(&header, sizeof(header), 1, file);
+        columnFiles.push_back(file);
+    }
+    indexFile = Open(prefix + ".index");
+    productFile = Open(prefix + ".products");
+    memset(&block, 0, sizeof(block));
+}
+
+ColumnarWriter::~ColumnarWriter() {
+    for (FILE* file : columnFiles) {
+        fclose(file);
+    }
+    fclose(indexFile);
+    fclose(productFile);
+}
+
+int64_t ColumnarWriter::Intern(const string& productId) {
+    auto inserted = handles.insert(make_pair(productId, static_cast<int64_t>(handles.size())));
+    if (inserted.second) {
+        // New products are rare, so the dictionary is flushed straight away and is never behind the columns.
+        fprintf(productFile, "%s\n", productId.c_str());
+        fflush(productFile);
+    }
+    return inserted.first->second;
+}
+
+void ColumnarWriter::Append(initializer_list<ColumnValue> values) {
+    if (values.size() != columns.size()) {
+        cerr << "Columnar record for " << prefix << " has " << values.size() << " values, expected " << columns.size();
+        exit(1);
+    }
+    LATENCY_SCOPE(PERSIST_STAGE);
+    TRACE_SPAN("Append", *this);
+    const ColumnValue* cells = values.begin();
+    int64_t timestamp = cells[0].integer;
+    int64_t handle = cells[1].integer;
+    if (recordCount % BLOCK_RECORDS == 0) {
+        block.firstRecord = recordCount;
+        block.minTimestamp = timestamp;
+        block.maxTimestamp = timestamp;
+        block.productMask = 0;
+    }
+    block.minTimestamp = min(block.minTimestamp, timestamp);
+    block.maxTimestamp = max(block.maxTimestamp, timestamp);
+    block.productMask |= uint64_t(1) << (handle & 63);
+
+    for (size_t i = 0; i < columns.size(); ++i) {
+        fwrite(&cells[i], sizeof(ColumnValue), 1, columnFiles[i]);
+    }
+    recordCount++;
+    // A block is indexed once it is complete. Records after the last complete block are scanned directly by readers.
+    if (recordCount % BLOCK_RECORDS == 0) {
+        fwrite(&block, sizeof(block), 1, indexFile);
+    }
+    LATENCY_MARK(END_TO_END_STAGE);
+}
+
+void ColumnarWriter::Flush() {
+    for (FILE* file : columnFiles) {
+        fflush(file);
+    }
+    fflush(indexFile);
+}
+
+uint64_t ColumnarWriter::GetRecordCount() const {
+    return recordCount;
+}
+
+int64_t ColumnarWriter::Now() {
+    return ToEpochMicros(boost::posix_time::microsec_clock::universal_time());
+}
+
+FILE* ColumnarWriter::Open(const string& path) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        cerr << "Unable to open file " << path;
+        exit(1);
+    }
+    // Large buffers keep appends to a memcpy; the OS sees one write per buffer.
+    setvbuf(file, nullptr, _IOFBF, 1 << 16);
+    return file;
+}
+
+ColumnarReader::ColumnarReader(const string& directory, const string& table) {
+    string prefix = directory + "/" + table;
+    ifstream schema(prefix + ".schema");
+    if (!schema) {
+        cerr << "Unable to open file " << prefix << ".schema";
+        exit(1);
+    }
+    string line;
+    while (getline(schema, line)) {
+        size_t comma = line.rfind(',');
+        if (comma == string::npos) {
+            continue;
+        }
+        columns.push_back(ColumnSpec{ line.substr(0, comma), static_cast<ColumnType>(stoi(line.substr(comma + 1))) });
+    }
+
+    recordCount = UINT64_MAX;
+    for (const auto& column : columns) {
+        string path = prefix + "." + column.name + ".col";
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(ColumnHeader)) {
+            cerr << "Unable to open file " << path;
+            exit(1);
+        }
+        size_t size = size_t(info.st_size);
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            cerr << "Unable to map file " << path;
+            exit(1);
+        }
+        madvise(mapping, size, MADV_SEQUENTIAL);
+        if (memcmp(static_cast<const char*>(mapping), COLUMN_MAGIC, sizeof(COLUMN_MAGIC)) != 0) {
+            cerr << "Not a column file: " << path;
+            exit(1);
+        }
+        mappings.push_back(static_cast<const char*>(mapping));
+        mappingSizes.push_back(size);
+        recordCount = min<uint64_t>(recordCount, (size - sizeof(ColumnHeader)) / sizeof(ColumnValue));
+    }
+    if (columns.empty()) {
+        recordCount = 0;
+    }
+
+    ifstream products(prefix + ".products");
+    while (getline(products, line)) {
+        productIds.push_back(line);
+    }
+
+    ifstream index(prefix + ".index", ios_base::binary);
+    BlockIndexEntry entry;
+    while (index.read(reinterpret_cast<char*>(&entry), sizeof(entry))) {
+        if (entry.firstRecord + BLOCK_RECORDS <= recordCount) {
+            blocks.push_back(entry);
+        }
+    }
+}
+
+ColumnarReader::~ColumnarReader() {
+    for (size_t i = 0; i < mappings.size(); ++i) {
+        munmap(const_cast<char*>(mappings[i]), mappingSizes[i]);
+    }
+}
+
+const vector<ColumnSpec>& ColumnarReader::GetColumns() const {
+    return columns;
+}
+
+uint64_t ColumnarReader::GetRecordCount() const {
+    return recordCount;
+}
+
+const int64_t* ColumnarReader::GetIntegerColumn(size_t column) const {
+    return reinterpret_cast<const int64_t*>(mappings.at(column) + sizeof(ColumnHeader));
+}
+
+const double* ColumnarReader::GetDoubleColumn(size_t column) const {
+    return reinterpret_cast<const double*>(mappings.at(column) + sizeof(ColumnHeader));
+}
+
+bool ColumnarReader::FindColumn(const string& name, size_t& column) const {
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (columns[i].name == name) {
+            column = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const string& ColumnarReader::GetProductId(int64_t handle) const {
+    return productIds.at(size_t(handle));
+}
+
+bool ColumnarReader::FindHandle(const string& productId, int64_t& handle) const {
+    for (size_t i = 0; i < productIds.size(); ++i) {
+        if (productIds[i] == productId) {
+            handle = int64_t(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Timestamps are appended in wall-clock order, so the block index is searched for the first block that can hold
+ * the timestamp and only that block is scanned record by record.
+ */
+uint64_t ColumnarReader::LowerBound(int64_t timestamp) const {
+    size_t low = 0, high = blocks.size();
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        if (blocks[middle].maxTimestamp < timestamp) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    uint64_t record = low < blocks.size() ? blocks[low].firstRecord : blocks.size() * BLOCK_RECORDS;
+    const int64_t* timestamps = Timestamps();
+    while (record < recordCount && timestamps[record] < timestamp) {
+        record++;
+    }
+    return record;
+}
+
+void ColumnarReader::Scan(int64_t handle, int64_t from, int64_t to, const function<void(uint64_t)>& visit) const {
+    const int64_t* timestamps = Timestamps();
+    const int64_t* handles = Handles();
+    uint64_t bit = uint64_t(1) << (handle & 63);
+    uint64_t record = LowerBound(from);
+    while (record < recordCount) {
+        size_t blockIndex = size_t(record / BLOCK_RECORDS);
+        uint64_t blockEnd = min<uint64_t>(recordCount, (blockIndex + 1) * BLOCK_RECORDS);
+        if (blockIndex < blocks.size()) {
+            const BlockIndexEntry& entry = blocks[blockIndex];
+            if (entry.minTimestamp >= to) {
+                return;
+            }
+            if (!(entry.productMask & bit)) {
+                record = blockEnd;
+                continue;
+            }
+        }
+        for (; record < blockEnd; ++record) {
+            if (timestamps[record] >= to) {
+                return;
+            }
+            if (handles[record] == handle) {
+                visit(record);
+            }
+        }
+    }
+}
+
+const int64_t* ColumnarReader::Timestamps() const {
+    return GetIntegerColumn(0);
+}
+
+const int64_t* ColumnarReader::Handles() const {
+    return GetIntegerColumn(1);
+}
+
+void ConvertColumnarToCSV(const ColumnarReader& reader, ostream& output) {
+    const vector<ColumnSpec>& columns = reader.GetColumns();
+    for (size_t i = 0; i < columns.size(); ++i) {
+        output << (i > 0 ? "," : "") << columns[i].name;
+    }
+    output << "\n";
+    for (uint64_t record = 0; record < reader.GetRecordCount(); ++record) {
+        for (size_t i = 0; i < columns.size(); ++i) {
+            if (i > 0) {
+                output << ",";
+            }
+            switch (columns[i].type) {
+            case TIMESTAMP_COLUMN:
+                output << FromEpochMicros(reader.GetIntegerColumn(i)[record]);
+                break;
+            case PRODUCT_COLUMN:
+                output << reader.GetProductId(reader.GetIntegerColumn(i)[record]);
+                break;
+            case DOUBLE_COLUMN:
+                output << reader.GetDoubleColumn(i)[record];
+                break;
+            case ENTITY_ID_COLUMN:
+                output << EntityId(uint64_t(reader.GetIntegerColumn(i)[record])).ToString();
+                break;
+            default:
+                output << reader.GetIntegerColumn(i)[record];
+                break;
+            }
+        }
+        output << "\n";
+    }
+}
+
+#endif //COLUMNAR_STORE_HPP
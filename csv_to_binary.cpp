@@ -0,0 +1,38 @@
+/**
+ * csv_to_binary.cpp
+ * Converts price and market data input files to the binary input format read with --binary-input.
+ *
+ * Usage: csv_to_binary
+ *        csv_to_binary <prices|marketdata> <input.csv> <output.bin>
+ * Without arguments, prices.csv and marketdata.csv in the current directory are converted to prices.bin and marketdata.bin.
+ */
+
+#include <iostream>
+#include "binaryinput.hpp"
+
+int main(int argc, char* argv[]) {
+    if (argc == 1) {
+        std::cout << "Converted " << ConvertPricesToBinary("prices.csv", "prices.bin") << " prices to prices.bin" << std::endl;
+        std::cout << "Converted " << ConvertMarketDataToBinary("marketdata.csv", "marketdata.bin")
+            << " order books to marketdata.bin" << std::endl;
+        return 0;
+    }
+    if (argc != 4) {
+        std::cerr << "Usage: " << argv[0] << " [<prices|marketdata> <input.csv> <output.bin>]" << std::endl;
+        return 1;
+    }
+    string kind = argv[1];
+    uint64_t count;
+    if (kind == "prices") {
+        count = ConvertPricesToBinary(argv[2], argv[3]);
+    }
+    else if (kind == "marketdata") {
+        count = ConvertMarketDataToBinary(argv[2], argv[3]);
+    }
+    else {
+        std::cerr << "Unknown input kind " << kind << std::endl;
+        return 1;
+    }
+    std::cout << "Converted " << count << " records to " << argv[3] << std::endl;
+    return 0;
+}
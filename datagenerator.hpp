@@ -0,0 +1,527 @@
+/**
+ * datagenerator.hpp
+ *
+ * This file defines the synthetic input data generator for the bond trading system. Key components include:
+ * - 'GeneratorRandom': A SplitMix64 generator. Every row is generated from its own generator seeded with (seed, file, row),
+ *   so the output depends only on the options and not on the number of threads or how rows are split into chunks.
+ * - 'ComputeCusipCheckDigit': The standard CUSIP check digit over the first eight characters.
+ * - 'GeneratedSecurity' and 'GenerateSecurities': A reference data universe. The first six securities are the on-the-run
+ *   Treasuries used by setupProducts; the rest are Treasuries and agency bonds with well-formed CUSIPs.
+ * - 'GeneratorOptions': Row counts per file, the universe size, the seed, the output format and threading.
+ * - 'DataGenerator': Writes securities.csv, prices, marketdata, trades and inquiries in the layouts input_data.py produces,
+ *   optionally with a leading 'Timestamp' column, and prices and market data optionally in the binary input format. The header
+ *   and any single row of each CSV file can also be formatted on their own, which is how the feed simulator generates a feed.
+ *
+ * Rows are generated in chunks on a ThreadPool and written in row order by the calling thread, with a bounded number of chunks
+ * in flight so memory stays flat however many rows are asked for. Rows cycle through the securities in order.
+ */
+
+#ifndef DATA_GENERATOR_HPP
+#define DATA_GENERATOR_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <future>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include <boost/date_time/gregorian/gregorian.hpp>
+#include "binaryinput.hpp"
+#include "threadpool.hpp"
+
+using namespace std;
+
+/**
+ * SplitMix64 pseudo-random generator.
+ */
+class GeneratorRandom {
+
+public:
+
+    explicit GeneratorRandom(uint64_t seed) : state(seed) {}
+
+    uint64_t Next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    // Get a value in [0, bound)
+    uint64_t Uniform(uint64_t bound) {
+        return Next() % bound;
+    }
+
+private:
+    uint64_t state;
+
+};
+
+/**
+ * Compute the check digit of a CUSIP from its first eight characters (issuer and issue).
+ */
+char ComputeCusipCheckDigit(const string& base) {
+    int sum = 0;
+    for (size_t i = 0; i < 8 && i < base.size(); ++i) {
+        char c = base[i];
+        int value = (c >= '0' && c <= '9') ? c - '0'
+            : (c >= 'A' && c <= 'Z') ? c - 'A' + 10
+            : c == '*' ? 36 : c == '@' ? 37 : 38;
+        if (i % 2 == 1) {
+            value *= 2;
+        }
+        sum += value / 10 + value % 10;
+    }
+    return char('0' + (10 - sum % 10) % 10);
+}
+
+struct GeneratedSecurity {
+    string productId;
+    string ticker;
+    string issuer;
+    double coupon;
+    boost::gregorian::date maturity;
+};
+
+/**
+ * Generate a universe of count securities. Roughly four in five are Treasuries; the rest are spread over the agency issuers.
+ */
+vector<GeneratedSecurity> GenerateSecurities(size_t count, uint64_t seed) {
+    using boost::gregorian::date;
+    vector<GeneratedSecurity> securities = {
+        { "9128283H1", "T", "US Treasury", 1.750, date(2019, 11, 30) },
+        { "9128283L2", "T", "US Treasury", 1.875, date(2020, 12, 15) },
+        { "912828M80", "T", "US Treasury", 2.0, date(2022, 11, 30) },
+        { "9128283J7", "T", "US Treasury", 2.125, date(2024, 11, 30) },
+        { "9128283F5", "T", "US Treasury", 2.25, date(2027, 12, 15) },
+        { "912810RZ3", "T", "US Treasury", 2.75, date(2047, 12, 15) }
+    };
+    securities.resize(min(count, securities.size()));
+
+    struct Issuer {
+        const char* ticker;
+        const char* name;
+        const char* prefix;   // first four characters of the six-character CUSIP issuer code
+        uint64_t issued;
+    };
+    Issuer issuers[] = {
+        { "T", "US Treasury", "9128", 0 },
+        { "FNMA", "Fannie Mae", "3135", 0 },
+        { "FHLMC", "Freddie Mac", "3137", 0 },
+        { "FHLB", "Federal Home Loan Banks", "3130", 0 },
+        { "FFCB", "Federal Farm Credit Banks", "3133", 0 }
+    };
+    static const char ALPHABET[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+    unordered_set<string> seen;
+    for (const auto& security : securities) {
+        seen.insert(security.productId);
+    }
+    GeneratorRandom random(seed);
+    while (securities.size() < count) {
+        uint64_t pick = random.Uniform(20);
+        Issuer& issuer = issuers[pick < 16 ? 0 : pick - 15];
+        // The counter runs through the last two issuer characters and the two issue characters in base 36.
+        uint64_t n = issuer.issued++;
+        string base = issuer.prefix;
+        base += ALPHABET[(n / 46656) % 36];
+        base += ALPHABET[(n / 1296) % 36];
+        base += ALPHABET[(n / 36) % 36];
+        base += ALPHABET[n % 36];
+        string productId = base + ComputeCusipCheckDigit(base);
+        if (!seen.insert(productId).second) {
+            continue;
+        }
+        double coupon = 0.125 * (4 + random.Uniform(37));
+        int year = 2018 + int(random.Uniform(30));
+        int month = 1 + int(random.Uniform(12));
+        securities.push_back(GeneratedSecurity{ productId, issuer.ticker, issuer.name, coupon, date(year, month, 15) });
+    }
+    return securities;
+}
+
+// The inside spread of generated order books, in ticks, cycles through these
+const int MARKET_DATA_SPREADS[] = { 2, 4, 6, 8, 6, 4 };
+
+struct GeneratorOptions {
+    uint64_t seed = 9815;
+    size_t securityCount = 6;
+    uint64_t priceRows = 600000;
+    uint64_t marketDataRows = 600000;
+    uint64_t tradeRows = 60;
+    uint64_t inquiryRows = 60;
+    // Write prices and market data in the binary input format instead of CSV
+    bool binary = false;
+    // Add a 'Timestamp' column (or binary timestamps) starting at startMicros, one row every intervalMicros
+    bool timestamps = false;
+    int64_t startMicros = 1514552400000000LL;   // 2017-Dec-29 13:00:00 UTC
+    int64_t intervalMicros = 1000;
+    // Worker threads (0 for one per hardware thread) and rows per chunk
+    size_t threadCount = 0;
+    size_t chunkRows = 1 << 16;
+    string directory = ".";
+};
+
+class DataGenerator {
+
+public:
+
+    explicit DataGenerator(const GeneratorOptions& options);
+
+    // Write every file with a non-zero row count, and securities.csv
+    void Run();
+
+    void WriteSecurities();
+    uint64_t WritePrices();
+    uint64_t WriteMarketData();
+    uint64_t WriteTrades();
+    uint64_t WriteInquiries();
+
+    const vector<GeneratedSecurity>& GetSecurities() const;
+
+    // Get the CSV header of an input file ('prices', 'marketdata', 'trades' or 'inquiries'), without a Timestamp column.
+    // Returns an empty string for any other name.
+    static string GetCSVHeader(const string& file);
+
+    // Append one row of an input file as CSV, without a Timestamp column or line ending
+    void FormatPriceRow(uint64_t row, string& output) const;
+    void FormatMarketDataRow(uint64_t row, string& output) const;
+    void FormatTradeRow(uint64_t row, string& output) const;
+    void FormatInquiryRow(uint64_t row, string& output) const;
+
+private:
+    GeneratorOptions options;
+    vector<GeneratedSecurity> securities;
+    ThreadPool pool;
+
+    // Streams keep the rows of different files independent of each other
+    enum Stream { PRICE_STREAM = 1, MARKET_DATA_STREAM = 2, TRADE_STREAM = 3, INQUIRY_STREAM = 4 };
+
+    // Generate rows [0, rows) in chunks on the pool and write the chunks in row order
+    template<typename Chunk>
+    void Generate(uint64_t rows, const function<void(uint64_t, uint64_t, Chunk&)>& fill, const function<void(const Chunk&)>& write);
+
+    GeneratorRandom RowRandom(Stream stream, uint64_t row) const;
+    const GeneratedSecurity& RowSecurity(uint64_t row) const;
+    int64_t RowTimestamp(uint64_t row) const;
+    // A 40-bit id unique to the row, so generated trades never look like duplicates
+    uint64_t RowId(Stream stream, uint64_t row) const;
+
+    FILE* Open(const string& name) const;
+    uint64_t WriteCSV(const string& name, const string& header, uint64_t rows,
+        const function<void(uint64_t, string&)>& formatRow);
+
+    static void AppendNumber(string& output, uint64_t value);
+    static void AppendFractional(string& output, int32_t ticks);
+    static void AppendHex(string& output, uint64_t value, int digits);
+
+};
+
+DataGenerator::DataGenerator(const GeneratorOptions& _options)
+    : options(_options), securities(GenerateSecurities(max<size_t>(_options.securityCount, 1), _options.seed)),
+    pool(_options.threadCount) {
+    options.chunkRows = max<size_t>(options.chunkRows, 1);
+}
+
+void DataGenerator::Run() {
+    WriteSecurities();
+    if (options.priceRows > 0) {
+        WritePrices();
+    }
+    if (options.marketDataRows > 0) {
+        WriteMarketData();
+    }
+    if (options.tradeRows > 0) {
+        WriteTrades();
+    }
+    if (options.inquiryRows > 0) {
+        WriteInquiries();
+    }
+}
+
+void DataGenerator::WriteSecurities() {
+    FILE* file = Open("securities.csv");
+    fputs("ProductId,Ticker,Issuer,Coupon,Maturity\n", file);
+    for (const auto& security : securities) {
+        fprintf(file, "%s,%s,%s,%.3f,%s\n", security.productId.c_str(), security.ticker.c_str(), security.issuer.c_str(),
+            security.coupon, boost::gregorian::to_iso_extended_string(security.maturity).c_str());
+    }
+    fclose(file);
+}
+
+/**
+ * Mid prices are uniform over [99, 101) in 1/256ths and spreads are 2 or 3 ticks, as in input_data.py.
+ */
+uint64_t DataGenerator::WritePrices() {
+    if (!options.binary) {
+        return WriteCSV("prices.csv", GetCSVHeader("prices"), options.priceRows, [this](uint64_t row, string& output) {
+            FormatPriceRow(row, output);
+        });
+    }
+
+    BinaryInputWriter<BinaryPriceRecord> writer(options.directory + "/prices.bin", options.timestamps);
+    for (const auto& security : securities) {
+        writer.Intern(security.productId);
+    }
+    Generate<vector<BinaryPriceRecord>>(options.priceRows,
+        [this](uint64_t begin, uint64_t end, vector<BinaryPriceRecord>& records) {
+            records.resize(end - begin);
+            for (uint64_t row = begin; row < end; ++row) {
+                GeneratorRandom random = RowRandom(PRICE_STREAM, row);
+                BinaryPriceRecord& record = records[row - begin];
+                record = BinaryPriceRecord{};
+                record.timestamp = options.timestamps ? RowTimestamp(row) : 0;
+                record.product = uint32_t(row % securities.size());
+                record.midTicks = int32_t(99 * TICKS_PER_POINT + random.Uniform(2 * TICKS_PER_POINT));
+                record.spreadTicks = int32_t(2 + random.Uniform(2));
+            }
+        },
+        [&writer](const vector<BinaryPriceRecord>& records) { writer.Append(records.data(), records.size()); });
+    writer.Close();
+    return writer.GetRecordCount();
+}
+
+/**
+ * Five levels a side around a mid uniform over [99, 101] in 1/256ths. The inside spread cycles 2, 4, 6, 8, 6, 4 ticks
+ * and level sizes run from 10 to 50 million, as in input_data.py.
+ */
+uint64_t DataGenerator::WriteMarketData() {
+    if (!options.binary) {
+        return WriteCSV("marketdata.csv", GetCSVHeader("marketdata"), options.marketDataRows, [this](uint64_t row, string& output) {
+            FormatMarketDataRow(row, output);
+        });
+    }
+
+    BinaryInputWriter<BinaryMarketDataRecord> writer(options.directory + "/marketdata.bin", options.timestamps);
+    for (const auto& security : securities) {
+        writer.Intern(security.productId);
+    }
+    Generate<vector<BinaryMarketDataRecord>>(options.marketDataRows,
+        [this](uint64_t begin, uint64_t end, vector<BinaryMarketDataRecord>& records) {
+            records.resize(end - begin);
+            for (uint64_t row = begin; row < end; ++row) {
+                GeneratorRandom random = RowRandom(MARKET_DATA_STREAM, row);
+                int32_t mid = int32_t(99 * TICKS_PER_POINT + random.Uniform(2 * TICKS_PER_POINT + 1));
+                int spread = MARKET_DATA_SPREADS[row % 6];
+                BinaryMarketDataRecord& record = records[row - begin];
+                record = BinaryMarketDataRecord{};
+                record.timestamp = options.timestamps ? RowTimestamp(row) : 0;
+                record.product = uint32_t(row % securities.size());
+                record.depth = BINARY_BOOK_DEPTH;
+                for (int level = 0; level < BINARY_BOOK_DEPTH; ++level) {
+                    record.bidTicks[level] = mid - spread / 2 - level;
+                    record.offerTicks[level] = mid + spread / 2 + level;
+                    record.bidQuantities[level] = 10000000LL * (level + 1);
+                    record.offerQuantities[level] = 10000000LL * (level + 1);
+                }
+            }
+        },
+        [&writer](const vector<BinaryMarketDataRecord>& records) { writer.Append(records.data(), records.size()); });
+    writer.Close();
+    return writer.GetRecordCount();
+}
+
+uint64_t DataGenerator::WriteTrades() {
+    return WriteCSV("trades.csv", GetCSVHeader("trades"), options.tradeRows, [this](uint64_t row, string& output) {
+        FormatTradeRow(row, output);
+    });
+}
+
+uint64_t DataGenerator::WriteInquiries() {
+    return WriteCSV("inquiries.csv", GetCSVHeader("inquiries"), options.inquiryRows, [this](uint64_t row, string& output) {
+        FormatInquiryRow(row, output);
+    });
+}
+
+const vector<GeneratedSecurity>& DataGenerator::GetSecurities() const {
+    return securities;
+}
+
+string DataGenerator::GetCSVHeader(const string& file) {
+    if (file == "prices") {
+        return "ProductId,Mid,Spread";
+    }
+    if (file == "marketdata") {
+        string header = "ProductId";
+        for (const char* side : { "Bid", "Offer" }) {
+            for (int level = 1; level <= BINARY_BOOK_DEPTH; ++level) {
+                header += string(",") + side + "Price" + to_string(level) + "," + side + "Volume" + to_string(level);
+            }
+        }
+        return header;
+    }
+    if (file == "trades") {
+        return "ProductId,TradeId,Price,Book,Quantity,Side";
+    }
+    if (file == "inquiries") {
+        return "ProductId,InquiryId,Side,Quantity";
+    }
+    return "";
+}
+
+void DataGenerator::FormatPriceRow(uint64_t row, string& output) const {
+    GeneratorRandom random = RowRandom(PRICE_STREAM, row);
+    output += RowSecurity(row).productId;
+    output += ',';
+    AppendFractional(output, int32_t(99 * TICKS_PER_POINT + random.Uniform(2 * TICKS_PER_POINT)));
+    output += ',';
+    AppendFractional(output, int32_t(2 + random.Uniform(2)));
+}
+
+void DataGenerator::FormatMarketDataRow(uint64_t row, string& output) const {
+    GeneratorRandom random = RowRandom(MARKET_DATA_STREAM, row);
+    int32_t mid = int32_t(99 * TICKS_PER_POINT + random.Uniform(2 * TICKS_PER_POINT + 1));
+    int spread = MARKET_DATA_SPREADS[row % 6];
+    output += RowSecurity(row).productId;
+    for (int level = 0; level < BINARY_BOOK_DEPTH; ++level) {
+        output += ',';
+        AppendFractional(output, mid - spread / 2 - level);
+        output += ',';
+        AppendNumber(output, 10000000ULL * (level + 1));
+    }
+    for (int level = 0; level < BINARY_BOOK_DEPTH; ++level) {
+        output += ',';
+        AppendFractional(output, mid + spread / 2 + level);
+        output += ',';
+        AppendNumber(output, 10000000ULL * (level + 1));
+    }
+}
+
+/**
+ * Trades alternate between 99 and 100 and between buys and sells, and cycle through the three books and sizes of 1 to 5 million.
+ */
+void DataGenerator::FormatTradeRow(uint64_t row, string& output) const {
+    output += RowSecurity(row).productId;
+    output += ',';
+    AppendHex(output, RowId(TRADE_STREAM, row), 10);
+    output += row % 2 == 0 ? ",99.0,TRSY" : ",100.0,TRSY";
+    AppendNumber(output, 1 + row % 3);
+    output += ',';
+    AppendNumber(output, 1000000ULL * (1 + row % 5));
+    output += row % 2 == 0 ? ",0" : ",1";
+}
+
+void DataGenerator::FormatInquiryRow(uint64_t row, string& output) const {
+    output += RowSecurity(row).productId;
+    output += ',';
+    AppendHex(output, RowId(INQUIRY_STREAM, row), 10);
+    output += row % 2 == 0 ? ",0," : ",1,";
+    AppendNumber(output, 1000000ULL * (1 + row % 5));
+}
+
+/**
+ * Keep twice as many chunks in flight as there are workers: enough to keep every worker busy while the oldest chunk is
+ * written, and few enough that memory is bounded by a handful of chunks.
+ */
+template<typename Chunk>
+void DataGenerator::Generate(uint64_t rows, const function<void(uint64_t, uint64_t, Chunk&)>& fill,
+    const function<void(const Chunk&)>& write) {
+    size_t window = 2 * pool.GetThreadCount();
+    deque<future<Chunk>> inFlight;
+    uint64_t next = 0;
+    while (next < rows || !inFlight.empty()) {
+        while (next < rows && inFlight.size() < window) {
+            uint64_t begin = next, end = min<uint64_t>(rows, next + options.chunkRows);
+            inFlight.push_back(pool.Submit([&fill, begin, end]() {
+                Chunk chunk;
+                fill(begin, end, chunk);
+                return chunk;
+            }));
+            next = end;
+        }
+        Chunk chunk = inFlight.front().get();
+        inFlight.pop_front();
+        write(chunk);
+    }
+}
+
+GeneratorRandom DataGenerator::RowRandom(Stream stream, uint64_t row) const {
+    GeneratorRandom mixer(options.seed ^ (uint64_t(stream) << 56));
+    return GeneratorRandom(mixer.Next() + row * 0xd1b54a32d192ed03ULL);
+}
+
+const GeneratedSecurity& DataGenerator::RowSecurity(uint64_t row) const {
+    return securities[row % securities.size()];
+}
+
+int64_t DataGenerator::RowTimestamp(uint64_t row) const {
+    return options.startMicros + int64_t(row) * options.intervalMicros;
+}
+
+/**
+ * An odd multiplier and an xor-shift are both invertible modulo 2^40, so distinct rows (below 2^40) get distinct ids.
+ */
+uint64_t DataGenerator::RowId(Stream stream, uint64_t row) const {
+    const uint64_t mask = (uint64_t(1) << 40) - 1;
+    uint64_t id = (row * 0x9e3779b97fULL + GeneratorRandom(options.seed + stream).Next()) & mask;
+    return id ^ (id >> 20);
+}
+
+FILE* DataGenerator::Open(const string& name) const {
+    string path = options.directory + "/" + name;
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        cerr << "Unable to open file " << path;
+        exit(1);
+    }
+    setvbuf(file, nullptr, _IOFBF, 1 << 20);
+    return file;
+}
+
+uint64_t DataGenerator::WriteCSV(const string& name, const string& header, uint64_t rows,
+    const function<void(uint64_t, string&)>& formatRow) {
+    FILE* file = Open(name);
+    string firstLine = (options.timestamps ? "Timestamp," : "") + header + "\n";
+    fwrite(firstLine.data(), 1, firstLine.size(), file);
+    Generate<string>(rows,
+        [this, &formatRow](uint64_t begin, uint64_t end, string& output) {
+            output.reserve((end - begin) * 64);
+            for (uint64_t row = begin; row < end; ++row) {
+                if (options.timestamps) {
+                    AppendNumber(output, uint64_t(RowTimestamp(row)));
+                    output += ',';
+                }
+                formatRow(row, output);
+                output += '\n';
+            }
+        },
+        [file](const string& output) { fwrite(output.data(), 1, output.size(), file); });
+    fclose(file);
+    return rows;
+}
+
+void DataGenerator::AppendNumber(string& output, uint64_t value) {
+    char digits[20];
+    int count = 0;
+    do {
+        digits[count++] = char('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    while (count > 0) {
+        output += digits[--count];
+    }
+}
+
+/**
+ * Write a price in ticks as 100-xyz: whole points, then 32nds (xy) and 256ths (z, with 4 written as +).
+ */
+void DataGenerator::AppendFractional(string& output, int32_t ticks) {
+    AppendNumber(output, uint64_t(ticks / TICKS_PER_POINT));
+    int32_t remainder = ticks % TICKS_PER_POINT;
+    int32_t thirtySeconds = remainder / 8, eighths = remainder % 8;
+    output += '-';
+    output += char('0' + thirtySeconds / 10);
+    output += char('0' + thirtySeconds % 10);
+    output += eighths == 4 ? '+' : char('0' + eighths);
+}
+
+void DataGenerator::AppendHex(string& output, uint64_t value, int digits) {
+    static const char HEX[] = "0123456789abcdef";
+    for (int shift = 4 * (digits - 1); shift >= 0; shift -= 4) {
+        output += HEX[(value >> shift) & 0xf];
+    }
+}
+
+#endif //DATA_GENERATOR_HPP
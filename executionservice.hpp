@@ -10,6 +10,7 @@
 #include <string>
 #include "soa.hpp"
 #include "marketdataservice.hpp"
+#include "identifiers.hpp"
 
 enum OrderType { FOK, IOC, MARKET, LIMIT, STOP };
 
@@ -27,19 +28,19 @@ public:
     // ctor for an order
     ExecutionOrder(const T& _product,
         PricingSide _side,
-        string _orderId,
+        OrderId _orderId,
         OrderType _orderType,
         double _price,
         double _visibleQuantity,
         double _hiddenQuantity,
-        string _parentOrderId,
+        OrderId _parentOrderId,
         bool _isChildOrder);
 
     // Get the product
     const T& GetProduct() const;
 
     // Get the order ID
-    const string& GetOrderId() const;
+    OrderId GetOrderId() const;
 
     // Get the order type on this order
     OrderType GetOrderType() const;
@@ -54,7 +55,7 @@ public:
     long GetHiddenQuantity() const;
 
     // Get the parent order ID
-    const string& GetParentOrderId() const;
+    OrderId GetParentOrderId() const;
 
     // Is child order?
     bool IsChildOrder() const;
@@ -63,12 +64,12 @@ public:
 private:
     T product;
     PricingSide side;
-    string orderId;
+    OrderId orderId;
     OrderType orderType;
     double price;
     double visibleQuantity;
     double hiddenQuantity;
-    string parentOrderId;
+    OrderId parentOrderId;
     bool isChildOrder;
 
 };
@@ -91,12 +92,12 @@ public:
 template<typename T>
 ExecutionOrder<T>::ExecutionOrder(const T& _product,
     PricingSide _side,
-    string _orderId,
+    OrderId _orderId,
     OrderType _orderType,
     double _price,
     double _visibleQuantity,
     double _hiddenQuantity,
-    string _parentOrderId,
+    OrderId _parentOrderId,
     bool _isChildOrder) :
     product(_product) {
     side = _side;
@@ -115,7 +116,7 @@ const T& ExecutionOrder<T>::GetProduct() const {
 }
 
 template<typename T>
-const string& ExecutionOrder<T>::GetOrderId() const {
+OrderId ExecutionOrder<T>::GetOrderId() const {
     return orderId;
 }
 
@@ -140,7 +141,7 @@ long ExecutionOrder<T>::GetHiddenQuantity() const {
 }
 
 template<typename T>
-const string& ExecutionOrder<T>::GetParentOrderId() const {
+OrderId ExecutionOrder<T>::GetParentOrderId() const {
     return parentOrderId;
 }
 
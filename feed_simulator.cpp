@@ -0,0 +1,218 @@
+/**
+ * feed_simulator.cpp
+ * Pushes generated rows of one input file to a live feed at a target rate, so streaming ingest can be run and benchmarked locally.
+ *
+ * Usage: feed_simulator [options]
+ *   --file=NAME       the input to send: prices, marketdata, trades or inquiries (default prices)
+ *   --target=TARGET   where to send it: '-' for standard output, 'fifo:PATH' for a named pipe (created if missing),
+ *                     'unix:PATH' to listen on a Unix domain socket and serve the first reader to connect, or a file to append
+ *                     to (read it with 'tail:PATH') (default '-')
+ *   --rows=N          rows to send (default 100000)
+ *   --rate=N          rows per second; 0 sends as fast as the reader takes them (default 10000)
+ *   --batch=N         most rows sent in one write (default 256)
+ *   --securities=N    size of the security universe (default 6)
+ *   --seed=N          seed for every random choice (default 9815); with the same seed and universe, rows match generate_data's
+ *   --timestamps      prefix each row with a Timestamp column: the wall-clock time it was sent, in microseconds since the epoch
+ *
+ * The header line is sent first, as in the input files, unless appending to a file that already has content. Rows due at the
+ * same time are sent in one write; writes block when the reader falls behind, so the achieved rate reported at the end can be
+ * below the target.
+ */
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "datagenerator.hpp"
+#include "replay.hpp"
+
+struct FeedOptions {
+    string file = "prices";
+    string target = "-";
+    uint64_t rows = 100000;
+    double rate = 10000.0;
+    size_t batchRows = 256;
+    bool timestamps = false;
+    GeneratorOptions generator;
+};
+
+bool parseOptions(int argc, char* argv[], FeedOptions& options) {
+    options.generator.threadCount = 1;
+    for (int i = 1; i < argc; ++i) {
+        string option = argv[i];
+        size_t equals = option.find('=');
+        string name = option.substr(0, equals);
+        string value = equals == string::npos ? "" : option.substr(equals + 1);
+        if (name == "--file") {
+            options.file = value;
+        }
+        else if (name == "--target") {
+            options.target = value;
+        }
+        else if (name == "--rows") {
+            options.rows = stoull(value);
+        }
+        else if (name == "--rate") {
+            options.rate = stod(value);
+        }
+        else if (name == "--batch") {
+            options.batchRows = max<size_t>(stoull(value), 1);
+        }
+        else if (name == "--securities") {
+            options.generator.securityCount = stoull(value);
+        }
+        else if (name == "--seed") {
+            options.generator.seed = stoull(value);
+        }
+        else if (name == "--timestamps") {
+            options.timestamps = true;
+        }
+        else {
+            std::cerr << "Unknown option " << option << std::endl;
+            return false;
+        }
+    }
+    if (DataGenerator::GetCSVHeader(options.file).empty()) {
+        std::cerr << "Unknown file " << options.file << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Open the target for writing. Sets appending if it is a file that already has content, so no header is written.
+ */
+int openTarget(const string& target, bool& appending) {
+    appending = false;
+    if (target == "-") {
+        return STDOUT_FILENO;
+    }
+    if (target.compare(0, 5, "fifo:") == 0) {
+        string path = target.substr(5);
+        if (mkfifo(path.c_str(), 0644) != 0 && errno != EEXIST) {
+            std::cerr << "Unable to create pipe " << path << ": " << strerror(errno) << std::endl;
+            exit(1);
+        }
+        std::cerr << "Waiting for a reader on " << path << std::endl;
+        return open(path.c_str(), O_WRONLY);
+    }
+    if (target.compare(0, 5, "unix:") == 0) {
+        string path = target.substr(5);
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path)) {
+            std::cerr << "Socket path too long: " << path << std::endl;
+            exit(1);
+        }
+        strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(path.c_str());
+        if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 1) != 0) {
+            std::cerr << "Unable to listen on " << path << ": " << strerror(errno) << std::endl;
+            exit(1);
+        }
+        std::cerr << "Waiting for a reader on " << path << std::endl;
+        int connection = accept(listener, nullptr, nullptr);
+        close(listener);
+        unlink(path.c_str());
+        return connection;
+    }
+    int descriptor = open(target.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    struct stat info;
+    appending = descriptor >= 0 && fstat(descriptor, &info) == 0 && info.st_size > 0;
+    return descriptor;
+}
+
+// Write all of data, waiting for the reader as needed. Returns false if the reader has gone.
+bool writeAll(int descriptor, const string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t result = write(descriptor, data.data() + written, data.size() - written);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result < 0) {
+            return false;
+        }
+        written += size_t(result);
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    FeedOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        return 1;
+    }
+    // A reader that goes away is reported by the failed write instead.
+    signal(SIGPIPE, SIG_IGN);
+
+    DataGenerator generator(options.generator);
+    void (DataGenerator::*formatRow)(uint64_t, string&) const =
+        options.file == "prices" ? &DataGenerator::FormatPriceRow
+        : options.file == "marketdata" ? &DataGenerator::FormatMarketDataRow
+        : options.file == "trades" ? &DataGenerator::FormatTradeRow : &DataGenerator::FormatInquiryRow;
+
+    bool appending;
+    int descriptor = openTarget(options.target, appending);
+    if (descriptor < 0) {
+        std::cerr << "Unable to open " << options.target << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+    string batch;
+    if (!appending) {
+        batch = (options.timestamps ? "Timestamp," : "") + DataGenerator::GetCSVHeader(options.file) + "\n";
+    }
+
+    ReplayOptions pacing;
+    pacing.enabled = options.rate > 0;
+    pacing.syntheticRate = options.rate;
+    ReplayScheduler scheduler(pacing);
+    scheduler.Start();
+    uint64_t sent = 0;
+    size_t batchRows = 0;
+    for (uint64_t row = 0; row < options.rows; ++row) {
+        int64_t due = scheduler.GetSyntheticOffset(row);
+        // Send what is waiting before sleeping until the next row is due, so no row waits on a later one.
+        if (batchRows == options.batchRows || (pacing.enabled && scheduler.GetElapsedSeconds() * 1e9 < due)) {
+            if (!writeAll(descriptor, batch)) {
+                break;
+            }
+            sent += batchRows;
+            batch.clear();
+            batchRows = 0;
+        }
+        if (pacing.enabled) {
+            scheduler.WaitFor(due);
+        }
+        if (options.timestamps) {
+            batch += to_string(chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count());
+            batch += ',';
+        }
+        (generator.*formatRow)(row, batch);
+        batch += '\n';
+        batchRows++;
+    }
+    if (writeAll(descriptor, batch)) {
+        sent += batchRows;
+    }
+    double seconds = scheduler.GetElapsedSeconds();
+    if (descriptor != STDOUT_FILENO) {
+        close(descriptor);
+    }
+
+    std::cerr << "Sent " << sent << " " << options.file << " rows to " << options.target << " in " << seconds << "s ("
+        << (seconds > 0 ? sent / seconds : 0.0) << " rows/s";
+    if (pacing.enabled) {
+        std::cerr << ", target " << options.rate << ", pacing error p99 " << scheduler.GetStats().GetPercentileMicros(99) << "us";
+    }
+    std::cerr << ")" << std::endl;
+    return sent == options.rows ? 0 : 1;
+}
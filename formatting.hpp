@@ -5,6 +5,8 @@
  * - 'splitString': Splits a given string into substrings based on a specified delimiter. Useful for parsing CSV or similarly formatted data.
  * - 'convertFractionalPriceToDouble': Converts bond prices from a fractional representation (common in bond markets) to a double value.
  *   This function is particularly important for processing bond prices which are often quoted in fractions.
+ * - 'ToEpochMicros' and 'FromEpochMicros': Convert between boost times and microseconds since the Unix epoch, the timestamp
+ *   format used by binary stores and in-memory caches.
  *
  * These utility functions are crucial for data parsing and conversion in various parts of the bond trading system, ensuring accurate and efficient data handling.
  */
@@ -15,6 +17,8 @@
 #include<vector>
 #include<string>
 #include<sstream>
+#include<cstdint>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 using namespace std;
 
@@ -52,4 +56,26 @@ double convertFractionalPriceToDouble(string price) {
     double secondFractionalPart = ((split[1][2] == '+') ? 4 : (split[1][2] - '0')) / 256.0;
     return integerPart + firstFractionalPart + secondFractionalPart;
 }
+
+/**
+ * Converts a boost time to microseconds since the Unix epoch.
+ *
+ * @param time a UTC time
+ * @return microseconds since 1970-01-01 00:00:00 UTC
+ */
+int64_t ToEpochMicros(const boost::posix_time::ptime& time) {
+    static const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+    return (time - epoch).total_microseconds();
+}
+
+/**
+ * Converts microseconds since the Unix epoch to a boost time.
+ *
+ * @param micros microseconds since 1970-01-01 00:00:00 UTC
+ * @return the UTC time
+ */
+boost::posix_time::ptime FromEpochMicros(int64_t micros) {
+    static const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+    return epoch + boost::posix_time::microseconds(micros);
+}
 #endif //FORMATTING_HPP
\ No newline at end of file
@@ -0,0 +1,83 @@
+/**
+ * generate_data.cpp
+ * Generates securities.csv and the input files for the bond trading system, deterministically from a seed.
+ *
+ * Usage: generate_data [options]
+ *   --seed=N          seed for every random choice (default 9815); the same options always produce the same files
+ *   --securities=N    size of the security universe (default 6, the on-the-run Treasuries the system sets up)
+ *   --prices=N        rows of prices (default 600000)
+ *   --marketdata=N    rows of market data (default 600000)
+ *   --trades=N        rows of trades (default 60)
+ *   --inquiries=N     rows of inquiries (default 60)
+ *   --binary          write prices.bin and marketdata.bin (read with --binary-input) instead of CSV
+ *   --timestamps      add a Timestamp column (or binary timestamps) for replay, one row every --interval-us
+ *   --interval-us=N   microseconds between consecutive rows of a file (default 1000)
+ *   --threads=N       generator threads (default one per hardware thread)
+ *   --directory=DIR   where to write the files (default the current directory)
+ */
+
+#include <chrono>
+#include <iostream>
+#include "datagenerator.hpp"
+
+bool parseOptions(int argc, char* argv[], GeneratorOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        string option = argv[i];
+        size_t equals = option.find('=');
+        string name = option.substr(0, equals);
+        string value = equals == string::npos ? "" : option.substr(equals + 1);
+        if (name == "--seed") {
+            options.seed = stoull(value);
+        }
+        else if (name == "--securities") {
+            options.securityCount = stoull(value);
+        }
+        else if (name == "--prices") {
+            options.priceRows = stoull(value);
+        }
+        else if (name == "--marketdata") {
+            options.marketDataRows = stoull(value);
+        }
+        else if (name == "--trades") {
+            options.tradeRows = stoull(value);
+        }
+        else if (name == "--inquiries") {
+            options.inquiryRows = stoull(value);
+        }
+        else if (name == "--binary") {
+            options.binary = true;
+        }
+        else if (name == "--timestamps") {
+            options.timestamps = true;
+        }
+        else if (name == "--interval-us") {
+            options.intervalMicros = stoll(value);
+        }
+        else if (name == "--threads") {
+            options.threadCount = stoull(value);
+        }
+        else if (name == "--directory") {
+            options.directory = value;
+        }
+        else {
+            std::cerr << "Unknown option " << option << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    GeneratorOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        return 1;
+    }
+    auto start = chrono::steady_clock::now();
+    DataGenerator generator(options);
+    generator.Run();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    uint64_t rows = options.priceRows + options.marketDataRows + options.tradeRows + options.inquiryRows;
+    std::cout << "Generated " << generator.GetSecurities().size() << " securities and " << rows << " rows in "
+        << seconds << "s" << std::endl;
+    return 0;
+}
@@ -12,9 +12,17 @@
 
 #include <string>
 #include "soa.hpp"
+#include "timeseriescache.hpp"
+#include "formatting.hpp"
+
+// Where a historical data service writes its records: CSV files, or binary column files (see columnarstore.hpp).
+enum HistoricalStorage { CSV_STORAGE, COLUMNAR_STORAGE };
+
  /**
   * Service for processing and persisting historical data to a persistent store.
   * Keyed on some persistent key.
+  * Recently persisted data can also be kept in a TimeSeriesCache keyed on the persist key, so it can be read back without the
+  * store. The cache is off until ConfigureCache turns it on, and persisting then costs nothing extra.
   * Type T is the data type to persist.
   */
 template<typename T>
@@ -25,6 +33,41 @@ public:
 	virtual // Persist data to a store
 		void PersistData(string persistKey, const T& data) = 0;
 
+	// Get the cache of recently persisted data
+	const TimeSeriesCache<T>& GetCache() const {
+		return cache;
+	}
+
+	// Replace the cache with one holding retention points and barRetention bars of barInterval microseconds per key.
+	// A retention of 0 turns the cache off.
+	void ConfigureCache(size_t retention = TIME_SERIES_DEFAULT_RETENTION, int64_t barInterval = 1000000,
+		size_t barRetention = TIME_SERIES_DEFAULT_BAR_RETENTION) {
+		cache = TimeSeriesCache<T>(retention, barInterval, barRetention);
+		cache.SetRollup(rollupValue, rollupVolume);
+	}
+
+protected:
+
+	// Set what the cache's bars roll up. Called by implementing classes.
+	void SetRollup(typename TimeSeriesCache<T>::RollupFunction value, typename TimeSeriesCache<T>::RollupFunction volume = nullptr) {
+		rollupValue = value;
+		rollupVolume = volume;
+		cache.SetRollup(value, volume);
+	}
+
+	// Add persisted data to the cache, stamped with the current time, if the cache is on
+	void Cache(const string& persistKey, const T& data) {
+		if (!cache.IsEnabled()) {
+			return;
+		}
+		cache.Insert(persistKey, ToEpochMicros(boost::posix_time::microsec_clock::universal_time()), data);
+	}
+
+private:
+	TimeSeriesCache<T> cache;
+	typename TimeSeriesCache<T>::RollupFunction rollupValue = nullptr;
+	typename TimeSeriesCache<T>::RollupFunction rollupVolume = nullptr;
+
 };
 
 #endif
\ No newline at end of file
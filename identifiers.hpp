@@ -0,0 +1,233 @@
+/**
+ * identifiers.hpp
+ *
+ * This file defines the compact 64-bit identifiers used for orders and trades in the bond trading system. Key components include:
+ * - 'EntityId': A 64-bit identifier packing the entity kind, session, shard and a per-shard sequence number. It is hashable and
+ *   comparable as a single integer and is only rendered to text by the output connectors.
+ * - 'IdGenerator': Hands out monotonically increasing EntityIds for one (kind, session, shard) triple without any allocation.
+ *
+ * Bit layout (most significant first): kind (4) | session (12) | shard (8) | sequence (40).
+ * Two workers generate colliding ids only if they share the same kind, session and shard. External ids that are not short hex
+ * strings are the exception: they keep a 60-bit hash below the kind, so two distinct ones can (rarely) get the same id.
+ */
+
+#ifndef IDENTIFIERS_HPP
+#define IDENTIFIERS_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <functional>
+#include <iostream>
+
+using namespace std;
+
+// The kind of entity an identifier refers to. EXTERNAL_ID and HASHED_EXTERNAL_ID are used for ids received from input files.
+enum EntityKind { NO_ID = 0, ORDER_ID = 1, TRADE_ID = 2, EXTERNAL_ID = 3, HASHED_EXTERNAL_ID = 4 };
+
+/**
+ * A compact 64-bit identifier for orders and trades.
+ */
+class EntityId {
+
+public:
+
+    static const int SEQUENCE_BITS = 40;
+    static const int SHARD_BITS = 8;
+    static const int SESSION_BITS = 12;
+    static const int KIND_BITS = 4;
+    static const int HASH_BITS = SESSION_BITS + SHARD_BITS + SEQUENCE_BITS;
+
+    // ctor for an empty identifier
+    EntityId() : value(0) {}
+
+    // ctor for an identifier from its raw 64-bit value
+    explicit EntityId(uint64_t _value) : value(_value) {}
+
+    // ctor for an identifier from its parts
+    EntityId(EntityKind kind, unsigned int session, unsigned int shard, uint64_t sequence);
+
+    // Build an identifier for an id received from an input file (e.g. a trade id in trades.csv).
+    static EntityId FromExternal(const string& externalId);
+
+    // Get the raw 64-bit value
+    uint64_t GetValue() const { return value; }
+
+    EntityKind GetKind() const;
+    unsigned int GetSession() const;
+    unsigned int GetShard() const;
+    uint64_t GetSequence() const;
+
+    // Is this the empty identifier?
+    bool IsEmpty() const { return value == 0; }
+
+    // Was this identifier hashed from an external id, so that it may be shared by another external id?
+    bool IsHashed() const { return GetKind() == HASHED_EXTERNAL_ID; }
+
+    // Render this identifier as text. Only output connectors should need this.
+    string ToString() const;
+
+    bool operator==(const EntityId& other) const { return value == other.value; }
+    bool operator!=(const EntityId& other) const { return value != other.value; }
+    bool operator<(const EntityId& other) const { return value < other.value; }
+
+    // Print the identifier
+    friend ostream& operator<<(ostream& output, const EntityId& id);
+
+private:
+    uint64_t value;
+
+    static const uint64_t SEQUENCE_MASK = (uint64_t(1) << SEQUENCE_BITS) - 1;
+    static const uint64_t SHARD_MASK = (uint64_t(1) << SHARD_BITS) - 1;
+    static const uint64_t SESSION_MASK = (uint64_t(1) << SESSION_BITS) - 1;
+    static const uint64_t KIND_MASK = (uint64_t(1) << KIND_BITS) - 1;
+    static const uint64_t HASH_MASK = (uint64_t(1) << HASH_BITS) - 1;
+
+};
+
+typedef EntityId OrderId;
+typedef EntityId TradeId;
+
+/**
+ * Generates unique identifiers of one kind for a given session and shard.
+ * Each sharded worker owns its own generator, so no synchronisation is needed.
+ */
+class IdGenerator {
+
+public:
+
+    // ctor for a generator
+    explicit IdGenerator(EntityKind _kind, unsigned int _session = 1, unsigned int _shard = 0);
+
+    // Get the next identifier
+    EntityId Next();
+
+    // Get the sequence number that the next identifier will carry
+    uint64_t GetNextSequence() const;
+
+    // Continue from a sequence number, e.g. one saved in a snapshot
+    void SetNextSequence(uint64_t sequence);
+
+private:
+    EntityKind kind;
+    unsigned int session;
+    unsigned int shard;
+    uint64_t nextSequence;
+
+};
+
+namespace std {
+template<>
+struct hash<EntityId> {
+    size_t operator()(const EntityId& id) const {
+        return hash<uint64_t>()(id.GetValue());
+    }
+};
+}
+
+EntityId::EntityId(EntityKind kind, unsigned int session, unsigned int shard, uint64_t sequence) {
+    value = ((uint64_t(kind) & KIND_MASK) << (SESSION_BITS + SHARD_BITS + SEQUENCE_BITS)) |
+        ((uint64_t(session) & SESSION_MASK) << (SHARD_BITS + SEQUENCE_BITS)) |
+        ((uint64_t(shard) & SHARD_MASK) << SEQUENCE_BITS) |
+        (sequence & SEQUENCE_MASK);
+}
+
+/**
+ * External ids in our input files are short hex strings, whose value is stored losslessly (up to 10 hex digits). Their
+ * leading zeros and letter case are not kept (see ToString).
+ * Anything else is hashed with 64-bit FNV-1a and keeps the low 60 bits of the hash: among a million such ids, the chance that
+ * any two share an id is about 1 in 2 million.
+ *
+ * @param externalId the id as it appears in the input file
+ * @return an EXTERNAL_ID EntityId, or a HASHED_EXTERNAL_ID one for anything else
+ */
+EntityId EntityId::FromExternal(const string& externalId) {
+    uint64_t parsed = 0;
+    bool isHex = !externalId.empty() && externalId.size() <= SEQUENCE_BITS / 4;
+    for (char c : externalId) {
+        if (!isHex) {
+            break;
+        }
+        parsed <<= 4;
+        if (c >= '0' && c <= '9') parsed |= uint64_t(c - '0');
+        else if (c >= 'a' && c <= 'f') parsed |= uint64_t(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') parsed |= uint64_t(c - 'A' + 10);
+        else isHex = false;
+    }
+    if (isHex) {
+        return EntityId(EXTERNAL_ID, 0, 0, parsed);
+    }
+    uint64_t hashed = 14695981039346656037ULL;
+    for (char c : externalId) {
+        hashed = (hashed ^ uint64_t(static_cast<unsigned char>(c))) * 1099511628211ULL;
+    }
+    return EntityId((uint64_t(HASHED_EXTERNAL_ID) << HASH_BITS) | (hashed & HASH_MASK));
+}
+
+EntityKind EntityId::GetKind() const {
+    return static_cast<EntityKind>((value >> (SESSION_BITS + SHARD_BITS + SEQUENCE_BITS)) & KIND_MASK);
+}
+
+unsigned int EntityId::GetSession() const {
+    return static_cast<unsigned int>((value >> (SHARD_BITS + SEQUENCE_BITS)) & SESSION_MASK);
+}
+
+unsigned int EntityId::GetShard() const {
+    return static_cast<unsigned int>((value >> SEQUENCE_BITS) & SHARD_MASK);
+}
+
+uint64_t EntityId::GetSequence() const {
+    return value & SEQUENCE_MASK;
+}
+
+/**
+ * Orders render as Order_<session>_<shard>_<sequence>, trades as Trade_<session>_<shard>_<sequence>.
+ * External ids render in canonical form: lowercase hex, zero-padded to at least 8 digits. This is the text they were read
+ * from only if it was written that way, as generated data is. Hashed external ids render as '#' and their 15-digit hash.
+ */
+string EntityId::ToString() const {
+    char buffer[48];
+    switch (GetKind()) {
+    case NO_ID:
+        return "";
+    case ORDER_ID:
+        snprintf(buffer, sizeof(buffer), "Order_%u_%u_%llu", GetSession(), GetShard(), (unsigned long long) GetSequence());
+        break;
+    case TRADE_ID:
+        snprintf(buffer, sizeof(buffer), "Trade_%u_%u_%llu", GetSession(), GetShard(), (unsigned long long) GetSequence());
+        break;
+    case HASHED_EXTERNAL_ID:
+        snprintf(buffer, sizeof(buffer), "#%015llx", (unsigned long long) (value & HASH_MASK));
+        break;
+    default:
+        snprintf(buffer, sizeof(buffer), "%08llx", (unsigned long long) GetSequence());
+        break;
+    }
+    return string(buffer);
+}
+
+ostream& operator<<(ostream& output, const EntityId& id) {
+    output << id.ToString();
+    return output;
+}
+
+IdGenerator::IdGenerator(EntityKind _kind, unsigned int _session, unsigned int _shard) {
+    kind = _kind;
+    session = _session;
+    shard = _shard;
+    nextSequence = 1;
+}
+
+EntityId IdGenerator::Next() {
+    return EntityId(kind, session, shard, nextSequence++);
+}
+
+uint64_t IdGenerator::GetNextSequence() const {
+    return nextSequence;
+}
+
+void IdGenerator::SetNextSequence(uint64_t sequence) {
+    nextSequence = sequence;
+}
+
+#endif //IDENTIFIERS_HPP
@@ -3,9 +3,26 @@
  * 
  * This file defines the InputFileConnector template class for the bond trading system. It is designed to read and process data from input files for various services. Key features include:
  * - Template Parameters: K (Key type) and V (Value type) for the connected service.
- * - 'parse': A pure virtual function to be overridden by implementing classes for custom parsing logic.
- * - 'read': Opens and reads from the specified file, calling 'parse' for each line in the file.
+ * - 'decode': A pure virtual function to be overridden by implementing classes to turn one line into a value. It must not
+ *   change the connector, so that lines can be decoded on several threads at once.
+ * - 'parse': Decodes a line and delivers the value.
+ * - 'read': Opens and reads from the specified file, calling 'parse' for each line in the file. When the file name is a stream
+ *   source ('-', 'fifo:PATH', 'unix:PATH' or 'tail:PATH', see streaminput.hpp), lines are parsed as they arrive until the
+ *   stream ends.
+ * - 'Deliver': Called by 'parse' with the parsed value to send it to the connected service. Separates the parse and service
+ *   stages when latency histograms are compiled in.
+ * - 'SetParallel': Reads by mapping the file, splitting it into newline-aligned chunks and decoding the chunks on a pool of
+ *   worker threads, while the reading thread delivers each chunk's values in file order as soon as the chunk is done.
+ * - 'SetStreamIdleTimeout': Ends a stream source that has received nothing for the given time.
+ * - 'SetReplay': Paces delivery with a ReplayScheduler instead of reading as fast as possible. Event times come from a
+ *   'Timestamp' column when the file has one (the column is removed before 'parse' sees the line) or from a synthetic rate.
  * - 'Publish': Overridden as a no-op, as this connector is intended only for data input, not output.
+ * - Checkpointing: When a snapshot is loaded, 'read' resumes at the byte offset of the file's watermark. When snapshots are
+ *   being written, the watermark is advanced past each line as it is delivered.
+ *
+ * A parallel read delivers exactly what a sequential read would, in the same order, so services need not be thread-safe. Only
+ * a bounded number of chunks are decoded ahead of delivery. Replay is paced one event at a time, so it always reads sequentially.
+ * A stream is paced by whoever writes it, so it is neither replayed nor decoded in parallel. Only a tailed file has a watermark.
  *
  * The class is a crucial part of the system's data pipeline, enabling the integration of external data files into the trading system's various services.
  */
@@ -13,10 +30,26 @@
 #ifndef INPUT_FILE_CONNECTOR_HPP
 #define INPUT_FILE_CONNECTOR_HPP
 
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <future>
 #include <string>
 #include <fstream>
 #include <iostream>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "soa.hpp"
+#include "replay.hpp"
+#include "snapshot.hpp"
+#include "streaminput.hpp"
+#include "threadpool.hpp"
+
+// Default size of the chunks a parallel read decodes at a time
+const size_t INPUT_CHUNK_BYTES = 1 << 18;
 
 /**
  * This class is used to read data from files into services. Implementing classes should override the parse method.
@@ -27,18 +60,121 @@ template<typename K, typename V>
 class InputFileConnector : public Connector<V> {
 private:
     string filePath;
+    ReplayOptions replay;
+    size_t parallelThreads;
+    size_t chunkBytes;
+    unsigned int streamIdleMillis;
+
+    // The values decoded from one chunk, each with the file offset just past its line
+    struct Chunk {
+        vector<V> values;
+        vector<uint64_t> ends;
+    };
+
+    // Decode the lines in [begin, end) of a mapped file
+    Chunk DecodeChunk(const char* mapping, size_t begin, size_t end, int timestampColumn) const;
+
+    // Read the file on a pool of parallelThreads workers
+    void ReadParallel();
+
+    // Read a stream source until it ends
+    void ReadStream();
+
+    // Find a column in the header line. Returns -1 if there is no such column.
+    static int FindColumn(const string& header, const string& name) {
+        int column = 0;
+        size_t begin = 0;
+        while (true) {
+            size_t end = header.find(',', begin);
+            if (header.compare(begin, end == string::npos ? string::npos : end - begin, name) == 0) {
+                return column;
+            }
+            if (end == string::npos) {
+                return -1;
+            }
+            begin = end + 1;
+            column++;
+        }
+    }
+
+    // Remove a column from a line, returning its cell
+    static string TakeColumn(string& line, int column) {
+        size_t begin = 0;
+        for (int i = 0; i < column && begin != string::npos; ++i) {
+            begin = line.find(',', begin);
+            begin = begin == string::npos ? begin : begin + 1;
+        }
+        if (begin == string::npos) {
+            return "";
+        }
+        size_t end = line.find(',', begin);
+        string cell = line.substr(begin, end == string::npos ? string::npos : end - begin);
+        if (end != string::npos) {
+            line.erase(begin, end - begin + 1);
+        }
+        else {
+            line.erase(begin > 0 ? begin - 1 : 0);
+        }
+        return cell;
+    }
 
 protected:
     Service<K, V>* connectedService;
+    MetricCounter* events;
+
+    // Send a parsed value to the connected service
+    void Deliver(V& data) {
+        DeliverInput(events, connectedService, data);
+    }
 
 public:
-    virtual void parse(string line) = 0;
+    // Turn one line of the file into a value for the connected service. Throws SkippedInput if the line cannot be delivered.
+    virtual V decode(const string& line) const = 0;
+
+    // Decode a line and send its value to the connected service. A line that cannot be decoded is skipped and reported.
+    void parse(string line) {
+        try {
+            V data = decode(line);
+            Deliver(data);
+        }
+        catch (const SkippedInput& skip) {
+            ReportSkippedInput(filePath, skip);
+        }
+    }
 
     void Publish(V& data) override {
         //do nothing since this is a subscribe only connector.
     }
 
+    // Replay the file at recorded (or synthetic) event times on the next read
+    void SetReplay(const ReplayOptions& options) {
+        replay = options;
+    }
+
+    /**
+     * Decode the file on worker threads on the next read.
+     * @param threads the number of worker threads; 0 reads on the calling thread only
+     * @param _chunkBytes the size of the chunks the file is split into
+     */
+    void SetParallel(size_t threads, size_t _chunkBytes = INPUT_CHUNK_BYTES) {
+        parallelThreads = threads;
+        chunkBytes = max<size_t>(_chunkBytes, 1);
+    }
+
+    // End a stream source after this many milliseconds without data (0 waits until its writer closes it)
+    void SetStreamIdleTimeout(unsigned int millis) {
+        streamIdleMillis = millis;
+    }
+
     void read() {
+        if (IsStreamSource(filePath)) {
+            ReadStream();
+            return;
+        }
+        if (parallelThreads > 0 && !replay.enabled) {
+            ReadParallel();
+            return;
+        }
         ifstream inFile;
         string line;
         inFile.open(filePath);
@@ -46,17 +182,215 @@ public:
             std::cerr << "Unable to open file " << filePath;
             exit(1);   // call system to stop
         }
-        inFile >> line; // skip headers
+        getline(inFile, line); // skip headers
+        // The offset just past the last line read; the last line of a file may have no newline.
+        uint64_t offset = line.size() + (inFile.eof() ? 0 : 1);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        int timestampColumn = FindColumn(line, "Timestamp");
+
+        InputWatermark* watermark = Checkpointer::GetInstance().GetWatermark(filePath);
+        if (watermark && watermark->offset > 0) {
+            inFile.seekg(0, ios_base::end);
+            if (uint64_t(inFile.tellg()) < watermark->offset) {
+                std::cerr << "File " << filePath << " is shorter than its snapshot watermark";
+                exit(1);
+            }
+            inFile.seekg(watermark->offset);
+            offset = watermark->offset;
+        }
 
-        while (inFile >> line) {
+        LATENCY_BEGIN_SOURCE(filePath);
+        ReplayScheduler scheduler(replay);
+        int64_t firstTimestamp = 0;
+        uint64_t eventIndex = 0;
+        scheduler.Start();
+        while (getline(inFile, line)) {
+            offset += line.size() + (inFile.eof() ? 0 : 1);
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (line.empty()) {
+                continue;
+            }
+            if (timestampColumn >= 0) {
+                string cell = TakeColumn(line, timestampColumn);
+                int64_t timestamp;
+                if (replay.enabled && ReplayScheduler::ParseTimestamp(cell, timestamp)) {
+                    if (eventIndex == 0) {
+                        firstTimestamp = timestamp;
+                    }
+                    scheduler.WaitFor(timestamp - firstTimestamp);
+                }
+                else if (replay.enabled) {
+                    scheduler.WaitFor(scheduler.GetSyntheticOffset(eventIndex));
+                }
+            }
+            else if (replay.enabled) {
+                scheduler.WaitFor(scheduler.GetSyntheticOffset(eventIndex));
+            }
+            LATENCY_BEGIN_EVENT();
+            TRACE_BEGIN_EVENT();
+            TRACE_SPAN("parse", *this);
             parse(line);
+            eventIndex++;
+            if (watermark) {
+                watermark->events++;
+                watermark->offset = offset;
+                Checkpointer::GetInstance().OnEvent();
+            }
         }
         inFile.close();
+        if (replay.enabled) {
+            scheduler.GetStats().Report(std::cout, filePath, scheduler.GetElapsedSeconds());
+        }
     }
 
     InputFileConnector(const string& filePath, Service<K, V>* connectedService)
-        : filePath(filePath), connectedService(connectedService) {
+        : filePath(filePath), parallelThreads(0), chunkBytes(INPUT_CHUNK_BYTES), streamIdleMillis(0), connectedService(connectedService),
+        events(MetricsRegistry::GetInstance().GetCounter("input." + filePath)) {
     }
 };
 
+template<typename K, typename V>
+typename InputFileConnector<K, V>::Chunk InputFileConnector<K, V>::DecodeChunk(const char* mapping, size_t begin, size_t end,
+    int timestampColumn) const {
+    TRACE_SPAN("parse", *this);
+    Chunk chunk;
+    string line;
+    while (begin < end) {
+        const char* newline = static_cast<const char*>(memchr(mapping + begin, '\n', end - begin));
+        size_t lineEnd = newline ? size_t(newline - mapping) : end;
+        line.assign(mapping + begin, lineEnd - begin);
+        begin = newline ? lineEnd + 1 : end;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty()) {
+            continue;
+        }
+        if (timestampColumn >= 0) {
+            TakeColumn(line, timestampColumn);
+        }
+        try {
+            chunk.values.push_back(decode(line));
+            chunk.ends.push_back(begin);
+        }
+        catch (const SkippedInput& skip) {
+            ReportSkippedInput(filePath, skip);
+        }
+    }
+    return chunk;
+}
+
+/**
+ * Chunks are submitted in file order and delivered in the order submitted, with at most two per worker decoded ahead.
+ */
+template<typename K, typename V>
+void InputFileConnector<K, V>::ReadParallel() {
+    int fd = open(filePath.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        std::cerr << "Unable to open file " << filePath;
+        exit(1);
+    }
+    size_t size = size_t(info.st_size);
+    if (size == 0) {
+        close(fd);
+        return;
+    }
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        std::cerr << "Unable to map file " << filePath;
+        exit(1);
+    }
+    madvise(mapped, size, MADV_SEQUENTIAL);
+    const char* mapping = static_cast<const char*>(mapped);
+
+    const char* newline = static_cast<const char*>(memchr(mapping, '\n', size));
+    size_t next = newline ? size_t(newline - mapping) + 1 : size;   // skip headers
+    string header(mapping, next - (newline ? 1 : 0));
+    if (!header.empty() && header.back() == '\r') {
+        header.pop_back();
+    }
+    int timestampColumn = FindColumn(header, "Timestamp");
+
+    InputWatermark* watermark = Checkpointer::GetInstance().GetWatermark(filePath);
+    if (watermark && watermark->offset > 0) {
+        if (size < watermark->offset) {
+            std::cerr << "File " << filePath << " is shorter than its snapshot watermark";
+            exit(1);
+        }
+        next = size_t(watermark->offset);
+    }
+
+    LATENCY_BEGIN_SOURCE(filePath);
+    {
+        ThreadPool pool(parallelThreads);
+        size_t window = 2 * pool.GetThreadCount();
+        deque<future<Chunk>> inFlight;
+        while (next < size || !inFlight.empty()) {
+            while (next < size && inFlight.size() < window) {
+                size_t begin = next;
+                size_t end = min(size, begin + chunkBytes);
+                newline = end < size ? static_cast<const char*>(memchr(mapping + end, '\n', size - end)) : nullptr;
+                end = newline ? size_t(newline - mapping) + 1 : size;
+                next = end;
+                inFlight.push_back(pool.Submit([this, mapping, begin, end, timestampColumn]() {
+                    return DecodeChunk(mapping, begin, end, timestampColumn);
+                }));
+            }
+            Chunk chunk = inFlight.front().get();
+            inFlight.pop_front();
+            for (size_t i = 0; i < chunk.values.size(); ++i) {
+                LATENCY_BEGIN_EVENT();
+                TRACE_BEGIN_EVENT();
+                Deliver(chunk.values[i]);
+                if (watermark) {
+                    watermark->events++;
+                    watermark->offset = chunk.ends[i];
+                    Checkpointer::GetInstance().OnEvent();
+                }
+            }
+        }
+    }
+    munmap(mapped, size);
+}
+
+template<typename K, typename V>
+void InputFileConnector<K, V>::ReadStream() {
+    StreamReader stream(filePath, streamIdleMillis);
+    string line;
+    if (!stream.NextLine(line)) {   // headers
+        return;
+    }
+    int timestampColumn = FindColumn(line, "Timestamp");
+
+    InputWatermark* watermark = stream.IsSeekable() ? Checkpointer::GetInstance().GetWatermark(filePath) : nullptr;
+    if (watermark && watermark->offset > 0) {
+        stream.Seek(watermark->offset);
+    }
+
+    LATENCY_BEGIN_SOURCE(filePath);
+    while (stream.NextLine(line)) {
+        if (line.empty()) {
+            continue;
+        }
+        if (timestampColumn >= 0) {
+            TakeColumn(line, timestampColumn);
+        }
+        LATENCY_BEGIN_EVENT();
+        TRACE_BEGIN_EVENT();
+        TRACE_SPAN("parse", *this);
+        parse(line);
+        if (watermark) {
+            watermark->events++;
+            watermark->offset = stream.GetOffset();
+            Checkpointer::GetInstance().OnEvent();
+        }
+    }
+}
+
 #endif //INPUT_FILE_CONNECTOR_HPP
\ No newline at end of file
@@ -0,0 +1,495 @@
+/**
+ * journal.hpp
+ *
+ * This file defines the write-ahead journal of booked trades and position changes in the bond trading system. Key components include:
+ * - 'JournalRecord': One fixed-layout 80-byte record: a booked trade or the change a trade made to a position, with a sequence
+ *   number and a CRC-32 of the whole record.
+ * - 'JournalOptions': The group-commit trade-off: how many records each commit holds at most, and how long the oldest record may
+ *   wait for a commit to fill. A batch of 1 syncs every record on its own; larger batches amortise each fdatasync. Also whether
+ *   booking waits for each trade to be durable.
+ * - 'JournalWriter': Appends records to the journal. Records are buffered by the caller's thread and written and synced by a
+ *   committer thread, so booking only waits on the disk if it falls JOURNAL_MAX_PENDING_BATCHES commits behind. It also keeps a
+ *   histogram of commit latency (append to durable).
+ * - 'JournalReader': Memory-maps a journal and scans its records in order, stopping at the first torn or corrupt record.
+ * - 'BondTradeJournalListener': Journals each trade booked by the BondTradeBookingService together with the position delta it
+ *   makes. It is registered ahead of the position listener, so both records are appended before the trade has any effect.
+ * - 'RecoverFromJournal': Rebuilds positions from the journaled deltas and marks the journaled trades as booked, so trades that
+ *   are read again are dropped as duplicates.
+ *
+ * A journal is a 16-byte header followed by records. A crash can leave at most a partly written batch at the end; the reader
+ * stops there and the next writer truncates it away before appending.
+ *
+ * Records are always appended before the trade's effects are published, but by default booking does not wait for them to be
+ * synced: a crash can lose the trades of the commits still pending (up to JOURNAL_MAX_PENDING_BATCHES batches), even though
+ * their positions were already written out. With 'waitForCommit', a trade reaches positions only once it is durable.
+ */
+
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "soa.hpp"
+#include "bookregistry.hpp"
+#include "bondproductservice.hpp"
+#include "bondtradebookingservice.hpp"
+#include "bondpositionservice.hpp"
+
+using namespace std;
+
+enum JournalRecordType { JOURNAL_TRADE = 1, JOURNAL_POSITION_DELTA = 2 };
+
+/**
+ * A booked trade (tradeId, price, quantity and side) or a position delta (a signed quantity). 80 bytes.
+ */
+struct JournalRecord {
+    uint64_t sequence;
+    uint32_t type;
+    // CRC-32 of the record with this field set to 0
+    uint32_t checksum;
+    uint64_t tradeId;
+    double price;
+    int64_t quantity;
+    uint32_t side;
+    uint32_t reserved;
+    char productId[16];
+    char book[16];
+};
+
+struct JournalFileHeader {
+    char magic[8];
+    uint32_t recordSize;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(JournalRecord) == 80, "JournalRecord layout changed");
+static_assert(sizeof(JournalFileHeader) == 16, "JournalFileHeader layout changed");
+
+static const char JOURNAL_MAGIC[8] = { 'B', 'T', 'S', 'J', 'N', 'L', '1', '\0' };
+
+// Get the CRC-32 (IEEE) of a block of memory
+uint32_t JournalChecksum(const void* data, size_t length);
+
+// Append blocks while this many full batches are waiting to be committed
+const size_t JOURNAL_MAX_PENDING_BATCHES = 16;
+
+struct JournalOptions {
+    // Commit as soon as this many records are waiting, and put no more than this many in one commit
+    size_t commitBatch = 64;
+    // Commit once the oldest waiting record has waited this long, however few records there are
+    unsigned int commitLatencyMicros = 1000;
+    // Block each booked trade until its records are durable, before its effects are published
+    bool waitForCommit = false;
+};
+
+class JournalWriter {
+
+public:
+
+    /**
+     * Open a journal for appending, creating it if needed. A torn tail left by a crash is truncated.
+     * @param path
+     * @param options
+     */
+    JournalWriter(const string& path, const JournalOptions& options);
+
+    // Commits anything still waiting
+    ~JournalWriter();
+
+    JournalWriter(const JournalWriter&) = delete;
+    JournalWriter& operator=(const JournalWriter&) = delete;
+
+    // Journal a record, filling in its sequence number and checksum. Returns the sequence number.
+    uint64_t Append(JournalRecord& record);
+
+    // Block until the record with the given sequence number is durable
+    void WaitForCommit(uint64_t sequence);
+
+    // Commit everything waiting and stop the committer thread
+    void Close();
+
+    // Get the histogram of the time from Append to durable, in LatencyClock ticks
+    const LatencyHistogram& GetCommitLatency() const;
+
+    // Get the number of fdatasync calls made
+    uint64_t GetCommitCount() const;
+
+private:
+    string path;
+    JournalOptions options;
+    int fileDescriptor;
+    thread committer;
+    mutex lock;
+    condition_variable pendingReady;
+    condition_variable committed;
+    bool stopping;
+    uint64_t nextSequence;
+    uint64_t committedSequence;
+    uint64_t commitCount;
+    // Records waiting to be committed, and when each was appended
+    vector<JournalRecord> pending;
+    vector<uint64_t> appendTimes;
+    LatencyHistogram commitLatency;
+    MetricCounter* records = MetricsRegistry::GetInstance().GetCounter("journal.records");
+    MetricCounter* commits = MetricsRegistry::GetInstance().GetCounter("journal.commits");
+
+    void Run();
+    void Commit(const vector<JournalRecord>& batch);
+};
+
+class JournalReader {
+
+public:
+
+    // Map a journal; exits if the file is not a journal
+    explicit JournalReader(const string& path);
+    ~JournalReader();
+
+    JournalReader(const JournalReader&) = delete;
+    JournalReader& operator=(const JournalReader&) = delete;
+
+    /**
+     * Call visit for each intact record in order.
+     * @return the number of records visited; scanning stops at the first torn or corrupt record
+     */
+    template<typename F>
+    uint64_t Scan(F visit) const;
+
+    // Get the length of the intact prefix of the file, as of the last Scan
+    uint64_t GetValidLength() const;
+
+    // Get the sequence number of the last intact record (0 if there are none), as of the last Scan
+    uint64_t GetLastSequence() const;
+
+private:
+    string path;
+    const char* mapping;
+    size_t size;
+    mutable uint64_t validLength;
+    mutable uint64_t lastSequence;
+
+};
+
+/**
+ * Journals every trade booked by the BondTradeBookingService and the change it makes to its position.
+ */
+class BondTradeJournalListener : public ServiceListener<Trade<Bond>> {
+public:
+    /**
+     * @param journal
+     * @param waitForCommit return only once the trade's records are durable
+     */
+    explicit BondTradeJournalListener(JournalWriter* journal, bool waitForCommit = false)
+        : journal(journal), waitForCommit(waitForCommit) {}
+
+    void ProcessAdd(Trade<Bond>& data) override {
+        JournalRecord record = {};
+        record.type = JOURNAL_TRADE;
+        record.tradeId = data.GetTradeId().GetValue();
+        record.price = data.GetPrice();
+        record.quantity = data.GetQuantity();
+        record.side = data.GetSide();
+        strncpy(record.productId, data.GetProduct().GetProductId().c_str(), sizeof(record.productId) - 1);
+        strncpy(record.book, data.GetBook().c_str(), sizeof(record.book) - 1);
+        journal->Append(record);
+
+        // The same change the BondPositionService makes for the trade
+        JournalRecord delta = {};
+        delta.type = JOURNAL_POSITION_DELTA;
+        delta.quantity = (data.GetSide() == BUY ? 1 : -1) * data.GetQuantity();
+        memcpy(delta.productId, record.productId, sizeof(delta.productId));
+        memcpy(delta.book, record.book, sizeof(delta.book));
+        uint64_t sequence = journal->Append(delta);
+        if (waitForCommit) {
+            journal->WaitForCommit(sequence);
+        }
+    }
+    void ProcessRemove(Trade<Bond>& data) override {
+        // NO-OP : Trades are never removed in this project.
+    }
+    void ProcessUpdate(Trade<Bond>& data) override {
+        // NO-OP : Trades are never updated in this project.
+    }
+
+private:
+    JournalWriter* journal;
+    bool waitForCommit;
+
+};
+
+/**
+ * Rebuild positions from a journal. Each position is set to the sum of its journaled deltas, and listeners are notified of the
+ * change as if by a trade. Journaled trade ids are marked as booked. Does nothing if there is no journal at path.
+ * @return the number of records recovered
+ */
+uint64_t RecoverFromJournal(const string& path, BondTradeBookingService* tradeBookingService, BondPositionService* positionService);
+
+uint32_t JournalChecksum(const void* data, size_t length) {
+    static const array<uint32_t, 256> table = []() {
+        array<uint32_t, 256> entries;
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+            }
+            entries[i] = value;
+        }
+        return entries;
+    }();
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; ++i) {
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+JournalWriter::JournalWriter(const string& _path, const JournalOptions& _options)
+    : path(_path), options(_options), stopping(false), nextSequence(1), committedSequence(0), commitCount(0) {
+    options.commitBatch = max<size_t>(options.commitBatch, 1);
+    struct stat info;
+    if (stat(path.c_str(), &info) == 0 && info.st_size > 0) {
+        JournalReader reader(path);
+        reader.Scan([](const JournalRecord&) {});
+        nextSequence = reader.GetLastSequence() + 1;
+        if (truncate(path.c_str(), off_t(reader.GetValidLength())) != 0) {
+            cerr << "Unable to truncate file " << path;
+            exit(1);
+        }
+    }
+    fileDescriptor = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fileDescriptor < 0) {
+        cerr << "Unable to open file " << path;
+        exit(1);
+    }
+    committedSequence = nextSequence - 1;
+    if (nextSequence == 1) {
+        JournalFileHeader header = {};
+        memcpy(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+        header.recordSize = sizeof(JournalRecord);
+        if (write(fileDescriptor, &header, sizeof(header)) != ssize_t(sizeof(header)) || fdatasync(fileDescriptor) != 0) {
+            cerr << "Unable to write file " << path;
+            exit(1);
+        }
+    }
+    committer = thread(&JournalWriter::Run, this);
+}
+
+JournalWriter::~JournalWriter() {
+    Close();
+}
+
+uint64_t JournalWriter::Append(JournalRecord& record) {
+    unique_lock<mutex> guard(lock);
+    committed.wait(guard, [this]() { return pending.size() < options.commitBatch * JOURNAL_MAX_PENDING_BATCHES; });
+    uint64_t now = LatencyClock::Now();
+    record.sequence = nextSequence++;
+    record.checksum = 0;
+    record.checksum = JournalChecksum(&record, sizeof(record));
+    pending.push_back(record);
+    appendTimes.push_back(now);
+    records->Increment();
+    if (pending.size() == 1 || pending.size() >= options.commitBatch) {
+        pendingReady.notify_one();
+    }
+    return record.sequence;
+}
+
+void JournalWriter::WaitForCommit(uint64_t sequence) {
+    unique_lock<mutex> guard(lock);
+    committed.wait(guard, [this, sequence]() { return committedSequence >= sequence; });
+}
+
+void JournalWriter::Close() {
+    if (!committer.joinable()) {
+        return;
+    }
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    pendingReady.notify_one();
+    committer.join();
+    close(fileDescriptor);
+}
+
+const LatencyHistogram& JournalWriter::GetCommitLatency() const {
+    return commitLatency;
+}
+
+uint64_t JournalWriter::GetCommitCount() const {
+    return commitCount;
+}
+
+/**
+ * Wait for a full batch, for the oldest record to reach the latency bound, or for Close; then write and sync up to a batch of
+ * the oldest waiting records. Appends carry on while a batch is being synced.
+ */
+void JournalWriter::Run() {
+    vector<JournalRecord> batch;
+    vector<uint64_t> batchTimes;
+    batch.reserve(options.commitBatch);
+    batchTimes.reserve(options.commitBatch);
+    unique_lock<mutex> guard(lock);
+    while (true) {
+        pendingReady.wait(guard, [this]() { return stopping || !pending.empty(); });
+        if (pending.empty()) {
+            break;
+        }
+        // The deadline is taken from when the committer first sees the batch, which is at most one commit after its first append.
+        auto deadline = chrono::steady_clock::now() + chrono::microseconds(options.commitLatencyMicros);
+        pendingReady.wait_until(guard, deadline, [this]() { return stopping || pending.size() >= options.commitBatch; });
+        size_t count = min(pending.size(), options.commitBatch);
+        batch.assign(pending.begin(), pending.begin() + count);
+        batchTimes.assign(appendTimes.begin(), appendTimes.begin() + count);
+        pending.erase(pending.begin(), pending.begin() + count);
+        appendTimes.erase(appendTimes.begin(), appendTimes.begin() + count);
+        guard.unlock();
+
+        Commit(batch);
+        uint64_t now = LatencyClock::Now();
+
+        guard.lock();
+        for (uint64_t appended : batchTimes) {
+            commitLatency.Record(now - appended);
+        }
+        committedSequence = batch.back().sequence;
+        commitCount++;
+        committed.notify_all();
+    }
+}
+
+void JournalWriter::Commit(const vector<JournalRecord>& batch) {
+    const char* data = reinterpret_cast<const char*>(batch.data());
+    size_t remaining = batch.size() * sizeof(JournalRecord);
+    while (remaining > 0) {
+        ssize_t written = write(fileDescriptor, data, remaining);
+        if (written <= 0) {
+            cerr << "Unable to write file " << path;
+            exit(1);
+        }
+        data += written;
+        remaining -= size_t(written);
+    }
+    if (fdatasync(fileDescriptor) != 0) {
+        cerr << "Unable to sync file " << path;
+        exit(1);
+    }
+    commits->Increment();
+}
+
+JournalReader::JournalReader(const string& _path) : path(_path), mapping(nullptr), size(0), validLength(0), lastSequence(0) {
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        cerr << "Unable to open file " << path;
+        exit(1);
+    }
+    size = size_t(info.st_size);
+    if (size < sizeof(JournalFileHeader)) {
+        // A crash before the header was synced leaves an empty journal.
+        close(fd);
+        size = 0;
+        return;
+    }
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        cerr << "Unable to map file " << path;
+        exit(1);
+    }
+    mapping = static_cast<const char*>(mapped);
+    madvise(mapped, size, MADV_SEQUENTIAL);
+    const JournalFileHeader* header = reinterpret_cast<const JournalFileHeader*>(mapping);
+    if (memcmp(header->magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 || header->recordSize != sizeof(JournalRecord)) {
+        cerr << "Not a journal file: " << path;
+        exit(1);
+    }
+}
+
+JournalReader::~JournalReader() {
+    if (mapping) {
+        munmap(const_cast<char*>(mapping), size);
+    }
+}
+
+template<typename F>
+uint64_t JournalReader::Scan(F visit) const {
+    validLength = 0;
+    lastSequence = 0;
+    if (!mapping) {
+        return 0;
+    }
+    uint64_t count = 0;
+    size_t offset = sizeof(JournalFileHeader);
+    JournalRecord record;
+    while (offset + sizeof(JournalRecord) <= size) {
+        memcpy(&record, mapping + offset, sizeof(record));
+        uint32_t checksum = record.checksum;
+        record.checksum = 0;
+        if (JournalChecksum(&record, sizeof(record)) != checksum || (count > 0 && record.sequence != lastSequence + 1)) {
+            break;
+        }
+        record.checksum = checksum;
+        visit(record);
+        lastSequence = record.sequence;
+        offset += sizeof(JournalRecord);
+        count++;
+    }
+    validLength = offset;
+    return count;
+}
+
+uint64_t JournalReader::GetValidLength() const {
+    return validLength;
+}
+
+uint64_t JournalReader::GetLastSequence() const {
+    return lastSequence;
+}
+
+uint64_t RecoverFromJournal(const string& path, BondTradeBookingService* tradeBookingService, BondPositionService* positionService) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        return 0;
+    }
+    JournalReader reader(path);
+    BookRegistry& books = BookRegistry::GetInstance();
+    // Quantities per book, by product
+    unordered_map<string, vector<long>> positions;
+    uint64_t count = reader.Scan([&](const JournalRecord& record) {
+        if (record.type == JOURNAL_TRADE) {
+            tradeBookingService->MarkBooked(TradeId(record.tradeId));
+        }
+        else if (record.type == JOURNAL_POSITION_DELTA) {
+            string productId(record.productId, strnlen(record.productId, sizeof(record.productId)));
+            BookId book = books.Intern(string(record.book, strnlen(record.book, sizeof(record.book))));
+            vector<long>& quantities = positions[productId];
+            if (quantities.size() <= book) {
+                quantities.resize(book + 1, 0);
+            }
+            quantities[book] += record.quantity;
+        }
+    });
+    for (const auto& entry : positions) {
+        const Bond& bond = BondProductService::GetInstance()->GetData(entry.first);
+        for (BookId book = 0; book < entry.second.size(); ++book) {
+            positionService->SetPosition(bond, book, entry.second[book]);
+        }
+    }
+    return count;
+}
+
+#endif //JOURNAL_HPP
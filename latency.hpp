@@ -0,0 +1,307 @@
+/**
+ * latency.hpp
+ *
+ * This file defines the optional per-stage latency instrumentation of the bond trading system. Key components include:
+ * - 'LatencyClock': A cheap timestamp (the TSC on x86, the steady clock elsewhere) and its calibration to nanoseconds.
+ * - 'LatencyHistogram': An HDR-style histogram with 32 linear sub-buckets per power of two, so any recorded value is reported
+ *   to within about 3% with a fixed 15KB of counters and an O(1) record.
+ * - 'LatencyStage': The stages an event passes through: parse (ingress to the parsed value), service (OnMessage, including
+ *   everything downstream of it), listener (each listener callback), persist (each output write), booked (ingress to a booked
+ *   trade) and end to end (ingress to each output write).
+ * - 'LatencyRecorder': Histograms per input source and stage, the per-thread context of the event being processed, and the
+ *   percentile report (p50/p99/p99.9/max) written on shutdown or when the process is sent a signal.
+ *
+ * Instrumentation is compiled in only when BTS_LATENCY is defined (the BTS_LATENCY_HISTOGRAMS CMake option). Otherwise the
+ * LATENCY_* macros expand to nothing and cost nothing. Each source is recorded by the thread reading it, so histograms are not
+ * locked; stages that run on other threads are not attributed to a source.
+ */
+
+#ifndef LATENCY_HPP
+#define LATENCY_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using namespace std;
+
+class LatencyClock {
+
+public:
+
+    // Get the current time in ticks
+    static uint64_t Now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return uint64_t(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    // Get the number of ticks per nanosecond, measured against the steady clock since the first call
+    static double TicksPerNano();
+
+};
+
+class LatencyHistogram {
+
+public:
+
+    static const int SUB_BUCKET_BITS = 5;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int BUCKETS = (64 - SUB_BUCKET_BITS) * SUB_BUCKETS + SUB_BUCKETS;
+
+    LatencyHistogram() { Reset(); }
+
+    void Record(uint64_t value) {
+        counts[BucketOf(value)]++;
+        count++;
+        sum += double(value);
+        maximum = value > maximum ? value : maximum;
+    }
+
+    void Reset();
+
+    uint64_t GetCount() const { return count; }
+    uint64_t GetMax() const { return maximum; }
+    double GetMean() const { return count > 0 ? sum / count : 0.0; }
+
+    // Get an upper bound on the given percentile (0-100) of recorded values
+    uint64_t GetPercentile(double percentile) const;
+
+private:
+    uint64_t counts[BUCKETS];
+    uint64_t count;
+    double sum;
+    uint64_t maximum;
+
+    // Values below 2 * SUB_BUCKETS get a bucket each; above that each power of two is split into SUB_BUCKETS buckets.
+    static int BucketOf(uint64_t value) {
+        if (value < uint64_t(2 * SUB_BUCKETS)) {
+            return int(value);
+        }
+        int exponent = 63 - __builtin_clzll(value);
+        return (exponent - SUB_BUCKET_BITS) * SUB_BUCKETS + int(value >> (exponent - SUB_BUCKET_BITS));
+    }
+
+    static uint64_t UpperBoundOf(int bucket);
+
+};
+
+enum LatencyStage { PARSE_STAGE, SERVICE_STAGE, LISTENER_STAGE, PERSIST_STAGE, BOOKED_STAGE, END_TO_END_STAGE, LATENCY_STAGES };
+
+// The histograms of one input source
+struct LatencySource {
+    string name;
+    LatencyHistogram stages[LATENCY_STAGES];
+};
+
+class LatencyRecorder {
+
+public:
+
+    static LatencyRecorder& GetInstance();
+
+    // Get the histograms of an input source, registering it on first use
+    LatencySource* Register(const string& name);
+
+    // Make a source current for this thread; events that follow are recorded against it
+    static void BeginSource(LatencySource* source);
+
+    // Stamp the ingress of the next event on this thread
+    static void BeginEvent();
+
+    // Record a duration in ticks against the current source
+    static void Record(LatencyStage stage, uint64_t ticks);
+
+    // Record the time since the current event's ingress
+    static void RecordSinceIngress(LatencyStage stage);
+
+    // Write the percentiles of every non-empty histogram
+    void Report(ostream& output) const;
+
+    // Write a report to standard error whenever the process receives the signal (e.g. SIGUSR1)
+    static void ReportOnSignal(int signalNumber);
+
+private:
+    LatencyRecorder() {}
+
+    // A deque keeps sources at stable addresses as more are registered.
+    deque<LatencySource> sources;
+    mutable mutex lock;
+
+    struct ThreadContext {
+        LatencySource* source;
+        uint64_t ingress;
+    };
+    static ThreadContext& Context();
+
+    static atomic<bool>& ReportRequested();
+
+};
+
+/**
+ * Records the time spent in a scope against the current source.
+ */
+class LatencyScope {
+
+public:
+
+    explicit LatencyScope(LatencyStage _stage) : stage(_stage), start(LatencyClock::Now()) {}
+    ~LatencyScope() { LatencyRecorder::Record(stage, LatencyClock::Now() - start); }
+
+private:
+    LatencyStage stage;
+    uint64_t start;
+
+};
+
+#ifdef BTS_LATENCY
+#define LATENCY_CONCAT_(a, b) a##b
+#define LATENCY_CONCAT(a, b) LATENCY_CONCAT_(a, b)
+#define LATENCY_BEGIN_SOURCE(name) LatencyRecorder::BeginSource(LatencyRecorder::GetInstance().Register(name))
+#define LATENCY_BEGIN_EVENT() LatencyRecorder::BeginEvent()
+#define LATENCY_SCOPE(stage) LatencyScope LATENCY_CONCAT(latencyScope, __LINE__)(stage)
+#define LATENCY_MARK(stage) LatencyRecorder::RecordSinceIngress(stage)
+#define LATENCY_REPORT(output) LatencyRecorder::GetInstance().Report(output)
+#define LATENCY_REPORT_ON_SIGNAL(signalNumber) LatencyRecorder::ReportOnSignal(signalNumber)
+#else
+#define LATENCY_BEGIN_SOURCE(name) ((void)0)
+#define LATENCY_BEGIN_EVENT() ((void)0)
+#define LATENCY_SCOPE(stage) ((void)0)
+#define LATENCY_MARK(stage) ((void)0)
+#define LATENCY_REPORT(output) ((void)0)
+#define LATENCY_REPORT_ON_SIGNAL(signalNumber) ((void)0)
+#endif
+
+double LatencyClock::TicksPerNano() {
+    static const uint64_t startTicks = Now();
+    static const chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+    double nanos = double(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - startTime).count());
+    double ticks = double(Now() - startTicks);
+    // Too short an interval to calibrate against; report raw ticks.
+    return nanos > 1e6 ? ticks / nanos : 1.0;
+}
+
+void LatencyHistogram::Reset() {
+    fill(counts, counts + BUCKETS, 0);
+    count = 0;
+    sum = 0.0;
+    maximum = 0;
+}
+
+uint64_t LatencyHistogram::GetPercentile(double percentile) const {
+    uint64_t rank = uint64_t(percentile / 100.0 * count);
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < BUCKETS; ++bucket) {
+        seen += counts[bucket];
+        if (seen > rank) {
+            return min(UpperBoundOf(bucket), maximum);
+        }
+    }
+    return maximum;
+}
+
+uint64_t LatencyHistogram::UpperBoundOf(int bucket) {
+    if (bucket < 2 * SUB_BUCKETS) {
+        return uint64_t(bucket);
+    }
+    int exponent = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    uint64_t subBucket = uint64_t(bucket % SUB_BUCKETS + SUB_BUCKETS);
+    return ((subBucket + 1) << (exponent - SUB_BUCKET_BITS)) - 1;
+}
+
+LatencyRecorder& LatencyRecorder::GetInstance() {
+    static LatencyRecorder* instance = new LatencyRecorder();
+    return *instance;
+}
+
+LatencySource* LatencyRecorder::Register(const string& name) {
+    lock_guard<mutex> guard(lock);
+    for (auto& source : sources) {
+        if (source.name == name) {
+            return &source;
+        }
+    }
+    sources.emplace_back();
+    sources.back().name = name;
+    return &sources.back();
+}
+
+void LatencyRecorder::BeginSource(LatencySource* source) {
+    LatencyClock::TicksPerNano();
+    Context().source = source;
+}
+
+void LatencyRecorder::BeginEvent() {
+    Context().ingress = LatencyClock::Now();
+    if (ReportRequested().load(memory_order_relaxed)) {
+        ReportRequested().store(false);
+        GetInstance().Report(std::cerr);
+    }
+}
+
+void LatencyRecorder::Record(LatencyStage stage, uint64_t ticks) {
+    LatencySource* source = Context().source;
+    if (source) {
+        source->stages[stage].Record(ticks);
+    }
+}
+
+void LatencyRecorder::RecordSinceIngress(LatencyStage stage) {
+    ThreadContext& context = Context();
+    if (context.source) {
+        context.source->stages[stage].Record(LatencyClock::Now() - context.ingress);
+    }
+}
+
+void LatencyRecorder::Report(ostream& output) const {
+    static const char* STAGE_NAMES[LATENCY_STAGES] = { "parse", "service", "listener", "persist", "booked", "end to end" };
+    double ticksPerNano = LatencyClock::TicksPerNano();
+    lock_guard<mutex> guard(lock);
+    output << left << setw(32) << "Latency (ns)" << right << setw(12) << "count" << setw(12) << "p50" << setw(12) << "p99"
+        << setw(12) << "p99.9" << setw(12) << "max" << endl;
+    for (const auto& source : sources) {
+        for (int stage = 0; stage < LATENCY_STAGES; ++stage) {
+            const LatencyHistogram& histogram = source.stages[stage];
+            if (histogram.GetCount() == 0) {
+                continue;
+            }
+            output << left << setw(32) << (source.name + " " + STAGE_NAMES[stage]) << right << setw(12) << histogram.GetCount()
+                << fixed << setprecision(0)
+                << setw(12) << histogram.GetPercentile(50) / ticksPerNano
+                << setw(12) << histogram.GetPercentile(99) / ticksPerNano
+                << setw(12) << histogram.GetPercentile(99.9) / ticksPerNano
+                << setw(12) << histogram.GetMax() / ticksPerNano << endl;
+            output.unsetf(ios_base::floatfield);
+        }
+    }
+}
+
+void LatencyRecorder::ReportOnSignal(int signalNumber) {
+    // The handler only raises a flag; the report is written by the next event, outside the handler.
+    ReportRequested();
+    signal(signalNumber, [](int) { ReportRequested().store(true); });
+}
+
+LatencyRecorder::ThreadContext& LatencyRecorder::Context() {
+    static thread_local ThreadContext context = { nullptr, 0 };
+    return context;
+}
+
+atomic<bool>& LatencyRecorder::ReportRequested() {
+    static atomic<bool> requested(false);
+    return requested;
+}
+
+#endif //LATENCY_HPP
@@ -1,129 +1,195 @@
 /**
  * main.cpp
- * This file is the main entry point for a bond trading system simulation, orchestrating various components and workflows. It includes:
- * - setupProducts: Initializes a range of bond products and adds them to the BondProductService.
- * - runTradesAndExecutionFlow: Sets up trade booking, position management, risk assessment services, and their historical data services.
- *   It integrates external trade and market data through file connectors.
- * - runInquiryFlow: Establishes the bond inquiry service and its listener, linking to an external inquiries data source.
- * - runStreamingFlow: Implements services for bond pricing, GUI updates, algorithmic streaming, streaming services,
- *   and a historical data service for price streams. It also connects to an external bond prices file for data input.
+ * This file is the main entry point for a bond trading system simulation, orchestrating various components and workflows. It sets up
+ * the products and risk sectors, then runs the streaming, inquiry and trades flows defined in tradingflows.hpp in turn, and finishes
+ * with the end-of-day key-rate risk refresh and scenario run.
+ *
+ * Options:
+ *   --columnar-history   write positions, risk, streams and executions as binary column files under 'history/' instead of CSV;
+ *                        the columnar_to_csv tool converts them back.
+ *   --replay-speed=X     pace input files at X times their recorded 'Timestamp' column (or synthetic rate); 'max' for unpaced.
+ *   --replay-rate=N      pace input files without timestamps at N events per second (at 1x).
+ *   --binary-input       read prices.bin and marketdata.bin (written by the csv_to_binary tool) instead of the CSV files.
+ *   --metrics=TARGET     append a JSON snapshot of the service metrics to file TARGET every interval, or send it to the Unix
+ *                        domain socket at PATH if TARGET is 'unix:PATH'.
+ *   --metrics-interval-ms=N  time between metric snapshots (default 1000).
+ *   --trace=FILE         record parse, OnMessage, listener and Publish spans and write them to FILE as Chrome trace JSON at exit
+ *                        (needs a build with BTS_TRACE_EVENTS).
+ *   --trace-sample=N     trace one in N input events (default 1, every event).
+ *   --restore=FILE       restore the services from snapshot FILE and read each input only after its watermark.
+ *   --checkpoint=FILE    write a snapshot of the services and input watermarks to FILE at the end of the run.
+ *   --checkpoint-every=N also write the snapshot every N input events.
+ *   --journal=FILE       recover positions from the write-ahead journal FILE, then append every booked trade and position
+ *                        change to it before the trade reaches positions.
+ *   --journal-batch=N    commit (write and fdatasync) the journal once N records are waiting (default 64; 1 syncs every record).
+ *   --journal-latency-us=N  commit once the oldest waiting record has waited N microseconds (default 1000).
+ *   --journal-sync       hold each booked trade until its journal records are durable, so no published position can be lost.
+ *   --securities=FILE    load the product universe from FILE (default 'securities.csv'); without it, the six on-the-run
+ *                        Treasuries are set up.
+ *   --parse-threads=N    decode each CSV input file in chunks on N worker threads, delivering in file order (default 0, off).
+ *   --parse-chunk-kb=N   size of the chunks a parallel parse splits files into (default 256).
+ *   --prices=SOURCE, --marketdata=SOURCE, --trades=SOURCE, --inquiries=SOURCE
+ *                        read that CSV input from SOURCE instead of the file in the current directory: another file, '-' for
+ *                        standard input, 'fifo:PATH' for a named pipe, 'unix:PATH' to connect to a Unix domain socket, or
+ *                        'tail:PATH' to follow a file as it grows. The feed_simulator tool writes to all of them.
+ *   --stream-idle-ms=N   end a stream input once it has received nothing for N milliseconds (default 0: wait until the
+ *                        writer closes it; a tailed file only ends this way).
+ *   --history-cache=N    keep the last N persisted points per key in memory in each historical service, rolled up into bars
+ *                        that are written to bars_streaming.csv, bars_positions.csv, bars_risk.csv and bars_execution.csv.
+ *   --history-bar-ms=N   length of those bars (default 1000).
+ * When replaying, each input file reports its achieved rate and pacing error.
+ *
+ * When built with BTS_LATENCY_HISTOGRAMS, per-stage latency percentiles of each input file are printed at the end of the run,
+ * and written to standard error whenever the process is sent SIGUSR1.
  *
  * Each workflow demonstrates a specific aspect of bond trading operations, including market data processing, trade execution,
  * risk management, client inquiries handling, and updating the user interface.
  */
 
-#include "BondPricingService.hpp"
-#include "GUIService.hpp"
-#include "BondAlgoStreamingService.hpp"
-#include "BondStreamingService.hpp"
-#include "BondPriceStreamsHistoricalDataService.hpp"
-#include "BondInquiryService.hpp"
-#include "BondTradeBookingService.hpp"
-#include "BondPositionService.hpp"
-#include "BondPositionHistoricalDataService.hpp"
-#include "BondRiskHistoricalDataService.hpp"
-#include "BondRiskService.hpp"
-#include "BondMarketDataService.hpp"
-#include "BondAlgoExecutionService.hpp"
-#include "BondExecutionService.hpp"
-#include "BondExecutionHistoricalDataService.hpp"
-
-void setupProducts();
-void runStreamingFlow();
-void runInquiryFlow();
-void runTradesAndExecutionFlow();
-
-int main() {
-    setupProducts();
-    runStreamingFlow();
-    runInquiryFlow();
-    runTradesAndExecutionFlow();
-}
-
-void setupProducts() {
-    auto productService = BondProductService::GetInstance();
-
-    Bond T2("9128283H1", CUSIP, "T", 1.750, date(2019, Nov, 30), 0.019851);
-    Bond T3("9128283L2", CUSIP, "T", 1.875, date(2020, Dec, 15), 0.029309);
-    Bond T5("912828M80", CUSIP, "T", 2.0, date(2022, Nov, 30), 0.048643);
-    Bond T7("9128283J7", CUSIP, "T", 2.125, date(2024, Nov, 30), 0.065843);
-    Bond T10("9128283F5", CUSIP, "T", 2.25, date(2027, Dec, 15), 0.087939);
-    Bond T30("912810RZ3", CUSIP, "T", 2.75, date(2047, Dec, 15), 0.184698);
-
-    productService->Add(T2);
-    productService->Add(T3);
-    productService->Add(T5);
-    productService->Add(T7);
-    productService->Add(T10);
-    productService->Add(T30);
+#include "tradingflows.hpp"
+
+bool parseOptions(int argc, char* argv[], RunOptions& options);
+
+int main(int argc, char* argv[]) {
+    RunOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        return 1;
+    }
+    LATENCY_REPORT_ON_SIGNAL(SIGUSR1);
+    if (!options.traceFile.empty()) {
+#ifdef BTS_TRACING
+        TRACE_START(options.traceFile, options.traceSampleEvery);
+#else
+        std::cerr << "Ignoring --trace: built without BTS_TRACE_EVENTS" << std::endl;
+#endif
+    }
+    MetricsExporter* metricsExporter = nullptr;
+    if (!options.metricsTarget.empty()) {
+        metricsExporter = new MetricsExporter(options.metricsTarget, options.metricsIntervalMillis);
+        metricsExporter->Start();
+    }
+
+    if (!options.restoreFile.empty()) {
+        Checkpointer::GetInstance().Load(options.restoreFile);
+    }
+    if (!options.checkpointFile.empty()) {
+        Checkpointer::GetInstance().Enable(options.checkpointFile, options.checkpointEvery);
+    }
+
+    setupProducts(options.securitiesFile);
+    auto riskService = new BondRiskService(VALUATION_DATE);
+    setupSectors(riskService);
+    Checkpointer::GetInstance().Attach(riskService);
+    auto scenarioService = new BondScenarioService(riskService->GetAnalytics(),
+        BondScenarioService::StandardScenarios(),
+        new ThreadPool());
+    Checkpointer::GetInstance().Attach(scenarioService);
+    runStreamingFlow(riskService, scenarioService, options);
+    runInquiryFlow(options);
+    runTradesAndExecutionFlow(riskService, scenarioService, options);
+
+    std::cout << "Refreshing key-rate risk" << std::endl;
+    riskService->RefreshKeyRateRisk();
+
+    std::cout << "Running end-of-day scenarios" << std::endl;
+    scenarioService->Run();
+    scenarioService->PublishResults();
+
+    if (!options.checkpointFile.empty()) {
+        std::cout << "Writing snapshot " << options.checkpointFile << std::endl;
+        Checkpointer::GetInstance().Save();
+    }
+    if (metricsExporter) {
+        metricsExporter->Stop();
+    }
+    LATENCY_REPORT(std::cout);
 }
 
-void runTradesAndExecutionFlow() {
-    auto tradeBookingService = new BondTradeBookingService();
-    auto positionService = new BondPositionService();
-    auto riskService = new BondRiskService();
-    auto positionHistoricalDataService = new BondPositionHistoricalDataService();
-    auto riskHistoricalDataService = new BondRiskHistoricalDataService();
-
-    auto tradeListener = new BondTradesServiceListener(positionService);
-    auto positionListener = new BondPositionServiceListener(positionHistoricalDataService);
-    auto positionListenerFromRisk = new BondPositionRiskServiceListener(riskService);
-    auto riskListener = new BondRiskServiceListener(riskHistoricalDataService);
-
-    tradeBookingService->AddListener(tradeListener);
-    positionService->AddListener(positionListener);
-    positionService->AddListener(positionListenerFromRisk);
-    riskService->AddListener(riskListener);
-
-    auto marketDataService = new BondMarketDataService();
-    auto algoExecutionService = new BondAlgoExecutionService();
-    auto executionService = new BondExecutionService();
-    auto executionHistoricalDataService = new BondExecutionHistoricalDataService();
-
-    auto marketDataListener = new BondMarketDataServiceListener(algoExecutionService);
-    auto algoExecutionListener = new BondAlgoExecutionServiceListener(executionService);
-    auto executionListener = new BondExecutionOrderServiceListener(executionHistoricalDataService);
-    auto executionListenerFromTrade = new BondExecutionServiceListener(tradeBookingService);
-
-    marketDataService->AddListener(marketDataListener);
-    algoExecutionService->AddListener(algoExecutionListener);
-    executionService->AddListener(executionListener);
-    executionService->AddListener(executionListenerFromTrade);
-
-    std::cout << "Processing trades.csv" << std::endl;
-    tradeBookingService->Subscribe(new BondTradesConnector("trades.csv", tradeBookingService));
-
-    std::cout << "Processing marketdata.csv" << std::endl;
-    marketDataService->Subscribe(new BondMarketDataConnector("marketdata.csv", marketDataService));
-}
-
-void runInquiryFlow() {
-    auto inquiryService = new BondInquiryService();
-    auto inquiryServiceListener = new BondInquiryServiceListener(inquiryService);
-    inquiryService->AddListener(inquiryServiceListener);
-
-    std::cout << "Processing inquiries.csv" << std::endl;
-    inquiryService->Subscribe(new BondInquirySubscriber("inquiries.csv", inquiryService));
-}
-
-void runStreamingFlow() {
-    auto pricingService = new BondPricingService();
-    auto guiService = new GUIService(300);
-    auto algoStreamingService = new BondAlgoStreamingService();
-    auto streamingService = new BondStreamingService();
-    auto historicalDataService = new BondPriceStreamsHistoricalDataService();
-
-    auto guiServiceListener = new BondPriceServiceListener(guiService);
-    auto algoStreamingServiceListener = new BondPricesServiceListener(algoStreamingService);
-    auto streamingServiceListener = new BondAlgoStreamServiceListener(streamingService);
-    auto historicalDataServiceListener = new BondPriceStreamsServiceListener(historicalDataService);
-
-    pricingService->AddListener(guiServiceListener);
-    pricingService->AddListener(algoStreamingServiceListener);
-    algoStreamingService->AddListener(streamingServiceListener);
-    streamingService->AddListener(historicalDataServiceListener);
-
-    std::cout << "Processing prices.csv" << std::endl;
-    pricingService->Subscribe(
-        new BondPricesConnector("prices.csv", pricingService));
+bool parseOptions(int argc, char* argv[], RunOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        string option = argv[i];
+        if (option == "--columnar-history") {
+            options.storage = COLUMNAR_STORAGE;
+        }
+        else if (option.compare(0, 15, "--replay-speed=") == 0) {
+            string speed = option.substr(15);
+            options.replay.enabled = true;
+            options.replay.speed = speed == "max" ? 0.0 : stod(speed);
+        }
+        else if (option.compare(0, 14, "--replay-rate=") == 0) {
+            options.replay.enabled = true;
+            options.replay.syntheticRate = stod(option.substr(14));
+        }
+        else if (option == "--binary-input") {
+            options.binaryInput = true;
+        }
+        else if (option.compare(0, 10, "--metrics=") == 0) {
+            options.metricsTarget = option.substr(10);
+        }
+        else if (option.compare(0, 22, "--metrics-interval-ms=") == 0) {
+            options.metricsIntervalMillis = stoul(option.substr(22));
+        }
+        else if (option.compare(0, 8, "--trace=") == 0) {
+            options.traceFile = option.substr(8);
+        }
+        else if (option.compare(0, 15, "--trace-sample=") == 0) {
+            options.traceSampleEvery = stoull(option.substr(15));
+        }
+        else if (option.compare(0, 10, "--restore=") == 0) {
+            options.restoreFile = option.substr(10);
+        }
+        else if (option.compare(0, 13, "--checkpoint=") == 0) {
+            options.checkpointFile = option.substr(13);
+        }
+        else if (option.compare(0, 19, "--checkpoint-every=") == 0) {
+            options.checkpointEvery = stoull(option.substr(19));
+        }
+        else if (option.compare(0, 13, "--securities=") == 0) {
+            options.securitiesFile = option.substr(13);
+        }
+        else if (option.compare(0, 10, "--journal=") == 0) {
+            options.journalFile = option.substr(10);
+        }
+        else if (option.compare(0, 16, "--journal-batch=") == 0) {
+            options.journal.commitBatch = stoul(option.substr(16));
+        }
+        else if (option.compare(0, 21, "--journal-latency-us=") == 0) {
+            options.journal.commitLatencyMicros = stoul(option.substr(21));
+        }
+        else if (option == "--journal-sync") {
+            options.journal.waitForCommit = true;
+        }
+        else if (option.compare(0, 9, "--prices=") == 0) {
+            options.pricesInput = option.substr(9);
+        }
+        else if (option.compare(0, 13, "--marketdata=") == 0) {
+            options.marketDataInput = option.substr(13);
+        }
+        else if (option.compare(0, 9, "--trades=") == 0) {
+            options.tradesInput = option.substr(9);
+        }
+        else if (option.compare(0, 12, "--inquiries=") == 0) {
+            options.inquiriesInput = option.substr(12);
+        }
+        else if (option.compare(0, 17, "--stream-idle-ms=") == 0) {
+            options.streamIdleMillis = stoul(option.substr(17));
+        }
+        else if (option.compare(0, 16, "--history-cache=") == 0) {
+            options.historyCachePoints = stoull(option.substr(16));
+        }
+        else if (option.compare(0, 17, "--history-bar-ms=") == 0) {
+            options.historyBarMicros = int64_t(stoull(option.substr(17))) * 1000;
+        }
+        else if (option.compare(0, 16, "--parse-threads=") == 0) {
+            options.parseThreads = stoul(option.substr(16));
+        }
+        else if (option.compare(0, 17, "--parse-chunk-kb=") == 0) {
+            options.parseChunkBytes = stoul(option.substr(17)) * 1024;
+        }
+        else {
+            std::cerr << "Unknown option " << option << std::endl;
+            return false;
+        }
+    }
+    return true;
 }
@@ -0,0 +1,307 @@
+/**
+ * metrics.hpp
+ *
+ * This file defines the runtime metrics of the bond trading system. Key components include:
+ * - 'MetricCounter': A monotonically increasing count (messages received, adds, updates, orders fired). Each thread increments
+ *   its own padded slot, so counting never contends on a cache line; reads sum the slots.
+ * - 'MetricGauge': A value that goes up and down (e.g. tasks queued on the thread pools), on its own padded cache line.
+ * - 'MetricsRegistry': Owns every counter and gauge by name. Services look their metrics up once, when constructed, and keep
+ *   the pointers; metrics live for the whole process.
+ * - 'MetricsExporter': A background thread that writes a snapshot of every metric at a fixed interval, as one JSON line, to a
+ *   file or to a Unix domain socket ('unix:/path'), plus a final snapshot when it is stopped.
+ *
+ * Metric names are '<service>.<metric>', e.g. 'pricing.updates' or 'gui.throttled'. Counters are cumulative, so rates are the
+ * difference between consecutive snapshots over the interval between their timestamps.
+ */
+
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Metric values are kept this far apart, which keeps them off each other's cache lines (and adjacent-line prefetches)
+// without relying on over-aligned allocation.
+const size_t METRIC_STRIDE = 128;
+
+class MetricCounter {
+
+public:
+
+    // Threads are spread over this many slots; threads that share a slot still count correctly, they only share a line.
+    static const size_t SLOTS = 16;
+
+    explicit MetricCounter(const string& _name) : name(_name) {
+        for (auto& slot : slots) {
+            slot.value.store(0, memory_order_relaxed);
+        }
+    }
+
+    void Increment(uint64_t amount = 1) {
+        slots[ThreadSlot()].value.fetch_add(amount, memory_order_relaxed);
+    }
+
+    uint64_t GetValue() const;
+
+    const string& GetName() const { return name; }
+
+private:
+    struct Slot {
+        atomic<uint64_t> value;
+        char padding[METRIC_STRIDE - sizeof(atomic<uint64_t>)];
+    };
+
+    string name;
+    Slot slots[SLOTS];
+
+    static size_t ThreadSlot();
+
+};
+
+class MetricGauge {
+
+public:
+
+    explicit MetricGauge(const string& _name) : name(_name) {
+        value.store(0, memory_order_relaxed);
+    }
+
+    void Set(int64_t newValue) { value.store(newValue, memory_order_relaxed); }
+    void Add(int64_t delta) { value.fetch_add(delta, memory_order_relaxed); }
+    int64_t GetValue() const { return value.load(memory_order_relaxed); }
+
+    const string& GetName() const { return name; }
+
+private:
+    atomic<int64_t> value;
+    char padding[METRIC_STRIDE - sizeof(atomic<int64_t>)];
+    string name;
+
+};
+
+class MetricsRegistry {
+
+public:
+
+    static MetricsRegistry& GetInstance();
+
+    // Get the counter with the given name, registering it on first use
+    MetricCounter* GetCounter(const string& name);
+
+    // Get the gauge with the given name, registering it on first use
+    MetricGauge* GetGauge(const string& name);
+
+    // Write every metric as one JSON line: {"timestamp_us": ..., "<name>": <value>, ...}
+    void Snapshot(ostream& output) const;
+
+private:
+    MetricsRegistry() {}
+
+    // Deques keep metrics at stable addresses as more are registered.
+    deque<MetricCounter> counters;
+    deque<MetricGauge> gauges;
+    mutable mutex lock;
+
+};
+
+class MetricsExporter {
+
+public:
+
+    /**
+     * @param target a file to append snapshots to, or 'unix:' followed by the path of a listening Unix domain socket
+     * @param intervalMillis time between snapshots
+     */
+    MetricsExporter(const string& target, unsigned int intervalMillis);
+
+    // Stops the exporter if it is still running
+    ~MetricsExporter();
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    // Start writing snapshots in the background
+    void Start();
+
+    // Write a final snapshot and stop the background thread
+    void Stop();
+
+private:
+    string target;
+    unsigned int intervalMillis;
+    ofstream file;
+    int socketDescriptor;
+    thread worker;
+    mutex lock;
+    condition_variable wake;
+    bool stopping;
+
+    void Run();
+    void Export();
+    bool Connect();
+};
+
+uint64_t MetricCounter::GetValue() const {
+    uint64_t total = 0;
+    for (const auto& slot : slots) {
+        total += slot.value.load(memory_order_relaxed);
+    }
+    return total;
+}
+
+size_t MetricCounter::ThreadSlot() {
+    static atomic<size_t> nextSlot(0);
+    static thread_local size_t slot = nextSlot.fetch_add(1, memory_order_relaxed) % SLOTS;
+    return slot;
+}
+
+MetricsRegistry& MetricsRegistry::GetInstance() {
+    static MetricsRegistry* instance = new MetricsRegistry();
+    return *instance;
+}
+
+MetricCounter* MetricsRegistry::GetCounter(const string& name) {
+    lock_guard<mutex> guard(lock);
+    for (auto& counter : counters) {
+        if (counter.GetName() == name) {
+            return &counter;
+        }
+    }
+    counters.emplace_back(name);
+    return &counters.back();
+}
+
+MetricGauge* MetricsRegistry::GetGauge(const string& name) {
+    lock_guard<mutex> guard(lock);
+    for (auto& gauge : gauges) {
+        if (gauge.GetName() == name) {
+            return &gauge;
+        }
+    }
+    gauges.emplace_back(name);
+    return &gauges.back();
+}
+
+void MetricsRegistry::Snapshot(ostream& output) const {
+    auto now = chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+    lock_guard<mutex> guard(lock);
+    output << "{\"timestamp_us\": " << now;
+    for (const auto& counter : counters) {
+        output << ", \"" << counter.GetName() << "\": " << counter.GetValue();
+    }
+    for (const auto& gauge : gauges) {
+        output << ", \"" << gauge.GetName() << "\": " << gauge.GetValue();
+    }
+    output << "}\n";
+}
+
+MetricsExporter::MetricsExporter(const string& _target, unsigned int _intervalMillis)
+    : target(_target), intervalMillis(_intervalMillis), socketDescriptor(-1), stopping(false) {
+    if (target.compare(0, 5, "unix:") != 0) {
+        file.open(target, ios_base::app);
+        if (!file) {
+            cerr << "Unable to open file " << target;
+            exit(1);
+        }
+    }
+}
+
+MetricsExporter::~MetricsExporter() {
+    Stop();
+    if (socketDescriptor >= 0) {
+        close(socketDescriptor);
+    }
+}
+
+void MetricsExporter::Start() {
+    worker = thread(&MetricsExporter::Run, this);
+}
+
+void MetricsExporter::Stop() {
+    if (!worker.joinable()) {
+        return;
+    }
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    worker.join();
+}
+
+/**
+ * The lock only guards the stop flag. Snapshots are written with it released, so Stop never waits behind a slow target.
+ */
+void MetricsExporter::Run() {
+    unique_lock<mutex> guard(lock);
+    while (!wake.wait_for(guard, chrono::milliseconds(intervalMillis), [this]() { return stopping; })) {
+        guard.unlock();
+        Export();
+        guard.lock();
+    }
+    guard.unlock();
+    Export();
+}
+
+void MetricsExporter::Export() {
+    ostringstream snapshot;
+    MetricsRegistry::GetInstance().Snapshot(snapshot);
+    string line = snapshot.str();
+    if (file.is_open()) {
+        file << line << flush;
+        return;
+    }
+    // Nobody listening is not an error; the snapshot is dropped and the connection retried next interval.
+    if (socketDescriptor < 0 && !Connect()) {
+        return;
+    }
+    // A listener that stops reading must not stall the process: a full socket buffer drops this snapshot and keeps the
+    // connection, while a partial write would split a line, so that connection is dropped instead.
+    ssize_t sent = send(socketDescriptor, line.data(), line.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return;
+    }
+    if (sent != ssize_t(line.size())) {
+        close(socketDescriptor);
+        socketDescriptor = -1;
+    }
+}
+
+bool MetricsExporter::Connect() {
+    string path = target.substr(5);
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    socketDescriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socketDescriptor < 0) {
+        return false;
+    }
+    if (connect(socketDescriptor, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        close(socketDescriptor);
+        socketDescriptor = -1;
+        return false;
+    }
+    return true;
+}
+
+#endif //METRICS_HPP
@@ -0,0 +1,217 @@
+/**
+ * objectpool.hpp
+ *
+ * This file defines pooled, reference-counted storage for events that are passed between services in the bond trading system. Key components include:
+ * - 'ObjectPool': A per-type slab allocator. Objects live in fixed-size chunks of contiguous slots, so their addresses never change
+ *   once acquired, and released slots are recycled through a free list instead of going back to the heap.
+ * - 'Pooled': A reference-counted handle to an object in an ObjectPool. Copying a handle only bumps a counter, so queues and
+ *   asynchronous stages can hold on to an event without a deep copy. The object is returned to its pool when the last handle goes away.
+ */
+
+#ifndef OBJECT_POOL_HPP
+#define OBJECT_POOL_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Slab allocator for objects of type T.
+ * Slots are handed out from chunks of CHUNK_SIZE contiguous slots and are never moved.
+ */
+template<typename T>
+class ObjectPool {
+
+public:
+
+    static const size_t CHUNK_SIZE = 256;
+
+    /**
+     * A slot holds the object, its reference count and the free list link.
+     */
+    struct Slot {
+        typename aligned_storage<sizeof(T), alignof(T)>::type storage;
+        atomic<unsigned int> references;
+        Slot* nextFree;
+
+        T* Get() {
+            return reinterpret_cast<T*>(&storage);
+        }
+    };
+
+    // Get the pool shared by all handles of type T
+    static ObjectPool<T>& GetInstance();
+
+    // Construct an object in a free slot. The slot starts with a reference count of one.
+    template<typename... Args>
+    Slot* Acquire(Args&&... args);
+
+    // Destroy the object in a slot and return the slot to the free list
+    void Release(Slot* slot);
+
+    // Get the number of slots currently holding an object
+    size_t GetLiveCount() const;
+
+    // Get the number of slots allocated across all chunks
+    size_t GetCapacity() const;
+
+private:
+    ObjectPool() : freeList(nullptr), liveCount(0) {}
+
+    void AddChunk();
+
+    vector<unique_ptr<Slot[]>> chunks;
+    Slot* freeList;
+    size_t liveCount;
+    mutable mutex lock;
+
+};
+
+/**
+ * Reference-counted handle to an object in an ObjectPool.
+ * The referenced object is immutable through the handle and keeps a stable address for its whole lifetime.
+ */
+template<typename T>
+class Pooled {
+
+public:
+
+    // ctor for an empty handle
+    Pooled() : slot(nullptr) {}
+
+    // Construct a new pooled object in place
+    template<typename... Args>
+    static Pooled<T> Make(Args&&... args);
+
+    Pooled(const Pooled<T>& other);
+    Pooled(Pooled<T>&& other);
+    Pooled<T>& operator=(Pooled<T> other);
+    ~Pooled();
+
+    // Get the pooled object
+    const T& Get() const;
+
+    const T& operator*() const { return Get(); }
+    const T* operator->() const { return &Get(); }
+
+    // Does this handle refer to an object?
+    bool IsEmpty() const { return slot == nullptr; }
+
+private:
+    explicit Pooled(typename ObjectPool<T>::Slot* _slot) : slot(_slot) {}
+
+    typename ObjectPool<T>::Slot* slot;
+
+};
+
+template<typename T>
+ObjectPool<T>& ObjectPool<T>::GetInstance() {
+    static ObjectPool<T>* instance = new ObjectPool<T>();
+    return *instance;
+}
+
+template<typename T>
+template<typename... Args>
+typename ObjectPool<T>::Slot* ObjectPool<T>::Acquire(Args&&... args) {
+    Slot* slot;
+    {
+        lock_guard<mutex> guard(lock);
+        if (!freeList) {
+            AddChunk();
+        }
+        slot = freeList;
+        freeList = slot->nextFree;
+        liveCount++;
+    }
+    try {
+        new (&slot->storage) T(forward<Args>(args)...);
+    }
+    catch (...) {
+        lock_guard<mutex> guard(lock);
+        slot->nextFree = freeList;
+        freeList = slot;
+        liveCount--;
+        throw;
+    }
+    slot->references.store(1, memory_order_relaxed);
+    return slot;
+}
+
+template<typename T>
+void ObjectPool<T>::Release(Slot* slot) {
+    slot->Get()->~T();
+    lock_guard<mutex> guard(lock);
+    slot->nextFree = freeList;
+    freeList = slot;
+    liveCount--;
+}
+
+template<typename T>
+size_t ObjectPool<T>::GetLiveCount() const {
+    lock_guard<mutex> guard(lock);
+    return liveCount;
+}
+
+template<typename T>
+size_t ObjectPool<T>::GetCapacity() const {
+    lock_guard<mutex> guard(lock);
+    return chunks.size() * CHUNK_SIZE;
+}
+
+/**
+ * Allocate a new chunk and thread its slots onto the free list in address order,
+ * so consecutive acquisitions touch consecutive cache lines.
+ */
+template<typename T>
+void ObjectPool<T>::AddChunk() {
+    unique_ptr<Slot[]> chunk(new Slot[CHUNK_SIZE]);
+    for (size_t i = CHUNK_SIZE; i > 0; --i) {
+        chunk[i - 1].nextFree = freeList;
+        freeList = &chunk[i - 1];
+    }
+    chunks.push_back(move(chunk));
+}
+
+template<typename T>
+template<typename... Args>
+Pooled<T> Pooled<T>::Make(Args&&... args) {
+    return Pooled<T>(ObjectPool<T>::GetInstance().Acquire(forward<Args>(args)...));
+}
+
+template<typename T>
+Pooled<T>::Pooled(const Pooled<T>& other) : slot(other.slot) {
+    if (slot) {
+        slot->references.fetch_add(1, memory_order_relaxed);
+    }
+}
+
+template<typename T>
+Pooled<T>::Pooled(Pooled<T>&& other) : slot(other.slot) {
+    other.slot = nullptr;
+}
+
+template<typename T>
+Pooled<T>& Pooled<T>::operator=(Pooled<T> other) {
+    swap(slot, other.slot);
+    return *this;
+}
+
+template<typename T>
+Pooled<T>::~Pooled() {
+    if (slot && slot->references.fetch_sub(1, memory_order_acq_rel) == 1) {
+        ObjectPool<T>::GetInstance().Release(slot);
+    }
+}
+
+template<typename T>
+const T& Pooled<T>::Get() const {
+    return *slot->Get();
+}
+
+#endif //OBJECT_POOL_HPP
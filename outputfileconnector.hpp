@@ -44,7 +44,10 @@ private:
 
 public:
     void Publish(V& data) override {
+        LATENCY_SCOPE(PERSIST_STAGE);
+        TRACE_SPAN("Publish", *this);
         appendLineToFile(toCSVString(data), false);
+        LATENCY_MARK(END_TO_END_STAGE);
     }
 
     void WriteHeader() {
@@ -8,14 +8,16 @@
 #define POSITION_SERVICE_HPP
 
 #include <string>
-#include <map>
+#include <vector>
 #include "soa.hpp"
 #include "tradebookingservice.hpp"
+#include "bookregistry.hpp"
 
 using namespace std;
 
 /**
  * Position class in a particular book.
+ * Quantities are held in a dense array indexed by BookId and the aggregate is maintained as trades are applied.
  * Type T is the product type.
  */
 template<typename T>
@@ -30,16 +32,59 @@ public:
     const T& GetProduct() const;
 
     // Get the position quantity
-    long GetPosition(string& book);
+    long GetPosition(const string& book) const;
+
+    // Get the position quantity for an interned book
+    long GetPosition(BookId book) const;
 
     // Get the aggregate position
-    long GetAggregatePosition();
+    long GetAggregatePosition() const;
+
+    // Get one more than the highest BookId this position has held a quantity in
+    BookId GetBookLimit() const;
 
     // Updates the position after a new trade.
     void UpdatePosition(const Trade<T>& trade);
+
+    // Set the quantity held in a book, e.g. when restoring a snapshot
+    void SetPosition(BookId book, long quantity);
 private:
     T product;
-    map<string, long> positions;
+    vector<long> positions;
+    long aggregatePosition;
+
+};
+
+/**
+ * The change in a position caused by a single trade.
+ * It refers to the product held by the stored position, so it is only valid for the duration of a listener callback.
+ * Type T is the product type.
+ */
+template<typename T>
+class PositionDelta {
+
+public:
+
+    // ctor for a position delta
+    PositionDelta(const T& _product, BookId _book, long _quantity, long _aggregatePosition);
+
+    // Get the product
+    const T& GetProduct() const;
+
+    // Get the book the trade was booked to
+    BookId GetBook() const;
+
+    // Get the signed change in quantity
+    long GetQuantity() const;
+
+    // Get the aggregate position after the change
+    long GetAggregatePosition() const;
+
+private:
+    const T& product;
+    BookId book;
+    long quantity;
+    long aggregatePosition;
 
 };
 
@@ -56,11 +101,24 @@ public:
     // Add a trade to the service
     virtual void AddTrade(const Trade<T>& trade) = 0;
 
+    // Add a listener that is notified of the change each trade makes to a position
+    void AddDeltaListener(ServiceListener<PositionDelta<T>>* listener) {
+        deltaListeners.push_back(listener);
+    }
+
+    // Get all delta listeners on the Service.
+    const vector<ServiceListener<PositionDelta<T>>*>& GetDeltaListeners() const {
+        return deltaListeners;
+    }
+
+private:
+    vector<ServiceListener<PositionDelta<T>>*> deltaListeners;
+
 };
 
 template<typename T>
 Position<T>::Position(const T& _product) :
-    product(_product) {
+    product(_product), aggregatePosition(0) {
 }
 
 template<typename T>
@@ -69,28 +127,72 @@ const T& Position<T>::GetProduct() const {
 }
 
 template<typename T>
-long Position<T>::GetPosition(string& book) {
-    return positions[book];
+long Position<T>::GetPosition(const string& book) const {
+    BookId id;
+    return BookRegistry::GetInstance().Find(book, id) ? GetPosition(id) : 0;
 }
 
 template<typename T>
-long Position<T>::GetAggregatePosition() {
-    long totalPosition = 0;
-    for (const auto& bookEntry : positions) {
-        totalPosition += bookEntry.second;
-    }
-    return totalPosition;
+BookId Position<T>::GetBookLimit() const {
+    return BookId(positions.size());
+}
+
+template<typename T>
+long Position<T>::GetPosition(BookId book) const {
+    return book < positions.size() ? positions[book] : 0;
+}
+
+template<typename T>
+long Position<T>::GetAggregatePosition() const {
+    return aggregatePosition;
 }
 
 template<typename T>
 void Position<T>::UpdatePosition(const Trade<T>& trade) {
     long quantity = (trade.GetSide() == BUY ? 1 : -1) * trade.GetQuantity();
-    if (positions.find(trade.GetBook()) == positions.end()) {
-        positions[trade.GetBook()] = quantity;
+    BookId book = trade.GetBookId();
+    if (book >= positions.size()) {
+        positions.resize(book + 1, 0);
     }
-    else {
-        positions[trade.GetBook()] += quantity;
+    positions[book] += quantity;
+    aggregatePosition += quantity;
+}
+
+template<typename T>
+void Position<T>::SetPosition(BookId book, long quantity) {
+    if (book >= positions.size()) {
+        positions.resize(book + 1, 0);
     }
+    aggregatePosition += quantity - positions[book];
+    positions[book] = quantity;
+}
+
+template<typename T>
+PositionDelta<T>::PositionDelta(const T& _product, BookId _book, long _quantity, long _aggregatePosition) :
+    product(_product) {
+    book = _book;
+    quantity = _quantity;
+    aggregatePosition = _aggregatePosition;
+}
+
+template<typename T>
+const T& PositionDelta<T>::GetProduct() const {
+    return product;
+}
+
+template<typename T>
+BookId PositionDelta<T>::GetBook() const {
+    return book;
+}
+
+template<typename T>
+long PositionDelta<T>::GetQuantity() const {
+    return quantity;
+}
+
+template<typename T>
+long PositionDelta<T>::GetAggregatePosition() const {
+    return aggregatePosition;
 }
 
 #endif
\ No newline at end of file
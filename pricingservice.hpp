@@ -32,7 +32,7 @@ public:
     double GetBidOfferSpread() const;
 
 private:
-    const T& product;
+    T product;
     double mid;
     double bidOfferSpread;
 
@@ -48,13 +48,13 @@ class Bond : public Product {
 
 public:
 
-    // ctor for a bond
+    // ctor for a bond, optionally naming its issuer
     Bond(string _productId,
         BondIdType _bondIdType,
         string _ticker,
         float _coupon,
         date _maturityDate,
-        double pv01);
+        string _issuer = "");
     Bond();
 
     // Get the ticker
@@ -69,7 +69,9 @@ public:
     // Get the bond identifier type
     BondIdType GetBondIdType() const;
 
-    double GetPV01() const;
+    // Get the issuer, or an empty string if it is not known
+    const string& GetIssuer() const;
+
     // Print the bond
     friend ostream& operator<<(ostream& output, const Bond& bond);
 
@@ -78,7 +80,7 @@ private:
     string ticker;
     float coupon;
     date maturityDate;
-    double pv01;
+    string issuer;
 
 };
 
@@ -191,14 +193,14 @@ Bond::Bond(string _productId,
     string _ticker,
     float _coupon,
     date _maturityDate,
-    double _pv01) : Product(
+    string _issuer) : Product(
         _productId,
         BOND) {
     bondIdType = _bondIdType;
     ticker = _ticker;
     coupon = _coupon;
     maturityDate = _maturityDate;
-    pv01 = _pv01;
+    issuer = _issuer;
 }
 
 Bond::Bond() : Product(0, BOND) {
@@ -220,8 +222,8 @@ BondIdType Bond::GetBondIdType() const {
     return bondIdType;
 }
 
-double Bond::GetPV01() const {
-    return pv01;
+const string& Bond::GetIssuer() const {
+    return issuer;
 }
 
 ostream& operator<<(ostream& output, const Bond& bond) {
@@ -0,0 +1,216 @@
+/**
+ * replay.hpp
+ *
+ * This file defines time-accurate replay of input files for the bond trading system. Key components include:
+ * - 'ReplayOptions': Whether to pace input, the speed multiplier, and the synthetic rate used when input has no timestamps.
+ * - 'ReplayStats': Pacing error statistics (how late each event was delivered against its schedule).
+ * - 'ReplayScheduler': Releases events at their scheduled times using a hybrid timer: it sleeps until shortly before the
+ *   deadline and then spins on the steady clock, which gives microsecond accuracy without burning a core between events.
+ *
+ * Event times come from a 'Timestamp' column when the input has one (microseconds since the epoch, or a boost time such as
+ * 2017-Dec-29 10:00:00.000123), otherwise from the synthetic rate. A speed of 10 replays ten times faster than recorded;
+ * a speed of 0 replays as fast as possible but still measures throughput.
+ */
+
+#ifndef REPLAY_HPP
+#define REPLAY_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "formatting.hpp"
+
+using namespace std;
+
+struct ReplayOptions {
+    // Pace events instead of delivering them as they are read
+    bool enabled = false;
+    // Multiplier on recorded time; 0 means as fast as possible
+    double speed = 1.0;
+    // Events per second (at 1x) for input without timestamps; 0 means unpaced
+    double syntheticRate = 0.0;
+    // How close to a deadline the scheduler stops sleeping and starts spinning, in nanoseconds
+    int64_t spinNanos = 200000;
+};
+
+/**
+ * Pacing error statistics. Errors are bucketed by powers of two of nanoseconds, so percentiles are accurate to within 2x.
+ */
+class ReplayStats {
+
+public:
+
+    static const int BUCKETS = 48;
+
+    ReplayStats();
+
+    // Record how late an event was released, in nanoseconds (early releases count as zero)
+    void Record(int64_t lateNanos);
+
+    // Get the number of events released
+    uint64_t GetCount() const;
+
+    // Get the mean and maximum lateness in microseconds
+    double GetMeanMicros() const;
+    double GetMaxMicros() const;
+
+    // Get an upper bound on the given percentile (0-100) of lateness, in microseconds
+    double GetPercentileMicros(double percentile) const;
+
+    // Print a one-line summary, including the achieved event rate over the given wall time
+    void Report(ostream& output, const string& source, double elapsedSeconds) const;
+
+private:
+    uint64_t count;
+    double sum;
+    int64_t maximum;
+    uint64_t buckets[BUCKETS];
+
+};
+
+class ReplayScheduler {
+
+public:
+
+    explicit ReplayScheduler(const ReplayOptions& options);
+
+    // Start the clock. Event offsets are measured from the first event.
+    void Start();
+
+    // Wait until the event at eventOffsetNanos (recorded time since the first event) is due, and record its pacing error
+    void WaitFor(int64_t eventOffsetNanos);
+
+    // Get the event offset for the n-th event of input without timestamps
+    int64_t GetSyntheticOffset(uint64_t eventIndex) const;
+
+    // Does this replay pace events at all?
+    bool IsPaced() const;
+
+    // Get the time since Start in seconds
+    double GetElapsedSeconds() const;
+
+    const ReplayStats& GetStats() const;
+
+    // Parse a timestamp cell into nanoseconds since the epoch. Returns false if the cell is not a timestamp.
+    static bool ParseTimestamp(const string& cell, int64_t& nanos);
+
+private:
+    ReplayOptions options;
+    chrono::steady_clock::time_point start;
+    ReplayStats stats;
+
+};
+
+ReplayStats::ReplayStats() : count(0), sum(0.0), maximum(0) {
+    fill(buckets, buckets + BUCKETS, 0);
+}
+
+void ReplayStats::Record(int64_t lateNanos) {
+    lateNanos = max<int64_t>(lateNanos, 0);
+    int bucket = 0;
+    while (bucket < BUCKETS - 1 && (int64_t(1) << bucket) <= lateNanos) {
+        bucket++;
+    }
+    buckets[bucket]++;
+    count++;
+    sum += double(lateNanos);
+    maximum = max(maximum, lateNanos);
+}
+
+uint64_t ReplayStats::GetCount() const {
+    return count;
+}
+
+double ReplayStats::GetMeanMicros() const {
+    return count > 0 ? sum / count / 1000.0 : 0.0;
+}
+
+double ReplayStats::GetMaxMicros() const {
+    return maximum / 1000.0;
+}
+
+double ReplayStats::GetPercentileMicros(double percentile) const {
+    uint64_t rank = uint64_t(percentile / 100.0 * count);
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < BUCKETS; ++bucket) {
+        seen += buckets[bucket];
+        if (seen > rank) {
+            return min<double>(double(int64_t(1) << bucket), double(maximum)) / 1000.0;
+        }
+    }
+    return GetMaxMicros();
+}
+
+void ReplayStats::Report(ostream& output, const string& source, double elapsedSeconds) const {
+    output << "Replay of " << source << ": " << count << " events in " << elapsedSeconds << "s ("
+        << (elapsedSeconds > 0 ? count / elapsedSeconds : 0.0) << "/s), pacing error mean " << GetMeanMicros()
+        << "us, p50 " << GetPercentileMicros(50) << "us, p99 " << GetPercentileMicros(99)
+        << "us, max " << GetMaxMicros() << "us" << endl;
+}
+
+ReplayScheduler::ReplayScheduler(const ReplayOptions& _options) : options(_options) {
+    start = chrono::steady_clock::now();
+}
+
+void ReplayScheduler::Start() {
+    start = chrono::steady_clock::now();
+}
+
+/**
+ * Sleep until spinNanos before the deadline, then spin. Events that are already due are released immediately,
+ * and how late they are is what the stats report.
+ */
+void ReplayScheduler::WaitFor(int64_t eventOffsetNanos) {
+    if (!IsPaced()) {
+        stats.Record(0);
+        return;
+    }
+    auto deadline = start + chrono::nanoseconds(int64_t(eventOffsetNanos / options.speed));
+    auto now = chrono::steady_clock::now();
+    auto spinFrom = deadline - chrono::nanoseconds(options.spinNanos);
+    if (now < spinFrom) {
+        this_thread::sleep_for(spinFrom - now);
+    }
+    while ((now = chrono::steady_clock::now()) < deadline) {
+    }
+    stats.Record(chrono::duration_cast<chrono::nanoseconds>(now - deadline).count());
+}
+
+int64_t ReplayScheduler::GetSyntheticOffset(uint64_t eventIndex) const {
+    return options.syntheticRate > 0 ? int64_t(eventIndex * (1e9 / options.syntheticRate)) : 0;
+}
+
+bool ReplayScheduler::IsPaced() const {
+    return options.enabled && options.speed > 0;
+}
+
+double ReplayScheduler::GetElapsedSeconds() const {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+const ReplayStats& ReplayScheduler::GetStats() const {
+    return stats;
+}
+
+bool ReplayScheduler::ParseTimestamp(const string& cell, int64_t& nanos) {
+    if (cell.empty()) {
+        return false;
+    }
+    if (cell.find_first_not_of("0123456789") == string::npos) {
+        nanos = stoll(cell) * 1000;
+        return true;
+    }
+    try {
+        nanos = ToEpochMicros(boost::posix_time::time_from_string(cell)) * 1000;
+        return true;
+    }
+    catch (const exception&) {
+        return false;
+    }
+}
+
+#endif //REPLAY_HPP
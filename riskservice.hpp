@@ -31,6 +31,9 @@ public:
     // Get the quantity that this risk value is associated with
     long GetQuantity() const;
 
+    // Apply a change in PV01 and quantity to this risk value
+    void Add(double _pv01, long _quantity);
+
 private:
     T product;
     double pv01;
@@ -41,6 +44,7 @@ private:
 /**
  * A bucket sector to bucket a group of securities.
  * We can then aggregate bucketed risk to this bucket.
+ * Only the product identifiers are kept, so a sector stays small however heavy T is.
  * Type T is the product type.
  */
 template<typename T>
@@ -50,14 +54,17 @@ public:
     // ctor for a bucket sector
     explicit BucketedSector(const vector<T>& _products, string _name);
 
-    // Get the products associated with this bucket
-    const vector<T>& GetProducts() const;
+    // ctor for a bucket sector from product identifiers
+    BucketedSector(const vector<string>& _productIds, string _name);
+
+    // Get the identifiers of the products associated with this bucket
+    const vector<string>& GetProductIds() const;
 
     // Get the name of the bucket
     const string& GetName() const;
 
 private:
-    vector<T> products;
+    vector<string> productIds;
     string name;
 
 };
@@ -101,14 +108,28 @@ long PV01<T>::GetQuantity() const {
 }
 
 template<typename T>
-BucketedSector<T>::BucketedSector(const vector<T>& _products, string _name) :
-    products(_products) {
+void PV01<T>::Add(double _pv01, long _quantity) {
+    pv01 += _pv01;
+    quantity += _quantity;
+}
+
+template<typename T>
+BucketedSector<T>::BucketedSector(const vector<T>& _products, string _name) {
+    for (const auto& product : _products) {
+        productIds.push_back(product.GetProductId());
+    }
+    name = _name;
+}
+
+template<typename T>
+BucketedSector<T>::BucketedSector(const vector<string>& _productIds, string _name) :
+    productIds(_productIds) {
     name = _name;
 }
 
 template<typename T>
-const vector<T>& BucketedSector<T>::GetProducts() const {
-    return products;
+const vector<string>& BucketedSector<T>::GetProductIds() const {
+    return productIds;
 }
 
 template<typename T>
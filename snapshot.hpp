@@ -0,0 +1,471 @@
+/**
+ * snapshot.hpp
+ *
+ * This file defines checkpointing of service state for fast restart of the bond trading system. Key components include:
+ * - 'SnapshotHeader' and 'SnapshotSectionEntry': A 64-byte file header and a directory of named sections. Each section is an
+ *   array of fixed-size records; strings (product ids, book names, inquiry ids, input paths) are offsets into a string table.
+ * - The 'Snapshot*Record' structs: The records of the services that are checkpointed, and of the input watermarks.
+ * - 'SnapshotWriter': Collects sections and writes them to a temporary file that is renamed over the snapshot, so a crash
+ *   while checkpointing leaves the previous snapshot intact.
+ * - 'SnapshotFile': Memory-maps a snapshot so sections can be read as plain arrays.
+ * - 'Checkpointable': Implemented by services whose stores are checkpointed (pricing, market data, positions, risk, inquiries),
+ *   and by the algo execution service and the execution trade generator, whose id sequences and side or book cycles are.
+ * - 'InputWatermark': How far an input file has been consumed: events delivered and the byte offset of the next line (or the
+ *   index of the next record for binary input).
+ * - 'Checkpointer': Restores services from a snapshot as they are attached and tells input connectors to resume after their
+ *   watermark, and writes snapshots of every attached service and input at the end of a run or every N input events.
+ *
+ * A snapshot is consistent because it is only ever taken between input events, on the thread delivering them. Services that
+ * are not attached when a snapshot is taken, and inputs not yet read, have no section and no watermark, so a restart simply
+ * rebuilds them from the start of their inputs. When a run was itself restored, the sections of services it has not attached
+ * yet are carried over from the snapshot it was restored from, together with their inputs' watermarks. Files are written in
+ * the native byte order.
+ */
+
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char SNAPSHOT_MAGIC[8] = "BTSSNP1";
+static const int SNAPSHOT_BOOK_DEPTH = 5;
+
+/**
+ * The start of a snapshot file. 64 bytes.
+ */
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t sectionCount;
+    uint32_t reserved;
+    uint64_t stringsOffset;
+    uint64_t stringsLength;
+    char padding[32];
+};
+
+/**
+ * Where a section's records are. 48 bytes; the directory follows the header.
+ */
+struct SnapshotSectionEntry {
+    char name[24];
+    uint32_t recordSize;
+    uint32_t reserved;
+    uint64_t recordCount;
+    uint64_t offset;
+};
+
+// The last price of a product. 24 bytes.
+struct SnapshotPriceRecord {
+    uint32_t product;
+    uint32_t reserved;
+    double mid;
+    double bidOfferSpread;
+};
+
+// The last order book of a product, best level first. 168 bytes.
+struct SnapshotOrderBookRecord {
+    uint32_t product;
+    uint16_t bidDepth;
+    uint16_t offerDepth;
+    double bidPrices[SNAPSHOT_BOOK_DEPTH];
+    double offerPrices[SNAPSHOT_BOOK_DEPTH];
+    int64_t bidQuantities[SNAPSHOT_BOOK_DEPTH];
+    int64_t offerQuantities[SNAPSHOT_BOOK_DEPTH];
+};
+
+// The position of a product in one book. 16 bytes.
+struct SnapshotPositionRecord {
+    uint32_t product;
+    uint32_t book;
+    int64_t quantity;
+};
+
+// A bond known to the risk service, in analytics order: its last clean price and the risk held in it. 32 bytes.
+struct SnapshotRiskRecord {
+    static const uint32_t HAS_PRICE = 1;
+    static const uint32_t HAS_RISK = 2;
+
+    uint32_t product;
+    uint32_t flags;
+    double cleanPrice;
+    double pv01;
+    int64_t quantity;
+};
+
+// An inquiry and the state it has reached. 32 bytes.
+struct SnapshotInquiryRecord {
+    uint32_t inquiry;
+    uint32_t product;
+    int32_t side;
+    int32_t state;
+    int64_t quantity;
+    double price;
+};
+
+// Where a generator of orders or trades has got to: the sequence of its next id and its place in the cycle it alternates
+// through. 16 bytes.
+struct SnapshotGeneratorRecord {
+    uint64_t nextSequence;
+    uint32_t state;
+    uint32_t reserved;
+};
+
+// How far an input has been consumed. 24 bytes.
+struct SnapshotWatermarkRecord {
+    uint32_t source;
+    uint32_t reserved;
+    uint64_t events;
+    uint64_t offset;
+};
+
+class SnapshotFile;
+
+class SnapshotWriter {
+
+public:
+
+    // ctor for a snapshot whose string table starts with that of base, so base's sections can be carried over unchanged
+    explicit SnapshotWriter(const SnapshotFile* base = nullptr);
+
+    // Get the string table offset of a string, adding it if it is new
+    uint32_t Intern(const string& text);
+
+    // Add a section of records
+    template<typename R>
+    void AddSection(const string& name, const vector<R>& records);
+
+    // Add a section of recordCount records of recordSize bytes each
+    void AddSection(const string& name, uint32_t recordSize, uint64_t recordCount, const char* data);
+
+    // Has a section of this name been added?
+    bool HasSection(const string& name) const;
+
+    // Write the snapshot to path, replacing any snapshot already there only once it is complete
+    void Write(const string& path) const;
+
+private:
+    struct Section {
+        string name;
+        uint32_t recordSize;
+        uint64_t recordCount;
+        vector<char> data;
+    };
+
+    vector<Section> sections;
+    string strings;
+    unordered_map<string, uint32_t> stringOffsets;
+
+};
+
+class SnapshotFile {
+
+public:
+
+    // Map a snapshot file; exits if it is not a complete snapshot
+    explicit SnapshotFile(const string& path);
+    ~SnapshotFile();
+
+    SnapshotFile(const SnapshotFile&) = delete;
+    SnapshotFile& operator=(const SnapshotFile&) = delete;
+
+    // Get the records of a section, or nullptr (and a count of 0) if there is no such section
+    template<typename R>
+    const R* GetSection(const string& name, uint64_t& count) const;
+
+    // Get a string by its string table offset
+    const char* GetString(uint32_t offset) const;
+
+    // Add every section of this snapshot that the writer does not already have, except those named exclude
+    void CopySections(SnapshotWriter& writer, const string& exclude) const;
+
+private:
+    friend class SnapshotWriter;
+
+    string path;
+    const char* mapping;
+    size_t size;
+    const SnapshotHeader* header;
+    const SnapshotSectionEntry* directory;
+
+};
+
+/**
+ * A service whose store can be checkpointed.
+ */
+class Checkpointable {
+
+public:
+
+    // Add the service's sections to a snapshot
+    virtual void SaveSnapshot(SnapshotWriter& writer) = 0;
+
+    // Replace the service's store with the one in a snapshot, without notifying listeners
+    virtual void RestoreSnapshot(const SnapshotFile& snapshot) = 0;
+
+};
+
+struct InputWatermark {
+    uint64_t events;
+    uint64_t offset;
+};
+
+class Checkpointer {
+
+public:
+
+    static Checkpointer& GetInstance();
+
+    // Restore services from the snapshot at path as they are attached, and resume inputs after their watermarks
+    void Load(const string& path);
+
+    // Write snapshots to path when Save is called, and also every everyEvents input events if that is not 0
+    void Enable(const string& path, uint64_t everyEvents);
+
+    // Restore a service from the loaded snapshot, if any, and include it in the snapshots written from now on
+    void Attach(Checkpointable* service);
+
+    // Get the watermark of an input, to resume after and to advance as events are delivered.
+    // Returns nullptr when no snapshot is loaded and none are written, so connectors can skip the bookkeeping.
+    InputWatermark* GetWatermark(const string& source);
+
+    // Called by connectors after each event; writes a snapshot every everyEvents events
+    void OnEvent() {
+        if (everyEvents > 0 && ++eventsSinceSave >= everyEvents) {
+            Save();
+        }
+    }
+
+    // Write a snapshot of every attached service and every input
+    void Save();
+
+private:
+    Checkpointer() : snapshot(nullptr), everyEvents(0), eventsSinceSave(0) {}
+
+    SnapshotFile* snapshot;
+    string path;
+    uint64_t everyEvents;
+    uint64_t eventsSinceSave;
+    vector<Checkpointable*> services;
+    // A deque keeps watermarks at stable addresses as more inputs are read.
+    deque<pair<string, InputWatermark>> watermarks;
+
+};
+
+SnapshotWriter::SnapshotWriter(const SnapshotFile* base) {
+    if (!base) {
+        return;
+    }
+    strings.assign(base->mapping + base->header->stringsOffset, base->header->stringsLength);
+    for (size_t offset = 0; offset < strings.size(); offset = strings.find('\0', offset) + 1) {
+        stringOffsets.insert(make_pair(string(strings.c_str() + offset), static_cast<uint32_t>(offset)));
+    }
+}
+
+uint32_t SnapshotWriter::Intern(const string& text) {
+    auto inserted = stringOffsets.insert(make_pair(text, static_cast<uint32_t>(strings.size())));
+    if (inserted.second) {
+        strings.append(text);
+        strings.push_back('\0');
+    }
+    return inserted.first->second;
+}
+
+template<typename R>
+void SnapshotWriter::AddSection(const string& name, const vector<R>& records) {
+    AddSection(name, sizeof(R), records.size(), reinterpret_cast<const char*>(records.data()));
+}
+
+void SnapshotWriter::AddSection(const string& name, uint32_t recordSize, uint64_t recordCount, const char* data) {
+    sections.push_back(Section{ name, recordSize, recordCount, vector<char>(data, data + recordSize * recordCount) });
+}
+
+bool SnapshotWriter::HasSection(const string& name) const {
+    for (const auto& section : sections) {
+        if (section.name == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SnapshotWriter::Write(const string& path) const {
+    string temporaryPath = path + ".tmp";
+    FILE* file = fopen(temporaryPath.c_str(), "wb");
+    if (!file) {
+        cerr << "Unable to open file " << temporaryPath;
+        exit(1);
+    }
+    SnapshotHeader header = {};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.sectionCount = static_cast<uint32_t>(sections.size());
+
+    // Sections follow the directory, each padded to 8 bytes so its records can be read in place.
+    vector<SnapshotSectionEntry> directory(sections.size());
+    uint64_t offset = sizeof(SnapshotHeader) + sections.size() * sizeof(SnapshotSectionEntry);
+    for (size_t i = 0; i < sections.size(); ++i) {
+        strncpy(directory[i].name, sections[i].name.c_str(), sizeof(directory[i].name) - 1);
+        directory[i].recordSize = sections[i].recordSize;
+        directory[i].recordCount = sections[i].recordCount;
+        directory[i].offset = offset;
+        offset += (sections[i].data.size() + 7) & ~uint64_t(7);
+    }
+    header.stringsOffset = offset;
+    header.stringsLength = strings.size();
+
+    static const char padding[8] = {};
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(directory.data(), sizeof(SnapshotSectionEntry), directory.size(), file);
+    for (const auto& section : sections) {
+        fwrite(section.data.data(), 1, section.data.size(), file);
+        fwrite(padding, 1, (8 - section.data.size() % 8) % 8, file);
+    }
+    fwrite(strings.data(), 1, strings.size(), file);
+    bool written = fflush(file) == 0 && fsync(fileno(file)) == 0;
+    fclose(file);
+    if (!written || rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        cerr << "Unable to write file " << path;
+        exit(1);
+    }
+}
+
+SnapshotFile::SnapshotFile(const string& _path) : path(_path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(SnapshotHeader)) {
+        cerr << "Unable to open file " << path;
+        exit(1);
+    }
+    size = size_t(info.st_size);
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        cerr << "Unable to map file " << path;
+        exit(1);
+    }
+    mapping = static_cast<const char*>(mapped);
+    header = reinterpret_cast<const SnapshotHeader*>(mapping);
+    directory = reinterpret_cast<const SnapshotSectionEntry*>(mapping + sizeof(SnapshotHeader));
+
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        cerr << "Not a snapshot file: " << path;
+        exit(1);
+    }
+    if (header->stringsOffset + header->stringsLength > size
+        || sizeof(SnapshotHeader) + header->sectionCount * sizeof(SnapshotSectionEntry) > header->stringsOffset) {
+        cerr << "Truncated snapshot file: " << path;
+        exit(1);
+    }
+}
+
+SnapshotFile::~SnapshotFile() {
+    munmap(const_cast<char*>(mapping), size);
+}
+
+template<typename R>
+const R* SnapshotFile::GetSection(const string& name, uint64_t& count) const {
+    for (uint32_t i = 0; i < header->sectionCount; ++i) {
+        const SnapshotSectionEntry& entry = directory[i];
+        if (name.compare(0, sizeof(entry.name), entry.name, strnlen(entry.name, sizeof(entry.name))) != 0) {
+            continue;
+        }
+        if (entry.recordSize != sizeof(R) || entry.offset + entry.recordCount * entry.recordSize > header->stringsOffset) {
+            cerr << "Corrupt section " << name << " in snapshot file " << path;
+            exit(1);
+        }
+        count = entry.recordCount;
+        return reinterpret_cast<const R*>(mapping + entry.offset);
+    }
+    count = 0;
+    return nullptr;
+}
+
+const char* SnapshotFile::GetString(uint32_t offset) const {
+    return mapping + header->stringsOffset + offset;
+}
+
+void SnapshotFile::CopySections(SnapshotWriter& writer, const string& exclude) const {
+    for (uint32_t i = 0; i < header->sectionCount; ++i) {
+        const SnapshotSectionEntry& entry = directory[i];
+        string name(entry.name, strnlen(entry.name, sizeof(entry.name)));
+        if (name != exclude && !writer.HasSection(name)) {
+            writer.AddSection(name, entry.recordSize, entry.recordCount, mapping + entry.offset);
+        }
+    }
+}
+
+Checkpointer& Checkpointer::GetInstance() {
+    static Checkpointer* instance = new Checkpointer();
+    return *instance;
+}
+
+void Checkpointer::Load(const string& snapshotPath) {
+    snapshot = new SnapshotFile(snapshotPath);
+    uint64_t count;
+    const SnapshotWatermarkRecord* records = snapshot->GetSection<SnapshotWatermarkRecord>("watermarks", count);
+    for (uint64_t i = 0; i < count; ++i) {
+        watermarks.push_back(make_pair(string(snapshot->GetString(records[i].source)),
+            InputWatermark{ records[i].events, records[i].offset }));
+    }
+}
+
+void Checkpointer::Enable(const string& snapshotPath, uint64_t _everyEvents) {
+    path = snapshotPath;
+    everyEvents = _everyEvents;
+}
+
+void Checkpointer::Attach(Checkpointable* service) {
+    if (snapshot) {
+        service->RestoreSnapshot(*snapshot);
+    }
+    if (!path.empty()) {
+        services.push_back(service);
+    }
+}
+
+InputWatermark* Checkpointer::GetWatermark(const string& source) {
+    if (!snapshot && path.empty()) {
+        return nullptr;
+    }
+    for (auto& watermark : watermarks) {
+        if (watermark.first == source) {
+            return &watermark.second;
+        }
+    }
+    watermarks.push_back(make_pair(source, InputWatermark{ 0, 0 }));
+    return &watermarks.back().second;
+}
+
+void Checkpointer::Save() {
+    if (path.empty()) {
+        return;
+    }
+    eventsSinceSave = 0;
+    SnapshotWriter writer(snapshot);
+    for (auto service : services) {
+        service->SaveSnapshot(writer);
+    }
+    if (snapshot) {
+        snapshot->CopySections(writer, "watermarks");
+    }
+    vector<SnapshotWatermarkRecord> records;
+    for (const auto& watermark : watermarks) {
+        records.push_back(SnapshotWatermarkRecord{ writer.Intern(watermark.first), 0,
+            watermark.second.events, watermark.second.offset });
+    }
+    writer.AddSection("watermarks", records);
+    writer.Write(path);
+}
+
+#endif //SNAPSHOT_HPP
@@ -8,8 +8,14 @@
 #ifndef SOA_HPP
 #define SOA_HPP
 
+#include <iostream>
+#include <stdexcept>
+#include <string>
 #include <vector>
 #include <unordered_map>
+#include "latency.hpp"
+#include "metrics.hpp"
+#include "tracing.hpp"
 
 using namespace std;
 
@@ -67,8 +73,80 @@ public:
         return listeners;
     }
 
+    // The value stored under a key and whether the key was added by the call.
+    struct UpsertResult {
+        V& stored;
+        bool added;
+    };
+
+    // Get the value stored under a key, inserting initial if the key is absent. An existing value is left as it is.
+    // Nothing is copied or allocated when the key is present.
+    UpsertResult FindOrInsert(const K& key, const V& initial) {
+        auto existing = dataStore.find(key);
+        if (existing != dataStore.end()) {
+            return UpsertResult{ existing->second, false };
+        }
+        return UpsertResult{ dataStore.emplace(key, initial).first->second, true };
+    }
+
+    // Store a value under a key, assigning over the existing value in place if there is one.
+    // An update is one hash probe and one assignment; only the first sighting of a key builds a node.
+    UpsertResult Upsert(const K& key, const V& value) {
+        auto existing = dataStore.find(key);
+        if (existing != dataStore.end()) {
+            existing->second = value;
+            return UpsertResult{ existing->second, false };
+        }
+        return UpsertResult{ dataStore.emplace(key, value).first->second, true };
+    }
+
+protected:
+
+    // Notify every listener of an add or an update of the stored value.
+    void Notify(V& stored, bool added) {
+        for (auto listener : listeners) {
+            LATENCY_SCOPE(LISTENER_STAGE);
+            TRACE_SPAN(added ? "ProcessAdd" : "ProcessUpdate", *listener);
+            if (added) {
+                listener->ProcessAdd(stored);
+            }
+            else {
+                listener->ProcessUpdate(stored);
+            }
+        }
+    }
+
+};
+
+/**
+ * Send a value read by an input connector to its service, counting it in the connector's events metric. Ends the event's
+ * parse stage and times the service stage when latency histograms are compiled in. Shared by the text and binary connectors.
+ */
+template<typename K, typename V>
+void DeliverInput(MetricCounter* events, Service<K, V>* service, V& data) {
+    events->Increment();
+    LATENCY_MARK(PARSE_STAGE);
+    LATENCY_SCOPE(SERVICE_STAGE);
+    TRACE_SPAN("OnMessage", *service);
+    service->OnMessage(data);
+}
+
+/**
+ * Thrown while decoding an input record that cannot be delivered, e.g. one naming an unknown product.
+ * Input connectors skip the record and carry on reading, so one bad record never ends a file or a live feed.
+ */
+class SkippedInput : public runtime_error {
+public:
+    explicit SkippedInput(const string& reason) : runtime_error(reason) {}
 };
 
+// Count a skipped input record in the 'input.skipped' metric and warn about it on one line
+void ReportSkippedInput(const string& source, const SkippedInput& skip) {
+    static MetricCounter* skipped = MetricsRegistry::GetInstance().GetCounter("input.skipped");
+    skipped->Increment();
+    std::cerr << ("Skipped a record of " + source + ": " + skip.what() + "\n");
+}
+
 /**
  * Definition of a Connector class.
  * This will invoke the Service.OnMessage() method for subscriber Connectors
@@ -0,0 +1,284 @@
+/**
+ * streaminput.hpp
+ *
+ * This file defines the streaming input sources of the bond trading system, so services can be fed from a live or growing feed
+ * instead of a complete file. Key components include:
+ * - 'IsStreamSource': Whether an input name is a stream rather than a file: '-' (standard input), 'fifo:PATH' (a named pipe),
+ *   'unix:PATH' (a listening Unix domain socket, which is connected to) or 'tail:PATH' (a file followed as it grows).
+ * - 'StreamReader': Reads newline-framed lines from one stream source. Reads are non-blocking and land in one reusable receive
+ *   buffer, and lines are framed incrementally: each byte is searched for a newline once, however the lines are split across
+ *   reads. While no data is available it waits in poll (a tailed file is polled at a fixed interval instead).
+ *
+ * A pipe, socket or standard input ends when its writer closes it. A source that does not exist yet (a socket nobody listens on,
+ * a file not yet created) is retried, and a named pipe waits for its writer to open it. With an idle timeout, a stream that
+ * receives nothing for that long ends, which is the only way a tailed file ends.
+ */
+
+#ifndef STREAM_INPUT_HPP
+#define STREAM_INPUT_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Initial size of the receive buffer; it only grows to hold a line longer than this
+const size_t STREAM_BUFFER_BYTES = 1 << 16;
+// How often a missing source is retried, and a tailed file is checked for new data
+const int STREAM_RETRY_MILLIS = 100;
+const int STREAM_TAIL_POLL_MILLIS = 10;
+
+bool IsStreamSource(const string& source) {
+    return source == "-" || source.compare(0, 5, "fifo:") == 0 || source.compare(0, 5, "unix:") == 0
+        || source.compare(0, 5, "tail:") == 0;
+}
+
+class StreamReader {
+
+public:
+
+    /**
+     * Open a stream source, waiting for it to become available.
+     * @param source '-', 'fifo:PATH', 'unix:PATH' or 'tail:PATH'
+     * @param idleTimeoutMillis end the stream after this long without data; 0 waits indefinitely
+     */
+    StreamReader(const string& source, unsigned int idleTimeoutMillis = 0);
+
+    // Closes the source; standard input is only returned to blocking mode
+    ~StreamReader();
+
+    StreamReader(const StreamReader&) = delete;
+    StreamReader& operator=(const StreamReader&) = delete;
+
+    // Get the next line, without its line ending. Returns false once the stream has ended.
+    bool NextLine(string& line);
+
+    // Can the stream be repositioned? Only a tailed file can.
+    bool IsSeekable() const;
+
+    // Continue a tailed file from a byte offset, discarding anything received but not yet returned
+    void Seek(uint64_t offset);
+
+    // Get the number of bytes of the source up to the end of the last line returned
+    uint64_t GetOffset() const;
+
+private:
+    enum SourceKind { STDIN_SOURCE, FIFO_SOURCE, UNIX_SOCKET_SOURCE, TAILED_FILE_SOURCE };
+
+    string source;
+    string path;
+    SourceKind kind;
+    unsigned int idleTimeoutMillis;
+    int descriptor;
+    int originalFlags;
+    vector<char> buffer;
+    // buffer holds [begin, end) unreturned; [begin, scanned) has no newline
+    size_t begin;
+    size_t scanned;
+    size_t end;
+    uint64_t offset;
+    bool ended;
+    chrono::steady_clock::time_point lastData;
+
+    bool Open();
+    bool Fill();
+    // Milliseconds left before the idle timeout, or -1 without one
+    int RemainingIdleMillis() const;
+    static void TrimLineEnding(string& line);
+};
+
+StreamReader::StreamReader(const string& _source, unsigned int _idleTimeoutMillis)
+    : source(_source), idleTimeoutMillis(_idleTimeoutMillis), descriptor(-1), originalFlags(-1), buffer(STREAM_BUFFER_BYTES),
+    begin(0), scanned(0), end(0), offset(0), ended(false), lastData(chrono::steady_clock::now()) {
+    if (source == "-") {
+        kind = STDIN_SOURCE;
+    }
+    else {
+        path = source.substr(5);
+        kind = source.compare(0, 5, "fifo:") == 0 ? FIFO_SOURCE
+            : source.compare(0, 5, "unix:") == 0 ? UNIX_SOCKET_SOURCE : TAILED_FILE_SOURCE;
+    }
+    if (!Open()) {
+        std::cerr << "No input from " << source << std::endl;
+        ended = true;
+    }
+}
+
+StreamReader::~StreamReader() {
+    if (kind == STDIN_SOURCE) {
+        if (originalFlags >= 0) {
+            fcntl(descriptor, F_SETFL, originalFlags);
+        }
+    }
+    else if (descriptor >= 0) {
+        close(descriptor);
+    }
+}
+
+bool StreamReader::NextLine(string& line) {
+    while (true) {
+        const char* newline = scanned < end ? static_cast<const char*>(memchr(buffer.data() + scanned, '\n', end - scanned)) : nullptr;
+        if (newline) {
+            size_t lineEnd = size_t(newline - buffer.data());
+            line.assign(buffer.data() + begin, lineEnd - begin);
+            offset += lineEnd + 1 - begin;
+            begin = scanned = lineEnd + 1;
+            TrimLineEnding(line);
+            return true;
+        }
+        scanned = end;
+        if (ended || !Fill()) {
+            ended = true;
+            // A closed pipe or socket may end without a final newline; a tailed file's last line may still be being written.
+            if (begin < end && kind != TAILED_FILE_SOURCE) {
+                line.assign(buffer.data() + begin, end - begin);
+                offset += end - begin;
+                begin = scanned = end;
+                TrimLineEnding(line);
+                return true;
+            }
+            return false;
+        }
+    }
+}
+
+bool StreamReader::IsSeekable() const {
+    return kind == TAILED_FILE_SOURCE;
+}
+
+void StreamReader::Seek(uint64_t _offset) {
+    if (kind != TAILED_FILE_SOURCE || descriptor < 0) {
+        return;
+    }
+    lseek(descriptor, off_t(_offset), SEEK_SET);
+    begin = scanned = end = 0;
+    offset = _offset;
+}
+
+uint64_t StreamReader::GetOffset() const {
+    return offset;
+}
+
+/**
+ * Missing sources are retried until the idle timeout. A named pipe is opened blocking, which waits for its writer; every
+ * source is then switched to non-blocking reads.
+ */
+bool StreamReader::Open() {
+    if (kind == STDIN_SOURCE) {
+        descriptor = STDIN_FILENO;
+    }
+    while (descriptor < 0) {
+        if (kind == UNIX_SOCKET_SOURCE) {
+            sockaddr_un address;
+            memset(&address, 0, sizeof(address));
+            address.sun_family = AF_UNIX;
+            if (path.size() >= sizeof(address.sun_path)) {
+                std::cerr << "Socket path too long: " << path;
+                exit(1);
+            }
+            strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+            descriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (descriptor >= 0 && connect(descriptor, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+                int error = errno;
+                close(descriptor);
+                descriptor = -1;
+                errno = error;
+            }
+        }
+        else {
+            descriptor = open(path.c_str(), O_RDONLY);
+        }
+        if (descriptor >= 0) {
+            break;
+        }
+        if (errno != ENOENT && errno != ECONNREFUSED && errno != EINTR) {
+            std::cerr << "Unable to open " << source << ": " << strerror(errno);
+            exit(1);
+        }
+        if (RemainingIdleMillis() == 0) {
+            return false;
+        }
+        this_thread::sleep_for(chrono::milliseconds(STREAM_RETRY_MILLIS));
+    }
+    originalFlags = fcntl(descriptor, F_GETFL);
+    fcntl(descriptor, F_SETFL, originalFlags | O_NONBLOCK);
+    lastData = chrono::steady_clock::now();
+    return true;
+}
+
+/**
+ * Read whatever is available after the unreturned bytes, first moving them to the front of the buffer.
+ * @return false if the stream ended before anything more arrived
+ */
+bool StreamReader::Fill() {
+    if (descriptor < 0) {
+        return false;
+    }
+    if (begin > 0) {
+        memmove(buffer.data(), buffer.data() + begin, end - begin);
+        end -= begin;
+        scanned -= begin;
+        begin = 0;
+    }
+    if (end == buffer.size()) {
+        buffer.resize(2 * buffer.size());
+    }
+    while (true) {
+        ssize_t received = read(descriptor, buffer.data() + end, buffer.size() - end);
+        if (received > 0) {
+            end += size_t(received);
+            lastData = chrono::steady_clock::now();
+            return true;
+        }
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            std::cerr << "Lost input from " << source << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        if (received == 0 && kind != TAILED_FILE_SOURCE) {
+            return false;
+        }
+        int remaining = RemainingIdleMillis();
+        if (remaining == 0) {
+            return false;
+        }
+        if (kind == TAILED_FILE_SOURCE) {
+            int wait = remaining < 0 ? STREAM_TAIL_POLL_MILLIS : min(remaining, STREAM_TAIL_POLL_MILLIS);
+            this_thread::sleep_for(chrono::milliseconds(wait));
+            continue;
+        }
+        pollfd readable = { descriptor, POLLIN, 0 };
+        if (poll(&readable, 1, remaining) == 0) {
+            return false;
+        }
+    }
+}
+
+int StreamReader::RemainingIdleMillis() const {
+    if (idleTimeoutMillis == 0) {
+        return -1;
+    }
+    auto idle = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - lastData).count();
+    return idle >= int64_t(idleTimeoutMillis) ? 0 : int(int64_t(idleTimeoutMillis) - idle);
+}
+
+void StreamReader::TrimLineEnding(string& line) {
+    if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+    }
+}
+
+#endif //STREAM_INPUT_HPP
@@ -0,0 +1,133 @@
+/**
+ * threadpool.hpp
+ *
+ * This file defines a small fixed-size thread pool for the bond trading system. Key features include:
+ * - 'Submit': Queues a task and returns a future for its result.
+ * - 'ParallelFor': Splits an index range into chunks, runs them on the pool and blocks until all chunks are done.
+ *
+ * Tasks are taken from a single FIFO queue, so tasks submitted earlier start earlier. The number of queued tasks across all pools
+ * is published as the 'threadpool.queued' gauge.
+ */
+
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "metrics.hpp"
+
+using namespace std;
+
+class ThreadPool {
+
+public:
+
+    // ctor for a pool with the given number of worker threads (defaults to the number of hardware threads)
+    explicit ThreadPool(size_t threadCount = 0);
+
+    // Stops accepting work, finishes queued tasks and joins the workers
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Queue a task and get a future for its result
+    template<typename F>
+    future<typename result_of<F()>::type> Submit(F task);
+
+    // Run body(chunkBegin, chunkEnd) over [begin, end) in chunks of at most grain indices and wait for completion
+    void ParallelFor(size_t begin, size_t end, size_t grain, const function<void(size_t, size_t)>& body);
+
+    // Get the number of worker threads
+    size_t GetThreadCount() const;
+
+private:
+    vector<thread> workers;
+    deque<function<void()>> tasks;
+    mutex lock;
+    condition_variable available;
+    bool stopping;
+    MetricGauge* queued = MetricsRegistry::GetInstance().GetGauge("threadpool.queued");
+
+    void Work();
+};
+
+ThreadPool::ThreadPool(size_t threadCount) : stopping(false) {
+    if (threadCount == 0) {
+        threadCount = max(1u, thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < threadCount; ++i) {
+        workers.emplace_back(&ThreadPool::Work, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    available.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+template<typename F>
+future<typename result_of<F()>::type> ThreadPool::Submit(F task) {
+    typedef typename result_of<F()>::type R;
+    auto packaged = make_shared<packaged_task<R()>>(move(task));
+    future<R> result = packaged->get_future();
+    {
+        lock_guard<mutex> guard(lock);
+        tasks.push_back([packaged]() { (*packaged)(); });
+    }
+    queued->Add(1);
+    available.notify_one();
+    return result;
+}
+
+void ThreadPool::ParallelFor(size_t begin, size_t end, size_t grain, const function<void(size_t, size_t)>& body) {
+    if (begin >= end) {
+        return;
+    }
+    grain = max<size_t>(grain, 1);
+    vector<future<void>> chunks;
+    for (size_t chunkBegin = begin; chunkBegin < end; chunkBegin += grain) {
+        size_t chunkEnd = min(end, chunkBegin + grain);
+        chunks.push_back(Submit([&body, chunkBegin, chunkEnd]() { body(chunkBegin, chunkEnd); }));
+    }
+    for (auto& chunk : chunks) {
+        chunk.get();
+    }
+}
+
+size_t ThreadPool::GetThreadCount() const {
+    return workers.size();
+}
+
+void ThreadPool::Work() {
+    while (true) {
+        function<void()> task;
+        {
+            unique_lock<mutex> guard(lock);
+            available.wait(guard, [this]() { return stopping || !tasks.empty(); });
+            if (tasks.empty()) {
+                return;
+            }
+            task = move(tasks.front());
+            tasks.pop_front();
+        }
+        queued->Add(-1);
+        task();
+    }
+}
+
+#endif //THREAD_POOL_HPP
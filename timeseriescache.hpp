@@ -0,0 +1,299 @@
+/**
+ * timeseriescache.hpp
+ *
+ * This file defines the in-memory time-series cache kept behind the historical data services. Key components include:
+ * - 'TimeSeriesPoint': A cached value with the time (microseconds since the Unix epoch) it was persisted at.
+ * - 'TimeSeriesBar': An OHLC bar with volume and VWAP over a fixed interval.
+ * - 'TimeSeriesRing': A fixed-capacity ring buffer that overwrites its oldest entry when full.
+ * - 'TimeSeriesCache': Per-product ring buffers of the most recent points, plus ring buffers of bars rolled up incrementally
+ *   as points are inserted. Supports range queries by product and time, the last N points and the bars over a time range.
+ *
+ * Memory per product is bounded by the point and bar retention, and a cache with a retention of 0 is off: inserts return at once
+ * and nothing is kept. Points must be inserted in time order per product, which holds for the historical services since they
+ * stamp data as it is persisted.
+ */
+
+#ifndef TIME_SERIES_CACHE_HPP
+#define TIME_SERIES_CACHE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// Points and bars kept per product by a cache that is turned on without saying how much to keep
+const size_t TIME_SERIES_DEFAULT_RETENTION = 256;
+const size_t TIME_SERIES_DEFAULT_BAR_RETENTION = 64;
+
+/**
+ * A value cached at a point in time.
+ * Type T is the data type cached.
+ */
+template<typename T>
+struct TimeSeriesPoint {
+    int64_t timestamp;
+    T value;
+};
+
+/**
+ * Open, high, low and close of a value over [start, start + interval), with the volume traded over it.
+ */
+struct TimeSeriesBar {
+    int64_t start;
+    double open;
+    double high;
+    double low;
+    double close;
+    double volume;
+    double notional;
+    size_t count;
+
+    // Volume-weighted average of the value over the bar. Falls back to the close if there was no volume.
+    double GetVWAP() const { return volume != 0.0 ? notional / volume : close; }
+};
+
+/**
+ * Fixed-capacity ring buffer ordered from oldest to newest.
+ */
+template<typename T>
+class TimeSeriesRing {
+
+public:
+
+    explicit TimeSeriesRing(size_t _capacity) : capacity(max<size_t>(_capacity, 1)), head(0) {}
+
+    // Append an item, overwriting the oldest one when full
+    void Push(const T& item) {
+        if (items.size() < capacity) {
+            items.push_back(item);
+        }
+        else {
+            items[head] = item;
+            head = (head + 1) % capacity;
+        }
+    }
+
+    // Get the i-th oldest item
+    const T& At(size_t i) const { return items[(head + i) % items.size()]; }
+
+    // Get the newest item
+    T& Back() { return items[(head + items.size() - 1) % items.size()]; }
+
+    size_t Size() const { return items.size(); }
+    bool Empty() const { return items.empty(); }
+
+private:
+    vector<T> items;
+    size_t capacity;
+    size_t head;
+
+};
+
+/**
+ * Time-series cache keyed on product identifier.
+ * Type T is the data type cached.
+ */
+template<typename T>
+class TimeSeriesCache {
+
+public:
+
+    // Extracts the value a bar tracks, or the weight of a point, from cached data
+    typedef double (*RollupFunction)(const T&);
+
+    /**
+     * @param retention the number of points kept per product; 0 turns the cache off
+     * @param barInterval the length of each bar in microseconds
+     * @param barRetention the number of bars kept per product
+     */
+    explicit TimeSeriesCache(size_t retention = 0, int64_t barInterval = 1000000,
+        size_t barRetention = TIME_SERIES_DEFAULT_BAR_RETENTION);
+
+    // Does the cache keep anything?
+    bool IsEnabled() const { return retention > 0; }
+
+    /**
+     * Turn on bar rollups. Bars are only built for points inserted from then on.
+     * @param value the value a bar tracks (e.g. a price or a position)
+     * @param volume the weight of each point in the volume and VWAP; null to weight every point equally
+     */
+    void SetRollup(RollupFunction value, RollupFunction volume = nullptr);
+
+    // Add a point for a product and update its current bar
+    void Insert(const string& productId, int64_t timestamp, const T& value);
+
+    // Get the points of a product with a timestamp in [from, to), oldest first
+    vector<TimeSeriesPoint<T>> GetRange(const string& productId, int64_t from, int64_t to) const;
+
+    // Get the last n points of a product, oldest first
+    vector<TimeSeriesPoint<T>> GetLast(const string& productId, size_t n) const;
+
+    // Get the latest point of a product, or null if there is none. Valid until the next insert.
+    const TimeSeriesPoint<T>* GetLatest(const string& productId) const;
+
+    // Get the bars of a product that start in [from, to), oldest first. The last bar may still be filling.
+    vector<TimeSeriesBar> GetBars(const string& productId, int64_t from, int64_t to) const;
+
+    // Get the number of points held for a product
+    size_t GetSize(const string& productId) const;
+
+    // Get the products with points held, in order
+    vector<string> GetProductIds() const;
+
+private:
+    struct Series {
+        TimeSeriesRing<TimeSeriesPoint<T>> points;
+        TimeSeriesRing<TimeSeriesBar> bars;
+
+        Series(size_t retention, size_t barRetention) : points(retention), bars(barRetention) {}
+    };
+
+    size_t retention;
+    int64_t barInterval;
+    size_t barRetention;
+    RollupFunction valueOf;
+    RollupFunction volumeOf;
+    unordered_map<string, Series> series;
+
+    // Get the position of the first point at or after a timestamp
+    static size_t LowerBound(const TimeSeriesRing<TimeSeriesPoint<T>>& points, int64_t timestamp);
+
+};
+
+template<typename T>
+TimeSeriesCache<T>::TimeSeriesCache(size_t _retention, int64_t _barInterval, size_t _barRetention) {
+    retention = _retention;
+    barInterval = max<int64_t>(_barInterval, 1);
+    barRetention = _barRetention;
+    valueOf = nullptr;
+    volumeOf = nullptr;
+}
+
+template<typename T>
+void TimeSeriesCache<T>::SetRollup(RollupFunction value, RollupFunction volume) {
+    valueOf = value;
+    volumeOf = volume;
+}
+
+/**
+ * Each insert is O(1): the point goes into the ring and the current bar is either extended or a new one is started.
+ */
+template<typename T>
+void TimeSeriesCache<T>::Insert(const string& productId, int64_t timestamp, const T& value) {
+    if (retention == 0) {
+        return;
+    }
+    auto found = series.find(productId);
+    if (found == series.end()) {
+        found = series.insert(make_pair(productId, Series(retention, barRetention))).first;
+    }
+    Series& entry = found->second;
+    entry.points.Push(TimeSeriesPoint<T>{ timestamp, value });
+
+    if (!valueOf) {
+        return;
+    }
+    double level = valueOf(value);
+    double volume = volumeOf ? volumeOf(value) : 1.0;
+    int64_t start = timestamp - ((timestamp % barInterval) + barInterval) % barInterval;
+    if (entry.bars.Empty() || entry.bars.Back().start != start) {
+        entry.bars.Push(TimeSeriesBar{ start, level, level, level, level, 0.0, 0.0, 0 });
+    }
+    TimeSeriesBar& bar = entry.bars.Back();
+    bar.high = max(bar.high, level);
+    bar.low = min(bar.low, level);
+    bar.close = level;
+    bar.volume += volume;
+    bar.notional += volume * level;
+    bar.count++;
+}
+
+template<typename T>
+vector<TimeSeriesPoint<T>> TimeSeriesCache<T>::GetRange(const string& productId, int64_t from, int64_t to) const {
+    vector<TimeSeriesPoint<T>> result;
+    auto found = series.find(productId);
+    if (found == series.end()) {
+        return result;
+    }
+    const auto& points = found->second.points;
+    for (size_t i = LowerBound(points, from); i < points.Size() && points.At(i).timestamp < to; ++i) {
+        result.push_back(points.At(i));
+    }
+    return result;
+}
+
+template<typename T>
+vector<TimeSeriesPoint<T>> TimeSeriesCache<T>::GetLast(const string& productId, size_t n) const {
+    vector<TimeSeriesPoint<T>> result;
+    auto found = series.find(productId);
+    if (found == series.end()) {
+        return result;
+    }
+    const auto& points = found->second.points;
+    for (size_t i = points.Size() - min(n, points.Size()); i < points.Size(); ++i) {
+        result.push_back(points.At(i));
+    }
+    return result;
+}
+
+template<typename T>
+const TimeSeriesPoint<T>* TimeSeriesCache<T>::GetLatest(const string& productId) const {
+    auto found = series.find(productId);
+    if (found == series.end() || found->second.points.Empty()) {
+        return nullptr;
+    }
+    return &found->second.points.At(found->second.points.Size() - 1);
+}
+
+template<typename T>
+vector<TimeSeriesBar> TimeSeriesCache<T>::GetBars(const string& productId, int64_t from, int64_t to) const {
+    vector<TimeSeriesBar> result;
+    auto found = series.find(productId);
+    if (found == series.end()) {
+        return result;
+    }
+    const auto& bars = found->second.bars;
+    for (size_t i = 0; i < bars.Size(); ++i) {
+        const TimeSeriesBar& bar = bars.At(i);
+        if (bar.start >= from && bar.start < to) {
+            result.push_back(bar);
+        }
+    }
+    return result;
+}
+
+template<typename T>
+size_t TimeSeriesCache<T>::GetSize(const string& productId) const {
+    auto found = series.find(productId);
+    return found == series.end() ? 0 : found->second.points.Size();
+}
+
+template<typename T>
+vector<string> TimeSeriesCache<T>::GetProductIds() const {
+    vector<string> productIds;
+    for (const auto& entry : series) {
+        productIds.push_back(entry.first);
+    }
+    sort(productIds.begin(), productIds.end());
+    return productIds;
+}
+
+template<typename T>
+size_t TimeSeriesCache<T>::LowerBound(const TimeSeriesRing<TimeSeriesPoint<T>>& points, int64_t timestamp) {
+    size_t low = 0, high = points.Size();
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        if (points.At(middle).timestamp < timestamp) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+#endif //TIME_SERIES_CACHE_HPP
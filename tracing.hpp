@@ -0,0 +1,248 @@
+/**
+ * tracing.hpp
+ *
+ * This file defines the optional event tracing mode of the bond trading system, for finding pipeline stalls. Key components include:
+ * - 'TraceEvent': One completed span: what ran (a call name and the class it ran on), when it started and how long it took.
+ * - 'TraceBuffer': The spans recorded by one thread, in fixed-size blocks that are only ever written by that thread, so recording
+ *   takes no lock. A thread stops recording (and counts what it drops) once it has TRACE_MAX_EVENTS spans.
+ * - 'TraceRecorder': Owns the per-thread buffers, makes the 1-in-N sampling decision as each input event is read, and writes
+ *   every span as Chrome trace-event JSON (load it in chrome://tracing or ui.perfetto.dev) when the process exits.
+ * - 'TraceSpan': Records the span of a scope, when the event being processed on its thread is sampled.
+ *
+ * Spans are recorded for parse, OnMessage, ProcessAdd/ProcessUpdate and Publish calls (Append for the columnar history). A span belongs to the last input event
+ * begun on its thread, so with sampling every span of an unsampled event is skipped and nested spans stay complete.
+ *
+ * Tracing is compiled in only when BTS_TRACING is defined (the BTS_TRACE_EVENTS CMake option), and then only records once
+ * started (main's --trace option). Otherwise the TRACE_* macros expand to nothing.
+ */
+
+#ifndef TRACING_HPP
+#define TRACING_HPP
+
+#include <cstdint>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+#include "latency.hpp"
+
+using namespace std;
+
+// The most spans kept per thread (32 bytes each); later spans are dropped and counted
+const size_t TRACE_MAX_EVENTS = 1 << 22;
+
+struct TraceEvent {
+    const char* name;
+    const type_info* type;
+    uint64_t start;
+    uint64_t duration;
+};
+
+class TraceBuffer {
+
+public:
+
+    static const size_t BLOCK_EVENTS = 1 << 14;
+
+    explicit TraceBuffer(size_t _threadIndex) : threadIndex(_threadIndex), count(0), dropped(0) {}
+
+    void Append(const char* name, const type_info* type, uint64_t start, uint64_t duration) {
+        if (count == TRACE_MAX_EVENTS) {
+            dropped++;
+            return;
+        }
+        if (count % BLOCK_EVENTS == 0) {
+            blocks.emplace_back(new TraceEvent[BLOCK_EVENTS]);
+        }
+        blocks.back()[count % BLOCK_EVENTS] = TraceEvent{ name, type, start, duration };
+        count++;
+    }
+
+    size_t GetThreadIndex() const { return threadIndex; }
+    size_t GetCount() const { return count; }
+    uint64_t GetDropped() const { return dropped; }
+    const TraceEvent& Get(size_t i) const { return blocks[i / BLOCK_EVENTS][i % BLOCK_EVENTS]; }
+
+private:
+    size_t threadIndex;
+    vector<unique_ptr<TraceEvent[]>> blocks;
+    size_t count;
+    uint64_t dropped;
+
+};
+
+class TraceRecorder {
+
+public:
+
+    static TraceRecorder& GetInstance();
+
+    /**
+     * Start recording, and write the trace to a file at exit.
+     * @param path where to write the trace JSON
+     * @param sampleEvery record the spans of one in this many input events
+     */
+    void Start(const string& path, uint64_t sampleEvery);
+
+    // Decide whether the next input event on this thread is sampled
+    static void BeginEvent();
+
+    // Is the current event on this thread sampled?
+    static bool IsSampled() { return Context().sampled; }
+
+    // Record a completed span on this thread
+    static void Record(const char* name, const type_info* type, uint64_t start, uint64_t duration);
+
+    // Write every recorded span as Chrome trace-event JSON
+    void Write(ostream& output) const;
+
+private:
+    TraceRecorder() : enabled(false), sampleEvery(1), startTicks(0) {}
+
+    bool enabled;
+    uint64_t sampleEvery;
+    uint64_t startTicks;
+    string path;
+    // A vector of pointers keeps buffers at stable addresses as more threads register.
+    vector<TraceBuffer*> buffers;
+    mutable mutex lock;
+
+    struct ThreadContext {
+        TraceBuffer* buffer;
+        uint64_t events;
+        bool sampled;
+    };
+    static ThreadContext& Context();
+
+    static void WriteAtExit();
+    static string Demangle(const type_info* type);
+
+};
+
+/**
+ * Records the span of a scope against the class it runs on.
+ */
+class TraceSpan {
+
+public:
+
+    TraceSpan(const char* _name, const type_info& _type)
+        : name(_name), type(&_type), start(TraceRecorder::IsSampled() ? LatencyClock::Now() : 0) {}
+    ~TraceSpan() {
+        if (start != 0) {
+            TraceRecorder::Record(name, type, start, LatencyClock::Now() - start);
+        }
+    }
+
+private:
+    const char* name;
+    const type_info* type;
+    uint64_t start;
+
+};
+
+#ifdef BTS_TRACING
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_START(path, sampleEvery) TraceRecorder::GetInstance().Start(path, sampleEvery)
+#define TRACE_BEGIN_EVENT() TraceRecorder::BeginEvent()
+#define TRACE_SPAN(name, object) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(name, typeid(object))
+#else
+#define TRACE_START(path, sampleEvery) ((void)0)
+#define TRACE_BEGIN_EVENT() ((void)0)
+#define TRACE_SPAN(name, object) ((void)0)
+#endif
+
+TraceRecorder& TraceRecorder::GetInstance() {
+    static TraceRecorder* instance = new TraceRecorder();
+    return *instance;
+}
+
+void TraceRecorder::Start(const string& _path, uint64_t _sampleEvery) {
+    path = _path;
+    sampleEvery = _sampleEvery > 0 ? _sampleEvery : 1;
+    startTicks = LatencyClock::Now();
+    LatencyClock::TicksPerNano();
+    enabled = true;
+    atexit(WriteAtExit);
+}
+
+void TraceRecorder::BeginEvent() {
+    TraceRecorder& recorder = GetInstance();
+    if (!recorder.enabled) {
+        return;
+    }
+    ThreadContext& context = Context();
+    context.sampled = context.events++ % recorder.sampleEvery == 0;
+}
+
+void TraceRecorder::Record(const char* name, const type_info* type, uint64_t start, uint64_t duration) {
+    ThreadContext& context = Context();
+    if (!context.buffer) {
+        TraceRecorder& recorder = GetInstance();
+        lock_guard<mutex> guard(recorder.lock);
+        context.buffer = new TraceBuffer(recorder.buffers.size());
+        recorder.buffers.push_back(context.buffer);
+    }
+    context.buffer->Append(name, type, start, duration);
+}
+
+void TraceRecorder::Write(ostream& output) const {
+    double ticksPerMicro = LatencyClock::TicksPerNano() * 1000.0;
+    unordered_map<const type_info*, string> classNames;
+    lock_guard<mutex> guard(lock);
+    uint64_t dropped = 0;
+    output << "{\"traceEvents\": [" << fixed << setprecision(3);
+    bool first = true;
+    for (const TraceBuffer* buffer : buffers) {
+        output << (first ? "\n" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+            << buffer->GetThreadIndex() << ", \"args\": {\"name\": \"thread " << buffer->GetThreadIndex() << "\"}}";
+        first = false;
+        for (size_t i = 0; i < buffer->GetCount(); ++i) {
+            const TraceEvent& event = buffer->Get(i);
+            auto className = classNames.find(event.type);
+            if (className == classNames.end()) {
+                className = classNames.insert(make_pair(event.type, Demangle(event.type))).first;
+            }
+            output << ",\n{\"name\": \"" << className->second << "::" << event.name << "\", \"cat\": \"" << event.name
+                << "\", \"ph\": \"X\", \"ts\": " << (event.start - startTicks) / ticksPerMicro
+                << ", \"dur\": " << event.duration / ticksPerMicro << ", \"pid\": 1, \"tid\": " << buffer->GetThreadIndex() << "}";
+        }
+        dropped += buffer->GetDropped();
+    }
+    output.unsetf(ios_base::floatfield);
+    output << "\n], \"displayTimeUnit\": \"ns\", \"otherData\": {\"sample_every\": \"" << sampleEvery
+        << "\", \"dropped_spans\": \"" << dropped << "\"}}\n";
+}
+
+TraceRecorder::ThreadContext& TraceRecorder::Context() {
+    static thread_local ThreadContext context = { nullptr, 0, GetInstance().enabled && GetInstance().sampleEvery == 1 };
+    return context;
+}
+
+void TraceRecorder::WriteAtExit() {
+    TraceRecorder& recorder = GetInstance();
+    ofstream output(recorder.path, ios_base::trunc);
+    if (!output) {
+        std::cerr << "Unable to open file " << recorder.path << std::endl;
+        return;
+    }
+    recorder.Write(output);
+}
+
+string TraceRecorder::Demangle(const type_info* type) {
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(type->name(), nullptr, nullptr, &status);
+    string name = status == 0 && demangled ? demangled : type->name();
+    free(demangled);
+    return name;
+}
+
+#endif //TRACING_HPP
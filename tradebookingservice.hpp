@@ -10,6 +10,8 @@
 #include <string>
 #include <vector>
 #include "soa.hpp"
+#include "identifiers.hpp"
+#include "bookregistry.hpp"
 
  // Trade sides
 enum Side { BUY, SELL };
@@ -23,21 +25,27 @@ class Trade {
 
 public:
 
-    // ctor for a trade
-    Trade(const T& _product, string _tradeId, double _price, string _book, long _quantity, Side _side);
+    // ctor for a trade on a named book (the name is interned in the BookRegistry)
+    Trade(const T& _product, TradeId _tradeId, double _price, const string& _book, long _quantity, Side _side);
+
+    // ctor for a trade on an interned book
+    Trade(const T& _product, TradeId _tradeId, double _price, BookId _book, long _quantity, Side _side);
 
     // Get the product
     const T& GetProduct() const;
 
     // Get the trade ID
-    const string& GetTradeId() const;
+    TradeId GetTradeId() const;
 
     // Get the mid price
     double GetPrice() const;
 
-    // Get the book
+    // Get the book name
     const string& GetBook() const;
 
+    // Get the interned book id
+    BookId GetBookId() const;
+
     // Get the quantity
     long GetQuantity() const;
 
@@ -46,9 +54,9 @@ public:
 
 private:
     T product;
-    string tradeId;
+    TradeId tradeId;
     double price;
-    string book;
+    BookId book;
     long quantity;
     Side side;
 
@@ -60,7 +68,7 @@ private:
  * Type T is the product type.
  */
 template<typename T>
-class TradeBookingService : public Service<string, Trade<T> > {
+class TradeBookingService : public Service<TradeId, Trade<T> > {
 
 public:
 
@@ -70,7 +78,12 @@ public:
 };
 
 template<typename T>
-Trade<T>::Trade(const T& _product, string _tradeId, double _price, string _book, long _quantity, Side _side) :
+Trade<T>::Trade(const T& _product, TradeId _tradeId, double _price, const string& _book, long _quantity, Side _side) :
+    Trade(_product, _tradeId, _price, BookRegistry::GetInstance().Intern(_book), _quantity, _side) {
+}
+
+template<typename T>
+Trade<T>::Trade(const T& _product, TradeId _tradeId, double _price, BookId _book, long _quantity, Side _side) :
     product(_product) {
     tradeId = _tradeId;
     price = _price;
@@ -85,7 +98,7 @@ const T& Trade<T>::GetProduct() const {
 }
 
 template<typename T>
-const string& Trade<T>::GetTradeId() const {
+TradeId Trade<T>::GetTradeId() const {
     return tradeId;
 }
 
@@ -96,6 +109,11 @@ double Trade<T>::GetPrice() const {
 
 template<typename T>
 const string& Trade<T>::GetBook() const {
+    return BookRegistry::GetInstance().GetName(book);
+}
+
+template<typename T>
+BookId Trade<T>::GetBookId() const {
     return book;
 }
 
@@ -0,0 +1,156 @@
+/**
+ * tradeidindex.hpp
+ *
+ * This file defines the idempotency index used to drop duplicate trades in the bond trading system. Key components include:
+ * - 'TradeIdIndex': A set of 64-bit trade-id fingerprints held in two fixed-size open-addressing tables. New ids go into the
+ *   current generation; when it fills up, it becomes the previous generation and the old previous generation is dropped.
+ *
+ * Memory is fixed at construction (32 to 64 bytes per id of window) no matter how many trades arrive in a day, and both checks
+ * and inserts are a short linear probe. Every id seen in the last 'window' distinct ids is guaranteed to be remembered;
+ * older ids are remembered for up to another 'window' ids before they age out.
+ */
+
+#ifndef TRADE_ID_INDEX_HPP
+#define TRADE_ID_INDEX_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "identifiers.hpp"
+
+using namespace std;
+
+class TradeIdIndex {
+
+public:
+
+    // ctor for an index guaranteed to remember the last window distinct ids
+    explicit TradeIdIndex(size_t window = 1 << 20);
+
+    // Record an id. Returns false if the id has been seen before and is still remembered.
+    bool Insert(const TradeId& tradeId);
+
+    // Has the id been seen before (and is it still remembered)?
+    bool Contains(const TradeId& tradeId) const;
+
+    // Get the number of ids currently remembered
+    size_t GetSize() const;
+
+    // Get the number of times the current generation has been retired
+    size_t GetGenerationCount() const;
+
+    // Get the memory held by the tables in bytes
+    size_t GetMemoryBytes() const;
+
+private:
+    // Slots hold the fingerprint itself; 0 marks an empty slot.
+    vector<uint64_t> current;
+    vector<uint64_t> previous;
+    size_t window;
+    size_t mask;
+    size_t currentSize;
+    size_t previousSize;
+    size_t generations;
+
+    static uint64_t Fingerprint(const TradeId& tradeId);
+    static uint64_t Mix(uint64_t fingerprint);
+    bool Find(const vector<uint64_t>& table, uint64_t fingerprint) const;
+    void Retire();
+
+};
+
+TradeIdIndex::TradeIdIndex(size_t _window) {
+    window = _window > 0 ? _window : 1;
+    // Keep each table at most half full so probes stay short.
+    size_t capacity = 2;
+    while (capacity < 2 * window) {
+        capacity <<= 1;
+    }
+    current.assign(capacity, 0);
+    previous.assign(capacity, 0);
+    mask = capacity - 1;
+    currentSize = 0;
+    previousSize = 0;
+    generations = 0;
+}
+
+bool TradeIdIndex::Insert(const TradeId& tradeId) {
+    uint64_t fingerprint = Fingerprint(tradeId);
+    if (Find(previous, fingerprint)) {
+        return false;
+    }
+    size_t slot = Mix(fingerprint) & mask;
+    while (current[slot] != 0) {
+        if (current[slot] == fingerprint) {
+            return false;
+        }
+        slot = (slot + 1) & mask;
+    }
+    current[slot] = fingerprint;
+    if (++currentSize >= window) {
+        Retire();
+    }
+    return true;
+}
+
+bool TradeIdIndex::Contains(const TradeId& tradeId) const {
+    uint64_t fingerprint = Fingerprint(tradeId);
+    return Find(current, fingerprint) || Find(previous, fingerprint);
+}
+
+size_t TradeIdIndex::GetSize() const {
+    return currentSize + previousSize;
+}
+
+size_t TradeIdIndex::GetGenerationCount() const {
+    return generations;
+}
+
+size_t TradeIdIndex::GetMemoryBytes() const {
+    return (current.size() + previous.size()) * sizeof(uint64_t);
+}
+
+/**
+ * Trade ids are already 64-bit values, so the fingerprint is the id itself. The index adds no false positives of its own, but
+ * hashed external ids (see EntityId::FromExternal) can share an id, so a duplicate of one may be a distinct trade.
+ * The only id that would collide with the empty marker is the empty id, which is mapped to a reserved value.
+ */
+uint64_t TradeIdIndex::Fingerprint(const TradeId& tradeId) {
+    uint64_t value = tradeId.GetValue();
+    return value != 0 ? value : ~uint64_t(0);
+}
+
+// SplitMix64 finaliser. Sequential ids differ only in their low bits, so they are scrambled before picking a slot.
+uint64_t TradeIdIndex::Mix(uint64_t fingerprint) {
+    fingerprint ^= fingerprint >> 30;
+    fingerprint *= 0xbf58476d1ce4e5b9ULL;
+    fingerprint ^= fingerprint >> 27;
+    fingerprint *= 0x94d049bb133111ebULL;
+    fingerprint ^= fingerprint >> 31;
+    return fingerprint;
+}
+
+bool TradeIdIndex::Find(const vector<uint64_t>& table, uint64_t fingerprint) const {
+    size_t slot = Mix(fingerprint) & mask;
+    while (table[slot] != 0) {
+        if (table[slot] == fingerprint) {
+            return true;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return false;
+}
+
+/**
+ * The current generation becomes the previous one and the oldest ids are forgotten.
+ * The table memory is reused, so nothing is allocated after construction.
+ */
+void TradeIdIndex::Retire() {
+    previous.swap(current);
+    previousSize = currentSize;
+    fill(current.begin(), current.end(), 0);
+    currentSize = 0;
+    generations++;
+}
+
+#endif //TRADE_ID_INDEX_HPP
@@ -0,0 +1,299 @@
+/**
+ * tradingflows.hpp
+ *
+ * This file wires the services of the bond trading system into the flows run by main.cpp and the benchmark. It includes:
+ * - setupProducts: Loads the product universe into the BondProductService from a securities file if there is one, and otherwise
+ *   adds the six on-the-run Treasuries.
+ * - setupSectors: Registers the FrontEnd, Belly and LongEnd sectors with the BondRiskService for bucketed risk and turns on key-rate risk.
+ * - The BondRiskService is shared by the streaming flow, which feeds it prices, and the trades flow, which feeds it positions.
+ *   The BondScenarioService is fed the same way and runs the end-of-day curve shock grid once all flows are done.
+ * - runTradesAndExecutionFlow: Sets up trade booking, position management, risk assessment services, and their historical data services.
+ *   It integrates external trade and market data through file connectors. With a journal, positions are first recovered from it
+ *   and every booked trade, with the position change it makes, is then appended to it before the trade reaches positions.
+ * - runInquiryFlow: Establishes the bond inquiry service and its listener, linking to an external inquiries data source.
+ * - runStreamingFlow: Implements services for bond pricing, GUI updates, algorithmic streaming, streaming services,
+ *   and a historical data service for price streams. It also connects to an external bond prices file for data input.
+ *
+ * - writeHistoryBars: With the historical services' caches turned on (historyCachePoints), each flow ends by writing the OHLC,
+ *   volume and VWAP bars its historical services rolled up to bars_<series>.csv.
+ *
+ * Input files are read from, and output files written to, the current directory, unless an input is given as a stream source.
+ * CSV inputs are decoded on worker threads when parseThreads is set, and still delivered in file order.
+ * The pricing, market data, position, algo execution and inquiry services, and the execution trade generator, are attached to
+ * the Checkpointer as they are created, so they are restored from a loaded snapshot before their inputs are read.
+ */
+
+#ifndef TRADING_FLOWS_HPP
+#define TRADING_FLOWS_HPP
+
+#include <fstream>
+#include <limits>
+#include <sys/stat.h>
+#include "BondPricingService.hpp"
+#include "GUIService.hpp"
+#include "BondAlgoStreamingService.hpp"
+#include "BondStreamingService.hpp"
+#include "BondPriceStreamsHistoricalDataService.hpp"
+#include "BondInquiryService.hpp"
+#include "BondTradeBookingService.hpp"
+#include "BondPositionService.hpp"
+#include "BondPositionHistoricalDataService.hpp"
+#include "BondRiskHistoricalDataService.hpp"
+#include "BondRiskService.hpp"
+#include "BondMarketDataService.hpp"
+#include "BondAlgoExecutionService.hpp"
+#include "BondExecutionService.hpp"
+#include "BondExecutionHistoricalDataService.hpp"
+#include "BondScenarioService.hpp"
+#include "journal.hpp"
+
+// Settlement date that bond analytics discount to. Matches the issue dates of the on-the-run set below.
+const date VALUATION_DATE(2017, Dec, 29);
+
+// Command line options shared by the flows
+struct RunOptions {
+    HistoricalStorage storage = CSV_STORAGE;
+    ReplayOptions replay;
+    bool binaryInput = false;
+    // Where main exports metric snapshots ('unix:/path' for a socket); empty for none
+    string metricsTarget;
+    unsigned int metricsIntervalMillis = 1000;
+    // Where main writes the event trace; empty for none
+    string traceFile;
+    uint64_t traceSampleEvery = 1;
+    // Snapshot to restore the services from before reading inputs; empty for a cold start
+    string restoreFile;
+    // Where snapshots are written at the end of the run (and every checkpointEvery input events if not 0); empty for none
+    string checkpointFile;
+    uint64_t checkpointEvery = 0;
+    // Write-ahead journal of booked trades and position changes; empty for none
+    string journalFile;
+    JournalOptions journal;
+    // Reference data for the product universe; the on-the-run Treasuries are used if it does not exist
+    string securitiesFile = "securities.csv";
+    // Worker threads each CSV input is decoded on (0 decodes on the flow's own thread), and the chunks they are given
+    size_t parseThreads = 0;
+    size_t parseChunkBytes = INPUT_CHUNK_BYTES;
+    // Where each CSV input is read from: a file, or a stream source ('-', 'fifo:PATH', 'unix:PATH' or 'tail:PATH')
+    string pricesInput = "prices.csv";
+    string marketDataInput = "marketdata.csv";
+    string tradesInput = "trades.csv";
+    string inquiriesInput = "inquiries.csv";
+    // How long a stream may go without data before it ends; 0 waits until its writer closes it
+    unsigned int streamIdleMillis = 0;
+    // Points the historical services cache per key (0 leaves their caches off), and the length of the bars they roll up
+    size_t historyCachePoints = 0;
+    int64_t historyBarMicros = 1000000;
+};
+
+void setupProducts(const string& securitiesFile = "securities.csv");
+void setupSectors(BondRiskService* riskService);
+void runStreamingFlow(BondRiskService* riskService, BondScenarioService* scenarioService, const RunOptions& options);
+void runInquiryFlow(const RunOptions& options);
+void runTradesAndExecutionFlow(BondRiskService* riskService, BondScenarioService* scenarioService, const RunOptions& options);
+template<typename T>
+void configureHistoryCache(HistoricalDataService<T>* service, const RunOptions& options);
+template<typename T>
+void writeHistoryBars(const HistoricalDataService<T>* service, const string& series);
+
+void setupProducts(const string& securitiesFile) {
+    auto productService = BondProductService::GetInstance();
+
+    struct stat info;
+    if (stat(securitiesFile.c_str(), &info) == 0) {
+        size_t loaded = productService->LoadSecurities(securitiesFile);
+        std::cout << "Loaded " << loaded << " securities from " << securitiesFile << std::endl;
+        return;
+    }
+
+    Bond T2("9128283H1", CUSIP, "T", 1.750, date(2019, Nov, 30));
+    Bond T3("9128283L2", CUSIP, "T", 1.875, date(2020, Dec, 15));
+    Bond T5("912828M80", CUSIP, "T", 2.0, date(2022, Nov, 30));
+    Bond T7("9128283J7", CUSIP, "T", 2.125, date(2024, Nov, 30));
+    Bond T10("9128283F5", CUSIP, "T", 2.25, date(2027, Dec, 15));
+    Bond T30("912810RZ3", CUSIP, "T", 2.75, date(2047, Dec, 15));
+
+    productService->Add(T2);
+    productService->Add(T3);
+    productService->Add(T5);
+    productService->Add(T7);
+    productService->Add(T10);
+    productService->Add(T30);
+}
+
+void setupSectors(BondRiskService* riskService) {
+    riskService->RegisterSector(BucketedSector<Bond>(vector<string>{ "9128283H1", "9128283L2" }, "FrontEnd"));
+    riskService->RegisterSector(BucketedSector<Bond>(vector<string>{ "912828M80", "9128283J7", "9128283F5" }, "Belly"));
+    riskService->RegisterSector(BucketedSector<Bond>(vector<string>{ "912810RZ3" }, "LongEnd"));
+    riskService->EnableKeyRateRisk(TenorBucket::StandardBuckets({ 2.0, 3.0, 5.0, 7.0, 10.0, 30.0 }));
+}
+
+template<typename T>
+void configureHistoryCache(HistoricalDataService<T>* service, const RunOptions& options) {
+    if (options.historyCachePoints > 0) {
+        service->ConfigureCache(options.historyCachePoints, options.historyBarMicros, TIME_SERIES_DEFAULT_BAR_RETENTION);
+    }
+}
+
+/**
+ * Write every bar held in a historical service's cache, oldest first for each key, to bars_<series>.csv.
+ * Does nothing while the cache is off.
+ */
+template<typename T>
+void writeHistoryBars(const HistoricalDataService<T>* service, const string& series) {
+    const TimeSeriesCache<T>& cache = service->GetCache();
+    if (!cache.IsEnabled()) {
+        return;
+    }
+    string path = "bars_" + series + ".csv";
+    ofstream file(path);
+    if (!file) {
+        std::cerr << "Unable to open file " << path;
+        exit(1);
+    }
+    file << "Start,Key,Open,High,Low,Close,Volume,VWAP,Count" << std::endl;
+    for (const string& key : cache.GetProductIds()) {
+        for (const TimeSeriesBar& bar : cache.GetBars(key, numeric_limits<int64_t>::min(), numeric_limits<int64_t>::max())) {
+            file << FromEpochMicros(bar.start) << "," << key << "," << bar.open << "," << bar.high << "," << bar.low << ","
+                << bar.close << "," << bar.volume << "," << bar.GetVWAP() << "," << bar.count << "\n";
+        }
+    }
+}
+
+void runTradesAndExecutionFlow(BondRiskService* riskService, BondScenarioService* scenarioService, const RunOptions& options) {
+    auto tradeBookingService = new BondTradeBookingService();
+    auto positionService = new BondPositionService();
+    Checkpointer::GetInstance().Attach(positionService);
+    auto positionHistoricalDataService = new BondPositionHistoricalDataService(options.storage);
+    auto riskHistoricalDataService = new BondRiskHistoricalDataService(options.storage);
+    configureHistoryCache(positionHistoricalDataService, options);
+    configureHistoryCache(riskHistoricalDataService, options);
+
+    auto tradeListener = new BondTradesServiceListener(positionService);
+    auto positionListener = new BondPositionServiceListener(positionHistoricalDataService);
+    auto positionDeltaListenerFromRisk = new BondPositionDeltaRiskServiceListener(riskService);
+    auto positionListenerFromScenario = new BondPositionScenarioServiceListener(scenarioService);
+    auto riskListener = new BondRiskServiceListener(riskHistoricalDataService);
+    auto bucketedRiskListener = new BondBucketedRiskServiceListener(riskHistoricalDataService);
+
+    positionService->AddListener(positionListener);
+    positionService->AddDeltaListener(positionDeltaListenerFromRisk);
+    positionService->AddListener(positionListenerFromScenario);
+    riskService->AddListener(riskListener);
+    riskService->AddSectorListener(bucketedRiskListener);
+
+    // Recovered positions reach the risk and history listeners, but are not journaled a second time. The journal listener goes
+    // ahead of the position listener, so each trade is journaled before any of its effects are published.
+    JournalWriter* journal = nullptr;
+    if (!options.journalFile.empty()) {
+        uint64_t recovered = RecoverFromJournal(options.journalFile, tradeBookingService, positionService);
+        std::cout << "Recovered " << recovered << " records from " << options.journalFile << std::endl;
+        journal = new JournalWriter(options.journalFile, options.journal);
+        tradeBookingService->AddListener(new BondTradeJournalListener(journal, options.journal.waitForCommit));
+    }
+    tradeBookingService->AddListener(tradeListener);
+
+    auto marketDataService = new BondMarketDataService();
+    Checkpointer::GetInstance().Attach(marketDataService);
+    auto algoExecutionService = new BondAlgoExecutionService();
+    Checkpointer::GetInstance().Attach(algoExecutionService);
+    auto executionService = new BondExecutionService();
+    auto executionHistoricalDataService = new BondExecutionHistoricalDataService(options.storage);
+    configureHistoryCache(executionHistoricalDataService, options);
+
+    auto marketDataListener = new BondMarketDataServiceListener(algoExecutionService);
+    auto algoExecutionListener = new BondAlgoExecutionServiceListener(executionService);
+    auto executionListener = new BondExecutionOrderServiceListener(executionHistoricalDataService);
+    auto executionListenerFromTrade = new BondExecutionServiceListener(tradeBookingService);
+    Checkpointer::GetInstance().Attach(executionListenerFromTrade);
+
+    marketDataService->AddListener(marketDataListener);
+    algoExecutionService->AddListener(algoExecutionListener);
+    executionService->AddListener(executionListener);
+    executionService->AddListener(executionListenerFromTrade);
+
+    std::cout << "Processing " << options.tradesInput << std::endl;
+    auto tradesConnector = new BondTradesConnector(options.tradesInput, tradeBookingService);
+    tradesConnector->SetReplay(options.replay);
+    tradesConnector->SetParallel(options.parseThreads, options.parseChunkBytes);
+    tradesConnector->SetStreamIdleTimeout(options.streamIdleMillis);
+    tradeBookingService->Subscribe(tradesConnector);
+
+    if (options.binaryInput) {
+        std::cout << "Processing marketdata.bin" << std::endl;
+        auto marketDataConnector = new BondMarketDataBinaryConnector("marketdata.bin", marketDataService);
+        marketDataConnector->SetReplay(options.replay);
+        marketDataService->Subscribe(marketDataConnector);
+    }
+    else {
+        std::cout << "Processing " << options.marketDataInput << std::endl;
+        auto marketDataConnector = new BondMarketDataConnector(options.marketDataInput, marketDataService);
+        marketDataConnector->SetReplay(options.replay);
+        marketDataConnector->SetParallel(options.parseThreads, options.parseChunkBytes);
+        marketDataConnector->SetStreamIdleTimeout(options.streamIdleMillis);
+        marketDataService->Subscribe(marketDataConnector);
+    }
+
+    if (journal) {
+        journal->Close();
+    }
+    writeHistoryBars(positionHistoricalDataService, "positions");
+    writeHistoryBars(riskHistoricalDataService, "risk");
+    writeHistoryBars(executionHistoricalDataService, "execution");
+}
+
+void runInquiryFlow(const RunOptions& options) {
+    auto inquiryService = new BondInquiryService();
+    Checkpointer::GetInstance().Attach(inquiryService);
+    auto inquiryServiceListener = new BondInquiryServiceListener(inquiryService);
+    inquiryService->AddListener(inquiryServiceListener);
+
+    std::cout << "Processing " << options.inquiriesInput << std::endl;
+    auto inquiryConnector = new BondInquirySubscriber(options.inquiriesInput, inquiryService);
+    inquiryConnector->SetReplay(options.replay);
+    inquiryConnector->SetParallel(options.parseThreads, options.parseChunkBytes);
+    inquiryConnector->SetStreamIdleTimeout(options.streamIdleMillis);
+    inquiryService->Subscribe(inquiryConnector);
+}
+
+void runStreamingFlow(BondRiskService* riskService, BondScenarioService* scenarioService, const RunOptions& options) {
+    auto pricingService = new BondPricingService();
+    Checkpointer::GetInstance().Attach(pricingService);
+    auto guiService = new GUIService(300);
+    auto algoStreamingService = new BondAlgoStreamingService();
+    auto streamingService = new BondStreamingService();
+    auto historicalDataService = new BondPriceStreamsHistoricalDataService(options.storage);
+    configureHistoryCache(historicalDataService, options);
+
+    auto guiServiceListener = new BondPriceServiceListener(guiService);
+    auto algoStreamingServiceListener = new BondPricesServiceListener(algoStreamingService);
+    auto streamingServiceListener = new BondAlgoStreamServiceListener(streamingService);
+    auto historicalDataServiceListener = new BondPriceStreamsServiceListener(historicalDataService);
+    auto riskServiceListener = new BondPriceRiskServiceListener(riskService);
+    auto scenarioServiceListener = new BondPriceScenarioServiceListener(scenarioService);
+
+    pricingService->AddListener(guiServiceListener);
+    pricingService->AddListener(algoStreamingServiceListener);
+    pricingService->AddListener(riskServiceListener);
+    pricingService->AddListener(scenarioServiceListener);
+    algoStreamingService->AddListener(streamingServiceListener);
+    streamingService->AddListener(historicalDataServiceListener);
+
+    if (options.binaryInput) {
+        std::cout << "Processing prices.bin" << std::endl;
+        auto pricesConnector = new BondPricesBinaryConnector("prices.bin", pricingService);
+        pricesConnector->SetReplay(options.replay);
+        pricingService->Subscribe(pricesConnector);
+    }
+    else {
+        std::cout << "Processing " << options.pricesInput << std::endl;
+        auto pricesConnector = new BondPricesConnector(options.pricesInput, pricingService);
+        pricesConnector->SetReplay(options.replay);
+        pricesConnector->SetParallel(options.parseThreads, options.parseChunkBytes);
+        pricesConnector->SetStreamIdleTimeout(options.streamIdleMillis);
+        pricingService->Subscribe(pricesConnector);
+    }
+    writeHistoryBars(historicalDataService, "streaming");
+}
+
+#endif //TRADING_FLOWS_HPP